@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++14
+CONFIG += console c++14 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -8,13 +8,42 @@ SOURCES += main.cpp \
     httpparser.cpp \
     ipaddress.cpp \
     selector.cpp \
+    iouring.cpp \
     tcpsocket.cpp \
-    logger.cpp
+    logger.cpp \
+    proxygroup.cpp \
+    pipepool.cpp \
+    resolver.cpp \
+    dnscache.cpp \
+    upstreampool.cpp \
+    requestparser.cpp \
+    responseframer.cpp \
+    responsecache.cpp \
+    diskcache.cpp \
+    timerwheel.cpp \
+    bufferpool.cpp \
+    histogram.cpp \
+    metricsserver.cpp
 
 HEADERS += \
     proxy.hpp \
     httpparser.hpp \
     ipaddress.hpp \
     selector.hpp \
+    iouring.hpp \
     tcpsocket.hpp \
-    logger.hpp
+    logger.hpp \
+    proxygroup.hpp \
+    pipepool.hpp \
+    resolver.hpp \
+    dnscache.hpp \
+    upstreampool.hpp \
+    requestparser.hpp \
+    responseframer.hpp \
+    responsecache.hpp \
+    diskcache.hpp \
+    timerwheel.hpp \
+    bufferpool.hpp \
+    slabpool.hpp \
+    histogram.hpp \
+    metricsserver.hpp
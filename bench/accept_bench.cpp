@@ -0,0 +1,152 @@
+// Measures how fast the proxy takes and drops connections: a proxy runs in its own thread and the benchmark
+// keeps a number of loopback clients connected, every client is reset as soon as the next one is connected.
+// Reports connections per second and the allocations per connection, the client side allocates nothing.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "proxy.hpp"
+
+namespace
+{
+
+std::atomic<uint64_t> allocations(0);
+
+int connect_to(const uint16_t port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    // the client is reset instead of closed, so thousands of connections leave no sockets in TIME_WAIT
+    linger reset = {1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    return fd;
+}
+
+void wait_for_closing(const Proxy& proxy)
+{
+    while (proxy.get_counters().active_connections != 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+int main(int argc, char* argv[])
+{
+    const std::size_t connections = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const std::size_t concurrency = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+    const uint16_t port = argc > 3 ? static_cast<uint16_t>(std::strtoul(argv[3], nullptr, 10)) : 18080;
+    if (connections == 0 || concurrency == 0)
+    {
+        std::fprintf(stderr, "usage: %s [connections] [concurrency] [port]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the sockets report every reset client with perror, so stderr is dropped, the proxy logs only its errors
+    FILE* out = stdout;
+    const int null_fd = ::open("/dev/null", O_WRONLY);
+    if (null_fd == -1)
+    {
+        perror("open");
+        return EXIT_FAILURE;
+    }
+    ::dup2(null_fd, STDERR_FILENO);
+
+    // the proxy never stops, the process ends with it still running
+    static Proxy proxy(port, Logger(null_fd, Logger::LOG_LEVEL::ERROR));
+    std::thread([]() { proxy.start(); }).detach();
+
+    int probe = -1;
+    for (int attempt = 0; attempt < 1000 && (probe = connect_to(port)) == -1; ++attempt)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (probe == -1)
+    {
+        std::fprintf(out, "can't connect to the proxy at %u port\n", port);
+        std::fflush(out);
+        std::_Exit(EXIT_FAILURE);
+    }
+    ::close(probe);
+    wait_for_closing(proxy);
+
+    std::fprintf(out, "%zu connections, %zu at once\nround | connections/s | allocations/connection\n",
+                 connections, concurrency);
+    std::vector<int> clients(concurrency, -1);
+    for (int round = 1; round <= 3; ++round)
+    {
+        allocations.store(0);
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < connections; ++i)
+        {
+            int& client = clients[i % concurrency];
+            if (client != -1)
+            {
+                ::close(client);
+            }
+
+            client = connect_to(port);
+            if (client == -1)
+            {
+                std::fprintf(out, "can't connect the client %zu\n", i);
+                std::fflush(out);
+                std::_Exit(EXIT_FAILURE);
+            }
+        }
+
+        for (int& client : clients)
+        {
+            ::close(client);
+            client = -1;
+        }
+        wait_for_closing(proxy);
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+        std::fprintf(out, "%5d | %13.0f | %22.2f\n", round, connections / time.count(),
+                     static_cast<double>(allocations.load()) / connections);
+    }
+
+    std::fflush(out);
+    std::_Exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,49 @@
+TEMPLATE = app
+CONFIG += console c++14 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += accept_bench.cpp \
+    ../proxy.cpp \
+    ../httpparser.cpp \
+    ../ipaddress.cpp \
+    ../selector.cpp \
+    ../iouring.cpp \
+    ../tcpsocket.cpp \
+    ../logger.cpp \
+    ../proxygroup.cpp \
+    ../pipepool.cpp \
+    ../resolver.cpp \
+    ../dnscache.cpp \
+    ../upstreampool.cpp \
+    ../requestparser.cpp \
+    ../responseframer.cpp \
+    ../responsecache.cpp \
+    ../diskcache.cpp \
+    ../timerwheel.cpp \
+    ../bufferpool.cpp \
+    ../histogram.cpp
+
+HEADERS += \
+    ../proxy.hpp \
+    ../httpparser.hpp \
+    ../ipaddress.hpp \
+    ../selector.hpp \
+    ../iouring.hpp \
+    ../tcpsocket.hpp \
+    ../logger.hpp \
+    ../proxygroup.hpp \
+    ../pipepool.hpp \
+    ../resolver.hpp \
+    ../dnscache.hpp \
+    ../upstreampool.hpp \
+    ../requestparser.hpp \
+    ../responseframer.hpp \
+    ../responsecache.hpp \
+    ../diskcache.hpp \
+    ../timerwheel.hpp \
+    ../bufferpool.hpp \
+    ../slabpool.hpp \
+    ../histogram.hpp
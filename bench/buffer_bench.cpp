@@ -0,0 +1,220 @@
+// Measures how responses are relayed between two loopback connections: a fresh string per response
+// filled from a 1024-byte receive buffer as the proxy did before, or pooled chunks received into
+// a whole chunk at a time. Reports the throughput, the receive calls and the allocations per response.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bufferpool.hpp"
+
+namespace
+{
+
+std::atomic<uint64_t> allocations(0);
+
+const std::size_t old_buffer_size = 1024;
+
+// a connected pair of loopback sockets, the first one is sent to and the second one is received from
+bool make_connection(int* sender, int* receiver)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener == -1
+            || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+            || ::listen(listener, 1) == -1
+            || ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == -1)
+    {
+        perror("listen");
+        return false;
+    }
+
+    *sender = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (*sender == -1 || ::connect(*sender, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        perror("connect");
+        return false;
+    }
+
+    *receiver = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    return *receiver != -1;
+}
+
+bool send_all(const int fd, const char* data, std::size_t size)
+{
+    while (size != 0)
+    {
+        auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+std::string make_header(const std::size_t response_bytes)
+{
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(response_bytes) + "\r\n\r\n";
+}
+
+bool relay_with_string(const int from, const int to, const std::size_t response_bytes, uint64_t* receives)
+{
+    std::string buffer = make_header(response_bytes);
+    char receive_buffer[old_buffer_size];
+    for (std::size_t remaining = response_bytes; remaining != 0; )
+    {
+        auto received = ::recv(from, receive_buffer, std::min(remaining, sizeof(receive_buffer)), 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        ++*receives;
+        remaining -= received;
+
+        buffer.append(receive_buffer, received);
+        if (!send_all(to, buffer.data(), buffer.size()))
+        {
+            return false;
+        }
+        buffer.clear();
+    }
+    return true;
+}
+
+bool relay_with_chunks(BufferPool* pool, const int from, const int to, const std::size_t response_bytes, uint64_t* receives)
+{
+    ChunkBuffer buffer(pool);
+    buffer.append(make_header(response_bytes));
+    for (std::size_t remaining = response_bytes; remaining != 0; )
+    {
+        std::size_t capacity = 0;
+        auto data = buffer.prepare(&capacity);
+        auto received = ::recv(from, data, std::min(remaining, capacity), 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        ++*receives;
+        remaining -= received;
+
+        buffer.commit(received);
+        while (!buffer.empty())
+        {
+            auto sent = ::send(to, buffer.front(), buffer.front_size(), MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return false;
+            }
+            buffer.consume(sent);
+        }
+    }
+    return true;
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+int main(int argc, char* argv[])
+{
+    const std::size_t responses = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    const std::size_t response_bytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64 * 1024;
+    const std::size_t max_idle_chunks = 64;
+
+    int source = -1;
+    int input = -1;
+    int output = -1;
+    int sink = -1;
+    if (!make_connection(&source, &input) || !make_connection(&output, &sink))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // the server side keeps sending, the client side only drains
+    std::thread feed([source]()
+    {
+        std::vector<char> data(64 * 1024, 'x');
+        while (send_all(source, data.data(), data.size()))
+        {}
+    });
+
+    std::thread drain([sink]()
+    {
+        std::vector<char> data(64 * 1024);
+        while (::recv(sink, data.data(), data.size(), 0) > 0)
+        {}
+    });
+
+    BufferPool pool(max_idle_chunks);
+    std::cout << "relaying " << responses << " responses of " << response_bytes << " bytes\n"
+              << "buffer | MB/s     | receives/response | allocations/response\n";
+    for (const bool use_chunks : { false, true, false, true })
+    {
+        uint64_t receives = 0;
+        allocations.store(0);
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < responses; ++i)
+        {
+            const bool is_relayed = use_chunks ? relay_with_chunks(&pool, input, output, response_bytes, &receives)
+                                               : relay_with_string(input, output, response_bytes, &receives);
+            if (!is_relayed)
+            {
+                std::cerr << "can't relay the response " << i << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+        std::printf("%-6s | %8.1f | %17.1f | %20.2f\n", use_chunks ? "chunks" : "string",
+                    static_cast<double>(responses) * response_bytes / time.count() / 1e6,
+                    static_cast<double>(receives) / responses,
+                    static_cast<double>(allocations.load()) / responses);
+    }
+
+    const auto counters = pool.get_counters();
+    std::cout << "chunks allocated : " << counters.allocated_chunks << " reused : " << counters.reused_chunks
+              << " idle : " << counters.idle_chunks << "\n";
+
+    // the feed stops on the broken connection
+    ::shutdown(input, SHUT_RDWR);
+    ::shutdown(output, SHUT_WR);
+    feed.join();
+    drain.join();
+    for (const int fd : { source, input, output, sink })
+    {
+        ::close(fd);
+    }
+    return EXIT_SUCCESS;
+}
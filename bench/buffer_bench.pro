@@ -0,0 +1,12 @@
+TEMPLATE = app
+CONFIG += console c++14 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += buffer_bench.cpp \
+    ../bufferpool.cpp
+
+HEADERS += \
+    ../bufferpool.hpp
@@ -0,0 +1,202 @@
+// Measures how fast large responses are served from the disk cache.
+// The cache is filled with objects of the given size, then every object is found and its body is sent
+// over a loopback TCP connection either with sendfile(2) as the proxy does, or read into a buffer and sent.
+// The reader on the other side only drains the connection.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "diskcache.hpp"
+
+namespace
+{
+
+const std::size_t buffer_size = 64 * 1024;
+
+// a connected pair of loopback sockets, the first one is sent to and the second one is drained
+bool make_connection(int* sender, int* receiver)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener == -1
+            || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+            || ::listen(listener, 1) == -1
+            || ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) == -1)
+    {
+        perror("listen");
+        return false;
+    }
+
+    *sender = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (*sender == -1 || ::connect(*sender, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1)
+    {
+        perror("connect");
+        return false;
+    }
+
+    *receiver = ::accept(listener, nullptr, nullptr);
+    ::close(listener);
+    return *receiver != -1;
+}
+
+bool send_all(const int fd, const char* data, std::size_t size)
+{
+    while (size != 0)
+    {
+        auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool send_with_sendfile(const int fd, const DiskCache::Hit& hit)
+{
+    off_t offset = hit.offset;
+    std::size_t size = hit.size;
+    while (size != 0)
+    {
+        auto sent = ::sendfile(fd, hit.segment->fd, &offset, size);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        size -= sent;
+    }
+    return true;
+}
+
+bool send_with_copy(const int fd, const DiskCache::Hit& hit, std::vector<char>* buffer)
+{
+    uint64_t offset = hit.offset;
+    uint64_t size = hit.size;
+    while (size != 0)
+    {
+        auto received = ::pread(hit.segment->fd, buffer->data(), std::min<uint64_t>(size, buffer->size()), offset);
+        if (received <= 0 || !send_all(fd, buffer->data(), received))
+        {
+            return false;
+        }
+        offset += received;
+        size -= received;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t objects = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    const std::size_t object_bytes = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4) * 1024 * 1024;
+    const std::size_t rounds = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4;
+    const std::string directory = argc > 4 ? argv[4] : "diskcache_bench.dir";
+
+    DiskCache cache(directory, 2 * objects * object_bytes + 64 * 1024 * 1024);
+    if (!cache.open() || object_bytes + 1024 > cache.get_max_response_bytes())
+    {
+        std::cerr << "can't use " << directory << " for objects of " << object_bytes << " bytes\n";
+        return EXIT_FAILURE;
+    }
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: bench\r\n\r\n";
+    const std::string header = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(object_bytes)
+            + "\r\nCache-Control: max-age=3600\r\n\r\n";
+    std::vector<char> body(buffer_size, 'x');
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < objects; ++i)
+    {
+        DiskCache::Writer writer;
+        bool is_written = cache.reserve(header.size() + object_bytes, &writer)
+                && cache.write(&writer, header.data(), header.size());
+        for (std::size_t written = 0; is_written && written < object_bytes; written += body.size())
+        {
+            // the cache refuses a part while too much waits for the disk, the benchmark waits instead
+            const auto size = std::min(body.size(), object_bytes - written);
+            is_written = cache.write(&writer, body.data(), size);
+            if (!is_written)
+            {
+                cache.flush();
+                is_written = cache.write(&writer, body.data(), size);
+            }
+        }
+
+        if (!is_written)
+        {
+            std::cerr << "can't store the object " << i << "\n";
+            return EXIT_FAILURE;
+        }
+        cache.commit(writer, "http://bench/" + std::to_string(i), request, header, 3600, 0);
+    }
+    cache.flush();
+    std::chrono::duration<double> fill_time = std::chrono::steady_clock::now() - start;
+    std::cout << "stored " << objects << " objects of " << object_bytes << " bytes: "
+              << objects * object_bytes / fill_time.count() / 1e6 << " MB/s\n";
+
+    int sender = -1;
+    int receiver = -1;
+    if (!make_connection(&sender, &receiver))
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::thread drain([receiver]()
+    {
+        std::vector<char> buffer(buffer_size);
+        while (::recv(receiver, buffer.data(), buffer.size(), 0) > 0)
+        {}
+    });
+
+    std::vector<char> buffer(buffer_size);
+    std::cout << "method   | MB/s     | hits/s\n";
+    for (const bool use_sendfile : { true, false, true, false })
+    {
+        start = std::chrono::steady_clock::now();
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            for (std::size_t i = 0; i < objects; ++i)
+            {
+                DiskCache::Hit hit;
+                const bool is_sent = cache.find("http://bench/" + std::to_string(i), request, &hit)
+                        && (use_sendfile ? send_with_sendfile(sender, hit) : send_with_copy(sender, hit, &buffer));
+                if (!is_sent)
+                {
+                    std::cerr << "can't serve the object " << i << "\n";
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+        const double hits = static_cast<double>(rounds * objects);
+        std::printf("%-8s | %8.1f | %8.1f\n", use_sendfile ? "sendfile" : "copy",
+                    hits * object_bytes / time.count() / 1e6, hits / time.count());
+    }
+
+    ::shutdown(sender, SHUT_WR);
+    drain.join();
+    ::close(sender);
+    ::close(receiver);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+TEMPLATE = app
+CONFIG += console c++14 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += diskcache_bench.cpp \
+    ../diskcache.cpp \
+    ../responsecache.cpp \
+    ../httpparser.cpp \
+    ../requestparser.cpp
+
+HEADERS += \
+    ../diskcache.hpp \
+    ../responsecache.hpp \
+    ../httpparser.hpp \
+    ../requestparser.hpp
@@ -0,0 +1,298 @@
+// Compares how the selector hands events to their handlers: the former one finds a heap-allocated
+// registration by the descriptor in unordered_map and calls std::function, the current one calls
+// the handler that epoll_event.data.ptr points at. The dispatch alone runs over a shuffled array of events,
+// the whole iteration runs epoll_wait over eventfds that are all signalled before every round.
+// Both are measured for 100 to 50000 descriptors unless the number is given.
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "logger.hpp"
+#include "selector.hpp"
+
+namespace
+{
+
+// the former registration, a handler bound to its object as the proxy used to bind it
+class FunctionSelector final
+{
+public:
+    using THandler = std::function<void(const epoll_event& event)>;
+
+    FunctionSelector()
+        : m_selector_fd(::epoll_create1(0))
+    {}
+
+    ~FunctionSelector() { ::close(m_selector_fd); }
+
+    void add(const int fd, const uint32_t mode, const THandler& handler)
+    {
+        auto event = std::make_unique<epoll_event>();
+        event->data.fd = fd;
+        event->events = mode | EPOLLET;
+        ::epoll_ctl(m_selector_fd, EPOLL_CTL_ADD, fd, event.get());
+        m_events[fd] = Event{std::move(event), handler};
+        m_buffer.resize(m_events.size());
+    }
+
+    void dispatch(const epoll_event* events, const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto event_iterator = m_events.find(events[i].data.fd);
+            if (event_iterator == m_events.end())
+            {
+                continue;
+            }
+            event_iterator->second.handler(events[i]);
+        }
+    }
+
+    std::size_t do_iteration()
+    {
+        int n = ::epoll_wait(m_selector_fd, m_buffer.data(), m_buffer.size(), -1);
+        dispatch(m_buffer.data(), n > 0 ? n : 0);
+        return n > 0 ? n : 0;
+    }
+
+private:
+    struct Event
+    {
+        std::unique_ptr<epoll_event> event;
+        THandler handler;
+    };
+
+    int m_selector_fd;
+    std::unordered_map<int, Event> m_events;
+    std::vector<epoll_event> m_buffer;
+};
+
+struct Counter
+{
+    void handle(const epoll_event&) { ++count; }
+
+    uint64_t count = 0;
+};
+
+class CountingHandler final : public Selector::Handler
+{
+public:
+    explicit CountingHandler(uint64_t* count)
+        : m_count(count)
+    {}
+
+    void handle_event(const uint32_t) override { ++*m_count; }
+
+private:
+    uint64_t* m_count;
+};
+
+double get_seconds(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void signal_all(const std::vector<int>& fds)
+{
+    const uint64_t one = 1;
+    for (const int fd : fds)
+    {
+        if (::write(fd, &one, sizeof(one)) != sizeof(one))
+        {
+            perror("write");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void report(FILE* out, const char* name, const char* part, const uint64_t events, const uint64_t expected, const double seconds)
+{
+    if (events != expected)
+    {
+        std::fprintf(stderr, "%s: %llu events are dispatched instead of %llu\n", name,
+                     static_cast<unsigned long long>(events), static_cast<unsigned long long>(expected));
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::fprintf(out, "%-8s | %-9s | %14.1f | %8.2f\n", name, part, events / seconds / 1e6, seconds * 1e9 / events);
+}
+
+// one measurement with the descriptors all registered in both selectors, false if they can't be opened
+bool run(FILE* results, const std::size_t descriptors, const std::size_t rounds)
+{
+    std::vector<int> fds;
+    for (std::size_t i = 0; i < descriptors; ++i)
+    {
+        const int fd = ::eventfd(0, EFD_NONBLOCK);
+        if (fd == -1)
+        {
+            perror("eventfd");
+            for (const int opened : fds)
+            {
+                ::close(opened);
+            }
+            return false;
+        }
+        fds.push_back(fd);
+    }
+
+    Counter counter;
+    FunctionSelector function_selector;
+
+    uint64_t handled = 0;
+    Selector selector(Logger(STDERR_FILENO, Logger::LOG_LEVEL::ERROR));
+    std::vector<CountingHandler> handlers(descriptors, CountingHandler(&handled));
+    for (std::size_t i = 0; i < descriptors; ++i)
+    {
+        function_selector.add(fds[i], EPOLLIN, std::bind(&Counter::handle, &counter, std::placeholders::_1));
+        selector.add(fds[i], EPOLLIN, &handlers[i]);
+    }
+
+    // the same events in an order that doesn't follow the registrations
+    std::vector<epoll_event> by_fd(descriptors);
+    std::vector<epoll_event> by_ptr(descriptors);
+    std::vector<std::size_t> order(descriptors);
+    for (std::size_t i = 0; i < descriptors; ++i)
+    {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(42));
+    for (std::size_t i = 0; i < descriptors; ++i)
+    {
+        by_fd[i].events = by_ptr[i].events = EPOLLIN;
+        by_fd[i].data.fd = fds[order[i]];
+        by_ptr[i].data.ptr = &handlers[order[i]];
+    }
+
+    std::fprintf(results, "%zu descriptors, %zu rounds\nselector | part      | M events/s     | ns/event\n",
+                 descriptors, rounds);
+    std::fflush(results);
+
+    for (int repeat = 0; repeat < 2; ++repeat)
+    {
+        const uint64_t expected = static_cast<uint64_t>(descriptors) * rounds * 8;
+
+        counter.count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t round = 0; round < rounds * 8; ++round)
+        {
+            function_selector.dispatch(by_fd.data(), by_fd.size());
+        }
+        const double function_dispatch = get_seconds(start);
+        const auto function_count = counter.count;
+
+        // the loop of Selector::do_iteration
+        handled = 0;
+        start = std::chrono::steady_clock::now();
+        for (std::size_t round = 0; round < rounds * 8; ++round)
+        {
+            for (const auto& event : by_ptr)
+            {
+                if (event.data.ptr != nullptr)
+                {
+                    static_cast<Selector::Handler*>(event.data.ptr)->handle_event(event.events);
+                }
+            }
+        }
+        const double handler_dispatch = get_seconds(start);
+        const auto handler_count = handled;
+
+        // only the iterations are timed, the eventfds are signalled between them
+        counter.count = 0;
+        double function_iterations = 0;
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            signal_all(fds);
+            start = std::chrono::steady_clock::now();
+            function_selector.do_iteration();
+            function_iterations += get_seconds(start);
+        }
+
+        handled = 0;
+        double handler_iterations = 0;
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            signal_all(fds);
+            start = std::chrono::steady_clock::now();
+            selector.do_iteration();
+            handler_iterations += get_seconds(start);
+        }
+
+        report(results, "function", "dispatch", function_count, expected, function_dispatch);
+        report(results, "handler", "dispatch", handler_count, expected, handler_dispatch);
+        report(results, "function", "iteration", counter.count, expected / 8, function_iterations);
+        report(results, "handler", "iteration", handled, expected / 8, handler_iterations);
+        std::fflush(results);
+    }
+
+    for (const int fd : fds)
+    {
+        ::close(fd);
+    }
+    return true;
+}
+
+// enough descriptors for the largest run if the hard limit lets or the process may raise it
+void raise_descriptor_limit(const std::size_t descriptors)
+{
+    rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur >= descriptors)
+    {
+        return;
+    }
+
+    rlimit wanted = limit;
+    wanted.rlim_cur = std::max<rlim_t>(wanted.rlim_max, descriptors);
+    wanted.rlim_max = wanted.rlim_cur;
+    if (::setrlimit(RLIMIT_NOFILE, &wanted) == -1)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    // without the number of descriptors the benchmark sweeps from a few connections to a loaded proxy,
+    // the rounds shrink as the descriptors grow so that every run dispatches about the same number of events
+    const std::vector<std::size_t> sweep{100, 1000, 10000, 50000};
+    const std::size_t events = 2048000;
+
+    const std::vector<std::size_t> counts = argc > 1 ? std::vector<std::size_t>{std::strtoul(argv[1], nullptr, 10)} : sweep;
+    const std::size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    if (counts.front() == 0 || (argc > 2 && rounds == 0))
+    {
+        std::fprintf(stderr, "usage: %s [descriptors] [rounds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    raise_descriptor_limit(*std::max_element(counts.begin(), counts.end()) + 16);
+
+    for (const auto descriptors : counts)
+    {
+        if (!run(stdout, descriptors, rounds != 0 ? rounds : std::max<std::size_t>(1, events / descriptors)))
+        {
+            rlimit limit;
+            ::getrlimit(RLIMIT_NOFILE, &limit);
+            std::fprintf(stderr, "%zu descriptors are more than the limit of %llu open files, raise it with ulimit -n\n",
+                         descriptors, static_cast<unsigned long long>(limit.rlim_cur));
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
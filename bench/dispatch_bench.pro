@@ -0,0 +1,20 @@
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += dispatch_bench.cpp \
+    ../selector.cpp \
+    ../iouring.cpp \
+    ../timerwheel.cpp \
+    ../tcpsocket.cpp \
+    ../ipaddress.cpp
+
+HEADERS += \
+    ../selector.hpp \
+    ../iouring.hpp \
+    ../timerwheel.hpp \
+    ../tcpsocket.hpp \
+    ../ipaddress.hpp
@@ -0,0 +1,1133 @@
+// Load test of the whole proxy on loopback: an epoll origin server answers with responses of the given size
+// after the given delay, the proxy runs in a child process and a multi-threaded load generator sends requests
+// for the origin through it over keep-alive connections. The closed loop keeps one request in flight
+// on every connection, the open loop sends requests at a fixed rate whether the answers are late or not
+// and counts the latency from the moment a request was due, so a stalled proxy can't hide its queue.
+// The results are printed as one JSON object: requests per second, latency percentiles, cpu time
+// of the proxy per request, its peak resident memory and its system calls per request. Several event backends
+// and the copying and splice(2) relays of response bodies are measured one after another with the same load,
+// one object for each of them.
+// The origin counts the requests that reach it, so with one URL and a delay it shows how many of the concurrent
+// requests the proxy has collapsed into one.
+// The system calls are counted by the functions below that stand in for the ones of libc, all of the proxy's
+// calls go through them, only the calls of the child process, which is the proxy, are counted.
+
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proxygroup.hpp"
+
+namespace
+{
+
+enum class Syscall
+{
+    RECV,
+    SEND,
+    ACCEPT,
+    CONNECT,
+    EPOLL_WAIT,
+    EPOLL_CTL,
+    IO_URING_ENTER,
+    OTHER,    // socket, close, setsockopt, getsockopt, read and write
+    COUNT
+};
+
+const char* const syscall_names[] =
+{
+    "recv", "send", "accept", "connect", "epoll_wait", "epoll_ctl", "io_uring_enter", "other"
+};
+
+const std::size_t syscalls_count = static_cast<std::size_t>(Syscall::COUNT);
+
+// shared with the proxy's process, it is mapped before the fork
+struct Shared
+{
+    std::atomic<uint64_t> syscalls[syscalls_count];
+    std::atomic<int> backend;
+};
+
+Shared* shared = nullptr;
+
+// set in the proxy's process only
+bool is_counting = false;
+
+void count(const Syscall syscall)
+{
+    if (is_counting)
+    {
+        shared->syscalls[static_cast<std::size_t>(syscall)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename Function>
+Function get_next(const char* name) { return reinterpret_cast<Function>(::dlsym(RTLD_NEXT, name)); }
+
+}
+
+extern "C"
+{
+
+ssize_t recv(int fd, void* buffer, size_t size, int flags)
+{
+    static const auto next = get_next<ssize_t (*)(int, void*, size_t, int)>("recv");
+    count(Syscall::RECV);
+    return next(fd, buffer, size, flags);
+}
+
+ssize_t send(int fd, const void* buffer, size_t size, int flags)
+{
+    static const auto next = get_next<ssize_t (*)(int, const void*, size_t, int)>("send");
+    count(Syscall::SEND);
+    return next(fd, buffer, size, flags);
+}
+
+int accept4(int fd, sockaddr* address, socklen_t* length, int flags)
+{
+    static const auto next = get_next<int (*)(int, sockaddr*, socklen_t*, int)>("accept4");
+    count(Syscall::ACCEPT);
+    return next(fd, address, length, flags);
+}
+
+int connect(int fd, const sockaddr* address, socklen_t length)
+{
+    static const auto next = get_next<int (*)(int, const sockaddr*, socklen_t)>("connect");
+    count(Syscall::CONNECT);
+    return next(fd, address, length);
+}
+
+int epoll_wait(int fd, epoll_event* events, int max, int timeout)
+{
+    static const auto next = get_next<int (*)(int, epoll_event*, int, int)>("epoll_wait");
+    count(Syscall::EPOLL_WAIT);
+    return next(fd, events, max, timeout);
+}
+
+int epoll_ctl(int fd, int operation, int target, epoll_event* event) __THROW
+{
+    static const auto next = get_next<int (*)(int, int, int, epoll_event*)>("epoll_ctl");
+    count(Syscall::EPOLL_CTL);
+    return next(fd, operation, target, event);
+}
+
+// io_uring has no wrapper in libc, the selector calls it through syscall
+long syscall(long number, ...) __THROW
+{
+    static const auto next = get_next<long (*)(long, ...)>("syscall");
+    va_list list;
+    va_start(list, number);
+    long arguments[6];
+    for (auto& argument : arguments)
+    {
+        argument = va_arg(list, long);
+    }
+    va_end(list);
+
+    count(number == __NR_io_uring_enter ? Syscall::IO_URING_ENTER : Syscall::OTHER);
+    return next(number, arguments[0], arguments[1], arguments[2], arguments[3], arguments[4], arguments[5]);
+}
+
+int socket(int domain, int type, int protocol) __THROW
+{
+    static const auto next = get_next<int (*)(int, int, int)>("socket");
+    count(Syscall::OTHER);
+    return next(domain, type, protocol);
+}
+
+int close(int fd)
+{
+    static const auto next = get_next<int (*)(int)>("close");
+    count(Syscall::OTHER);
+    return next(fd);
+}
+
+int setsockopt(int fd, int level, int name, const void* value, socklen_t length) __THROW
+{
+    static const auto next = get_next<int (*)(int, int, int, const void*, socklen_t)>("setsockopt");
+    count(Syscall::OTHER);
+    return next(fd, level, name, value, length);
+}
+
+int getsockopt(int fd, int level, int name, void* value, socklen_t* length) __THROW
+{
+    static const auto next = get_next<int (*)(int, int, int, void*, socklen_t*)>("getsockopt");
+    count(Syscall::OTHER);
+    return next(fd, level, name, value, length);
+}
+
+ssize_t read(int fd, void* buffer, size_t size)
+{
+    static const auto next = get_next<ssize_t (*)(int, void*, size_t)>("read");
+    count(Syscall::OTHER);
+    return next(fd, buffer, size);
+}
+
+ssize_t write(int fd, const void* buffer, size_t size)
+{
+    static const auto next = get_next<ssize_t (*)(int, const void*, size_t)>("write");
+    count(Syscall::OTHER);
+    return next(fd, buffer, size);
+}
+
+}
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    bool is_open_loop = false;
+    std::size_t connections = 64;
+    std::size_t threads = 2;
+    double rate = 10000;          // requests per second of the open loop
+    double duration = 10;         // seconds measured
+    double warmup = 2;            // seconds before the measurement
+    std::size_t response_bytes = 1024;
+    unsigned origin_delay = 0;    // milliseconds
+    std::size_t origin_threads = 1;
+    std::size_t proxy_threads = 1;
+    std::size_t urls = 1;         // distinct URLs the requests go to
+    bool is_cacheable = false;    // the origin allows the proxy to cache its responses
+    bool is_collapsing = true;    // the proxy collapses concurrent requests for the same URL
+    // a run fails unless the origin gets every URL once per proxy thread
+    bool is_checking_collapsing = false;
+    uint16_t proxy_port = 18081;     // the runs after the first one use the next ports
+    std::vector<Selector::Backend> backends;
+    std::vector<bool> splices;    // whether the proxy relays response bodies with splice(2)
+};
+
+void usage(const char* name)
+{
+    std::fprintf(stderr, "usage: %s [-m closed|open] [-c connections] [-t threads] [-r rate] [-d seconds] [-w seconds]\n"
+                         "       [-s response bytes] [-D origin delay ms] [-o origin threads] [-P proxy threads]\n"
+                         "       [-u urls] [-a] [-N] [-C] [-p proxy port] [-b epoll,io_uring_poll] [-x copy,splice]\n", name);
+}
+
+bool set_non_blocking(const int fd) { return ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) != -1; }
+
+sockaddr_in make_loopback_address(const uint16_t port)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+// the value of a field, the name is in lower case, -1 if there is no such field
+long get_field(const std::string& header, const std::size_t header_size, const char* name)
+{
+    const std::size_t name_size = std::strlen(name);
+    for (std::size_t line = header.find("\r\n") + 2; line < header_size; line = header.find("\r\n", line) + 2)
+    {
+        std::size_t i = 0;
+        while (i < name_size && line + i < header_size && std::tolower(header[line + i]) == name[i])
+        {
+            ++i;
+        }
+
+        if (i == name_size && header[line + i] == ':')
+        {
+            return std::strtol(header.c_str() + line + i + 1, nullptr, 10);
+        }
+    }
+
+    return -1;
+}
+
+// Answers "GET /<bytes>/<delay ms>" with a body of the size after the delay, requests of a connection
+// are answered in order. Every thread has its own epoll, the listening socket is shared with EPOLLEXCLUSIVE.
+class Origin final
+{
+public:
+    Origin(const std::size_t threads, const bool is_cacheable)
+        : m_listen_fd(-1)
+        , m_port(0)
+        , m_is_cacheable(is_cacheable)
+        , m_running(false)
+        , m_requests(0)
+        , m_threads_count(threads)
+    {}
+
+    ~Origin()
+    {
+        m_running = false;
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+
+        if (m_listen_fd != -1)
+        {
+            ::close(m_listen_fd);
+        }
+    }
+
+    bool start(const std::size_t max_body_size)
+    {
+        m_body.assign(max_body_size, 'x');
+
+        m_listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        auto address = make_loopback_address(0);
+        socklen_t size = sizeof(address);
+        if (m_listen_fd == -1 || ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+                || ::listen(m_listen_fd, SOMAXCONN) == -1
+                || ::getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&address), &size) == -1)
+        {
+            perror("origin");
+            return false;
+        }
+
+        m_port = ntohs(address.sin_port);
+        m_running = true;
+        for (std::size_t i = 0; i < m_threads_count; ++i)
+        {
+            m_threads.emplace_back(&Origin::run, this);
+        }
+        return true;
+    }
+
+    uint16_t get_port() const { return m_port; }
+
+    // all requests that have come from the proxy, the warmup included
+    uint64_t get_requests() const { return m_requests.load(); }
+
+private:
+    struct Response
+    {
+        Clock::time_point due;
+        std::size_t size;
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        std::string input;
+        std::deque<Response> responses;
+
+        // what is being sent of the first response
+        std::string header;
+        std::size_t sent = 0;
+    };
+
+    struct Due
+    {
+        Clock::time_point time;
+        Connection* connection;
+
+        bool operator< (const Due& other) const { return time > other.time; }
+    };
+
+    void run()
+    {
+        const int epoll_fd = ::epoll_create1(0);
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = nullptr;
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &event);
+
+        std::vector<std::unique_ptr<Connection>> connections;
+        std::priority_queue<Due> delayed;
+        std::vector<epoll_event> events(256);
+        while (m_running)
+        {
+            int timeout = 100;
+            if (!delayed.empty())
+            {
+                const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(delayed.top().time - Clock::now());
+                timeout = std::max<int>(0, std::min<int>(timeout, wait.count() + 1));
+            }
+
+            const int n = ::epoll_wait(epoll_fd, events.data(), events.size(), timeout);
+            for (int i = 0; i < n; ++i)
+            {
+                auto connection = static_cast<Connection*>(events[i].data.ptr);
+                if (connection == nullptr)
+                {
+                    accept_all(epoll_fd, &connections);
+                }
+                else if (!handle(connection, &delayed))
+                {
+                    ::close(connection->fd);
+                    connection->fd = -1;
+                }
+            }
+
+            const auto now = Clock::now();
+            while (!delayed.empty() && delayed.top().time <= now)
+            {
+                auto connection = delayed.top().connection;
+                delayed.pop();
+                if (connection->fd != -1 && !send_responses(connection, &delayed))
+                {
+                    ::close(connection->fd);
+                    connection->fd = -1;
+                }
+            }
+
+            // the closed connections are dropped when no delayed response may point to them
+            if (delayed.empty())
+            {
+                connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                                 [](const std::unique_ptr<Connection>& c) { return c->fd == -1; }),
+                                  connections.end());
+            }
+        }
+
+        for (auto& connection : connections)
+        {
+            if (connection->fd != -1)
+            {
+                ::close(connection->fd);
+            }
+        }
+        ::close(epoll_fd);
+    }
+
+    void accept_all(const int epoll_fd, std::vector<std::unique_ptr<Connection>>* connections)
+    {
+        while (true)
+        {
+            const int fd = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd == -1)
+            {
+                return;
+            }
+
+            const int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            connections->emplace_back(new Connection);
+            auto connection = connections->back().get();
+            connection->fd = fd;
+
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+            event.data.ptr = connection;
+            ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    // false if the connection is to be closed
+    bool handle(Connection* connection, std::priority_queue<Due>* delayed)
+    {
+        char buffer[16 * 1024];
+        while (true)
+        {
+            const auto received = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received == 0 || (received == -1 && errno != EAGAIN))
+            {
+                return false;
+            }
+            if (received == -1)
+            {
+                break;
+            }
+            connection->input.append(buffer, received);
+        }
+
+        std::size_t end = 0;
+        while ((end = connection->input.find("\r\n\r\n")) != std::string::npos)
+        {
+            // "GET /<bytes>/<delay> HTTP/1.1", the proxy sends the origin form
+            const auto path = connection->input.find('/');
+            char* next = nullptr;
+            const std::size_t size = std::min<std::size_t>(std::strtoul(connection->input.c_str() + path + 1, &next, 10), m_body.size());
+            const unsigned long delay = *next == '/' ? std::strtoul(next + 1, nullptr, 10) : 0;
+            connection->input.erase(0, end + 4);
+            m_requests.fetch_add(1, std::memory_order_relaxed);
+
+            const auto due = Clock::now() + std::chrono::milliseconds(delay);
+            connection->responses.push_back(Response{due, size});
+            if (delay != 0)
+            {
+                delayed->push(Due{due, connection});
+            }
+        }
+
+        return send_responses(connection, delayed);
+    }
+
+    bool send_responses(Connection* connection, std::priority_queue<Due>* delayed)
+    {
+        const auto now = Clock::now();
+        while (!connection->responses.empty() && connection->responses.front().due <= now)
+        {
+            const auto size = connection->responses.front().size;
+            if (connection->header.empty())
+            {
+                connection->header = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(size)
+                        + (m_is_cacheable ? "\r\nCache-Control: max-age=60\r\n\r\n" : "\r\nCache-Control: no-store\r\n\r\n");
+                connection->sent = 0;
+            }
+
+            const std::size_t total = connection->header.size() + size;
+            while (connection->sent < total)
+            {
+                iovec parts[2];
+                int count = 0;
+                if (connection->sent < connection->header.size())
+                {
+                    parts[count].iov_base = &connection->header[connection->sent];
+                    parts[count++].iov_len = connection->header.size() - connection->sent;
+                }
+                const std::size_t body_offset = connection->sent > connection->header.size()
+                        ? connection->sent - connection->header.size() : 0;
+                parts[count].iov_base = &m_body[body_offset];
+                parts[count++].iov_len = size - body_offset;
+
+                const auto sent = ::writev(connection->fd, parts, count);
+                if (sent == -1)
+                {
+                    return errno == EAGAIN;
+                }
+                connection->sent += sent;
+            }
+
+            connection->header.clear();
+            connection->responses.pop_front();
+        }
+
+        // the next response waits for its time, the timer of the thread wakes it
+        if (!connection->responses.empty() && connection->responses.front().due > now)
+        {
+            delayed->push(Due{connection->responses.front().due, connection});
+        }
+        return true;
+    }
+
+private:
+    int m_listen_fd;
+    uint16_t m_port;
+    bool m_is_cacheable;
+    std::atomic_bool m_running;
+    std::atomic<uint64_t> m_requests;
+    std::size_t m_threads_count;
+    std::string m_body;
+    std::vector<std::thread> m_threads;
+};
+
+// The load of one thread, its connections go through the proxy with keep-alive.
+class Generator final
+{
+public:
+    Generator(const Options& options, const std::vector<std::string>& requests, const std::size_t connections,
+              const double rate, const Clock::time_point start, const Clock::time_point measure, const Clock::time_point end)
+        : m_options(options)
+        , m_requests(requests)
+        , m_connections(connections)
+        , m_interval(rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / rate)) : Clock::duration(0))
+        , m_start(start)
+        , m_measure(measure)
+        , m_end(end)
+        , m_next_request(0)
+        , m_errors(0)
+    {}
+
+    void run()
+    {
+        m_epoll_fd = ::epoll_create1(0);
+        for (auto& connection : m_connections)
+        {
+            if (!open(&connection))
+            {
+                ++m_errors;
+            }
+        }
+
+        std::this_thread::sleep_until(m_start);
+        auto next_due = m_start;
+        if (!m_options.is_open_loop)
+        {
+            for (auto& connection : m_connections)
+            {
+                send_request(&connection, Clock::now());
+            }
+        }
+
+        std::vector<epoll_event> events(256);
+        while (true)
+        {
+            auto now = Clock::now();
+            if (now >= m_end)
+            {
+                break;
+            }
+
+            if (m_options.is_open_loop)
+            {
+                // every request that has become due is queued, it is sent when a connection is free
+                for (; next_due <= now; next_due += m_interval)
+                {
+                    m_pending.push_back(next_due);
+                }
+                send_pending();
+            }
+
+            // the wait is rounded up to a millisecond, the requests that become due meanwhile are sent together
+            // and their latency still counts from their due time, a busy wait would take the cpu from the proxy
+            const auto until = m_options.is_open_loop ? std::min(next_due, m_end) : m_end;
+            const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(until - now).count();
+            const int timeout = static_cast<int>((wait + 999) / 1000);
+            const int n = ::epoll_wait(m_epoll_fd, events.data(), events.size(), std::max(timeout, 0));
+            for (int i = 0; i < n; ++i)
+            {
+                handle(static_cast<Connection*>(events[i].data.ptr));
+            }
+        }
+
+        for (auto& connection : m_connections)
+        {
+            ::close(connection.fd);
+        }
+        ::close(m_epoll_fd);
+    }
+
+    // microseconds of the requests completed during the measurement
+    const std::vector<uint64_t>& get_latencies() const { return m_latencies; }
+
+    uint64_t get_errors() const { return m_errors; }
+
+private:
+    struct Connection
+    {
+        int fd = -1;
+        bool is_busy = false;
+        Clock::time_point due;
+        std::string input;
+    };
+
+    bool open(Connection* connection)
+    {
+        connection->fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const auto address = make_loopback_address(m_options.proxy_port);
+        if (connection->fd == -1 || ::connect(connection->fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1)
+        {
+            return false;
+        }
+
+        const int one = 1;
+        ::setsockopt(connection->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        set_non_blocking(connection->fd);
+
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = connection;
+        ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, connection->fd, &event);
+        connection->is_busy = false;
+        connection->input.clear();
+        return true;
+    }
+
+    void reopen(Connection* connection)
+    {
+        ++m_errors;
+        ::close(connection->fd);
+        if (!open(connection))
+        {
+            connection->fd = -1;
+        }
+    }
+
+    void send_request(Connection* connection, const Clock::time_point due)
+    {
+        // the requests are small, they fit into the socket buffer of an idle connection at once
+        const auto& request = m_requests[m_next_request++ % m_requests.size()];
+        connection->is_busy = true;
+        connection->due = due;
+        if (::send(connection->fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+        {
+            reopen(connection);
+        }
+    }
+
+    void send_pending()
+    {
+        for (auto& connection : m_connections)
+        {
+            if (m_pending.empty())
+            {
+                return;
+            }
+            if (!connection.is_busy && connection.fd != -1)
+            {
+                send_request(&connection, m_pending.front());
+                m_pending.pop_front();
+            }
+        }
+    }
+
+    void handle(Connection* connection)
+    {
+        char buffer[64 * 1024];
+        while (true)
+        {
+            const auto received = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received == 0 || (received == -1 && errno != EAGAIN))
+            {
+                reopen(connection);
+                if (!m_options.is_open_loop && connection->fd != -1)
+                {
+                    send_request(connection, Clock::now());
+                }
+                return;
+            }
+            if (received == -1)
+            {
+                break;
+            }
+            connection->input.append(buffer, received);
+        }
+
+        const auto end_of_header = connection->input.find("\r\n\r\n");
+        if (end_of_header == std::string::npos)
+        {
+            return;
+        }
+
+        const long length = get_field(connection->input, end_of_header + 2, "content-length");
+        const bool is_ok = connection->input.compare(0, 12, "HTTP/1.1 200") == 0 || connection->input.compare(0, 12, "HTTP/1.0 200") == 0;
+        if (length < 0 || connection->input.size() < end_of_header + 4 + length)
+        {
+            if (length < 0)
+            {
+                reopen(connection);
+            }
+            return;
+        }
+
+        const auto now = Clock::now();
+        if (now >= m_measure)
+        {
+            if (is_ok)
+            {
+                m_latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - connection->due).count());
+            }
+            else
+            {
+                ++m_errors;
+            }
+        }
+
+        connection->input.erase(0, end_of_header + 4 + length);
+        connection->is_busy = false;
+        if (m_options.is_open_loop)
+        {
+            send_pending();
+        }
+        else
+        {
+            send_request(connection, now);
+        }
+    }
+
+private:
+    const Options& m_options;
+    const std::vector<std::string>& m_requests;
+    std::vector<Connection> m_connections;
+    Clock::duration m_interval;
+    Clock::time_point m_start;
+    Clock::time_point m_measure;
+    Clock::time_point m_end;
+    int m_epoll_fd = -1;
+    std::size_t m_next_request;
+    std::deque<Clock::time_point> m_pending;
+    uint64_t m_errors;
+    std::vector<uint64_t> m_latencies;
+};
+
+// user and system time of the process in microseconds
+uint64_t get_cpu_time(const pid_t pid)
+{
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    std::getline(stat, line);
+
+    // the fields after the name in parentheses, utime and stime are the 14th and 15th fields of the line
+    std::size_t position = line.rfind(')');
+    if (position == std::string::npos)
+    {
+        return 0;
+    }
+    const char* fields = line.c_str() + position + 2;
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    if (std::sscanf(fields, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+    {
+        return 0;
+    }
+    return (utime + stime) * 1000000 / ::sysconf(_SC_CLK_TCK);
+}
+
+uint64_t get_peak_rss_kb(const pid_t pid)
+{
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+pid_t start_proxy(const Options& options, const Selector::Backend backend, const bool use_splice)
+{
+    const pid_t pid = ::fork();
+    if (pid != 0)
+    {
+        return pid;
+    }
+
+    // the child is the proxy, as it would be started with -t and the default caches
+    const int null_fd = ::open("/dev/null", O_WRONLY);
+    ::dup2(null_fd, STDOUT_FILENO);
+    ::dup2(null_fd, STDERR_FILENO);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    is_counting = true;
+
+    ProxyGroup proxies(options.proxy_port, options.proxy_threads, Logger(null_fd, Logger::LOG_LEVEL::ERROR));
+    shared->backend = static_cast<int>(proxies.set_event_backend(backend));
+    proxies.set_dns_cache(1024);
+    proxies.set_response_cache(64 * 1024 * 1024);
+    proxies.set_splice(use_splice);
+    proxies.set_request_collapsing(options.is_collapsing);
+    proxies.start();
+    proxies.join();
+    std::_Exit(EXIT_SUCCESS);
+}
+
+bool wait_for_proxy(const uint16_t port)
+{
+    for (int attempt = 0; attempt < 2000; ++attempt)
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const auto address = make_loopback_address(port);
+        const bool is_connected = ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        ::close(fd);
+        if (is_connected)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+uint64_t get_percentile(const std::vector<uint64_t>& sorted, const double percentile)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    const auto index = static_cast<std::size_t>(percentile / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// measures the proxy with the backend and the relay of bodies, false if it can't be done
+bool run(const Options& options, const Selector::Backend backend, const bool use_splice)
+{
+    for (auto& syscalls : shared->syscalls)
+    {
+        syscalls = 0;
+    }
+
+    // the proxy is forked while no thread of the benchmark is running
+    const pid_t proxy = start_proxy(options, backend, use_splice);
+    if (proxy == -1 || !wait_for_proxy(options.proxy_port))
+    {
+        std::fprintf(stderr, "can't start the proxy at %u port\n", options.proxy_port);
+        if (proxy > 0)
+        {
+            ::kill(proxy, SIGKILL);
+        }
+        return false;
+    }
+
+    bool result = true;
+    {
+        Origin origin(options.origin_threads, options.is_cacheable);
+        if (!origin.start(options.response_bytes))
+        {
+            ::kill(proxy, SIGKILL);
+            ::waitpid(proxy, nullptr, 0);
+            return false;
+        }
+
+        // the proxy resolves the numeric address without DNS
+        std::vector<std::string> requests;
+        for (std::size_t i = 0; i < options.urls; ++i)
+        {
+            const std::string host = "127.0.0.1:" + std::to_string(origin.get_port());
+            requests.push_back("GET http://" + host + "/" + std::to_string(options.response_bytes) + "/"
+                               + std::to_string(options.origin_delay) + "/" + std::to_string(i) + " HTTP/1.1\r\n"
+                               + "Host: " + host + "\r\n\r\n");
+        }
+
+        // the connections are opened first, so they aren't part of the measurement
+        const auto start = Clock::now() + std::chrono::milliseconds(200);
+        const auto measure = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup));
+        const auto end = measure + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+
+        std::vector<std::unique_ptr<Generator>> generators;
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < options.threads; ++i)
+        {
+            const std::size_t connections = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+            generators.emplace_back(new Generator(options, requests, connections, options.rate / options.threads, start, measure, end));
+            threads.emplace_back(&Generator::run, generators.back().get());
+        }
+
+        std::this_thread::sleep_until(measure);
+        const auto cpu_start = get_cpu_time(proxy);
+        uint64_t syscalls[syscalls_count];
+        for (std::size_t i = 0; i < syscalls_count; ++i)
+        {
+            syscalls[i] = shared->syscalls[i].load();
+        }
+        std::this_thread::sleep_until(end);
+        const auto cpu_end = get_cpu_time(proxy);
+        uint64_t total_syscalls = 0;
+        for (std::size_t i = 0; i < syscalls_count; ++i)
+        {
+            syscalls[i] = shared->syscalls[i].load() - syscalls[i];
+            total_syscalls += syscalls[i];
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::vector<uint64_t> latencies;
+        uint64_t errors = 0;
+        for (const auto& generator : generators)
+        {
+            latencies.insert(latencies.end(), generator->get_latencies().begin(), generator->get_latencies().end());
+            errors += generator->get_errors();
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        uint64_t sum = 0;
+        for (const auto latency : latencies)
+        {
+            sum += latency;
+        }
+
+        const double requests_count = static_cast<double>(latencies.size());
+        std::string syscalls_text;
+        for (std::size_t i = 0; i < syscalls_count; ++i)
+        {
+            char text[64];
+            std::snprintf(text, sizeof(text), "\"%s\": %.2f, ", syscall_names[i], requests_count == 0 ? 0.0 : syscalls[i] / requests_count);
+            syscalls_text += text;
+        }
+
+        const auto used_backend = static_cast<Selector::Backend>(shared->backend.load());
+        std::printf("{\"backend\": \"%s\", \"relay\": \"%s\", \"mode\": \"%s\", \"connections\": %zu, \"threads\": %zu, \"rate\": %.0f, \"duration_s\": %.1f, "
+                    "\"response_bytes\": %zu, \"origin_delay_ms\": %u, \"urls\": %zu, \"cacheable\": %s, \"collapsing\": %s, \"proxy_threads\": %zu, "
+                    "\"requests\": %llu, \"errors\": %llu, \"origin_requests\": %llu, \"rps\": %.1f, "
+                    "\"latency_us\": {\"mean\": %.1f, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}, "
+                    "\"proxy_cpu_us_per_request\": %.2f, \"proxy_peak_rss_kb\": %llu, "
+                    "\"proxy_syscalls_per_request\": {%s\"total\": %.2f}}\n",
+                    used_backend == Selector::Backend::IO_URING_POLL ? "io_uring_poll" : "epoll", use_splice ? "splice" : "copy",
+                    options.is_open_loop ? "open" : "closed", options.connections, options.threads,
+                    options.is_open_loop ? options.rate : 0.0, options.duration, options.response_bytes, options.origin_delay,
+                    options.urls, options.is_cacheable ? "true" : "false", options.is_collapsing ? "true" : "false", options.proxy_threads,
+                    static_cast<unsigned long long>(latencies.size()), static_cast<unsigned long long>(errors),
+                    static_cast<unsigned long long>(origin.get_requests()),
+                    requests_count / options.duration, requests_count == 0 ? 0.0 : sum / requests_count,
+                    static_cast<unsigned long long>(get_percentile(latencies, 50)),
+                    static_cast<unsigned long long>(get_percentile(latencies, 99)),
+                    static_cast<unsigned long long>(get_percentile(latencies, 99.9)),
+                    static_cast<unsigned long long>(latencies.empty() ? 0 : latencies.back()),
+                    requests_count == 0 ? 0.0 : (cpu_end - cpu_start) / requests_count,
+                    static_cast<unsigned long long>(get_peak_rss_kb(proxy)),
+                    syscalls_text.c_str(), requests_count == 0 ? 0.0 : total_syscalls / requests_count);
+        std::fflush(stdout);
+
+        if (latencies.empty())
+        {
+            result = false;
+        }
+
+        // the responses live for 60 seconds in the cache, so within a shorter run
+        // every proxy thread fetches every URL once, collapsing the concurrent requests for it
+        const uint64_t expected_requests = options.urls * options.proxy_threads;
+        if (options.is_checking_collapsing && origin.get_requests() != expected_requests)
+        {
+            std::fprintf(stderr, "the origin got %llu requests instead of %llu, one per URL and proxy thread\n",
+                         static_cast<unsigned long long>(origin.get_requests()), static_cast<unsigned long long>(expected_requests));
+            result = false;
+        }
+    }
+
+    ::kill(proxy, SIGKILL);
+    ::waitpid(proxy, nullptr, 0);
+    return result;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    int option = 0;
+    while ((option = ::getopt(argc, argv, "m:c:t:r:d:w:s:D:o:P:u:aNCp:b:x:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'm':
+            options.is_open_loop = std::string(optarg) == "open";
+            break;
+        case 'c':
+            options.connections = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 't':
+            options.threads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'r':
+            options.rate = std::strtod(optarg, nullptr);
+            break;
+        case 'd':
+            options.duration = std::strtod(optarg, nullptr);
+            break;
+        case 'w':
+            options.warmup = std::strtod(optarg, nullptr);
+            break;
+        case 's':
+            options.response_bytes = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'D':
+            options.origin_delay = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'o':
+            options.origin_threads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'P':
+            options.proxy_threads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'u':
+            options.urls = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'a':
+            options.is_cacheable = true;
+            break;
+        case 'N':
+            options.is_collapsing = false;
+            break;
+        case 'C':
+            options.is_checking_collapsing = true;
+            break;
+        case 'p':
+            options.proxy_port = static_cast<uint16_t>(std::strtoul(optarg, nullptr, 10));
+            break;
+        case 'b':
+            for (std::string backends = optarg; !backends.empty(); )
+            {
+                const auto comma = backends.find(',');
+                const auto name = backends.substr(0, comma);
+                backends = comma == std::string::npos ? "" : backends.substr(comma + 1);
+                if (name == "epoll" || name == "io_uring_poll")
+                {
+                    options.backends.push_back(name == "epoll" ? Selector::Backend::EPOLL : Selector::Backend::IO_URING_POLL);
+                }
+                else
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+        case 'x':
+            for (std::string relays = optarg; !relays.empty(); )
+            {
+                const auto comma = relays.find(',');
+                const auto name = relays.substr(0, comma);
+                relays = comma == std::string::npos ? "" : relays.substr(comma + 1);
+                if (name == "copy" || name == "splice")
+                {
+                    options.splices.push_back(name == "splice");
+                }
+                else
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (options.connections == 0 || options.threads == 0 || options.urls == 0 || options.proxy_threads == 0
+            || options.origin_threads == 0 || options.duration <= 0 || (options.is_open_loop && options.rate <= 0)
+            || (options.is_checking_collapsing && (!options.is_cacheable || !options.is_collapsing)))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    options.threads = std::min(options.threads, options.connections);
+
+    if (options.backends.empty())
+    {
+        options.backends.push_back(Selector::Backend::EPOLL);
+    }
+    if (options.splices.empty())
+    {
+        options.splices.push_back(false);
+    }
+
+    shared = static_cast<Shared*>(::mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED)
+    {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    for (std::size_t i = 0; i < options.backends.size() * options.splices.size(); ++i)
+    {
+        // the port of the killed proxy may still have connections in TIME_WAIT
+        Options run_options = options;
+        run_options.proxy_port = static_cast<uint16_t>(options.proxy_port + i);
+        if (!run(run_options, options.backends[i / options.splices.size()], options.splices[i % options.splices.size()]))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,689 @@
+// Microbenchmarks of the hot paths: parsing requests, finding where requests and responses end, rewriting headers,
+// the selector's registrations and dispatch over socketpairs and TcpSocket round trips over loopback.
+// Every benchmark is calibrated to run about the given time per repetition, runs the warmup repetitions
+// and then the measured ones, the median of the repetitions is the result. The results are written
+// as JSON, one benchmark per line, so the outputs of two commits can be diffed; a table goes to stderr.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "httpparser.hpp"
+#include "logger.hpp"
+#include "requestparser.hpp"
+#include "responseframer.hpp"
+#include "selector.hpp"
+#include "tcpsocket.hpp"
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// the checksums of the benchmarks go here, so the compiler can't drop the work
+volatile uint64_t sink = 0;
+
+// the selectors share one logger, so a benchmark doesn't start its thread
+const Logger& get_logger()
+{
+    static const Logger logger(STDERR_FILENO, Logger::LOG_LEVEL::ERROR);
+    return logger;
+}
+
+struct Options
+{
+    std::size_t repetitions = 10;
+    std::size_t warmup = 2;
+    double repetition_seconds = 0.05;
+    std::string filter;
+};
+
+struct Benchmark
+{
+    std::string name;
+
+    // bytes processed by one operation, 0 if there is no throughput to speak of
+    std::size_t bytes_per_op;
+
+    // runs the operation the given number of times, returns a checksum
+    std::function<uint64_t(const std::size_t iterations)> run;
+};
+
+struct Result
+{
+    std::string name;
+    std::size_t iterations;
+    std::size_t bytes_per_op;
+    double median;
+    double min;
+    double mean;
+    double stddev;
+};
+
+double measure(const Benchmark& benchmark, const std::size_t iterations)
+{
+    const auto start = Clock::now();
+    sink = sink + benchmark.run(iterations);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+Result run(const Benchmark& benchmark, const Options& options)
+{
+    // the iterations grow until a run is long enough to be timed, then they are scaled to the wanted time
+    std::size_t iterations = 1;
+    double ns = measure(benchmark, iterations);
+    while (ns < options.repetition_seconds * 1e8 && iterations < (std::size_t(1) << 40))
+    {
+        iterations *= 2;
+        ns = measure(benchmark, iterations);
+    }
+    iterations = std::max<std::size_t>(1, static_cast<std::size_t>(iterations * options.repetition_seconds * 1e9 / ns));
+
+    for (std::size_t i = 0; i < options.warmup; ++i)
+    {
+        measure(benchmark, iterations);
+    }
+
+    std::vector<double> ns_per_op;
+    for (std::size_t i = 0; i < options.repetitions; ++i)
+    {
+        ns_per_op.push_back(measure(benchmark, iterations) / iterations);
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+
+    Result result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.bytes_per_op = benchmark.bytes_per_op;
+    const std::size_t middle = ns_per_op.size() / 2;
+    result.median = ns_per_op.size() % 2 == 1 ? ns_per_op[middle] : (ns_per_op[middle - 1] + ns_per_op[middle]) / 2;
+    result.min = ns_per_op.front();
+
+    double sum = 0;
+    for (const auto value : ns_per_op)
+    {
+        sum += value;
+    }
+    result.mean = sum / ns_per_op.size();
+
+    double squares = 0;
+    for (const auto value : ns_per_op)
+    {
+        squares += (value - result.mean) * (value - result.mean);
+    }
+    result.stddev = ns_per_op.size() > 1 ? std::sqrt(squares / (ns_per_op.size() - 1)) : 0;
+    return result;
+}
+
+// the corpora of requests and responses of different sizes
+
+std::string make_small_request()
+{
+    return "GET http://example.com/ HTTP/1.1\r\n"
+           "Host: example.com\r\n"
+           "User-Agent: curl/7.88.1\r\n"
+           "Accept: */*\r\n"
+           "Proxy-Connection: Keep-Alive\r\n"
+           "\r\n";
+}
+
+std::string make_browser_request()
+{
+    return "GET http://www.example.org/news/2016/10/index.html?page=2&sort=date HTTP/1.1\r\n"
+           "Host: www.example.org\r\n"
+           "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:49.0) Gecko/20100101 Firefox/49.0\r\n"
+           "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+           "Accept-Language: en-US,en;q=0.5\r\n"
+           "Accept-Encoding: gzip, deflate\r\n"
+           "Referer: http://www.example.org/news/2016/10/\r\n"
+           "Cookie: session=5f2b9c1e7a4d4e0f8c3b2a1d; theme=dark; _ga=GA1.2.1234567890.1476000000; lang=en\r\n"
+           "Connection: keep-alive\r\n"
+           "Upgrade-Insecure-Requests: 1\r\n"
+           "Cache-Control: max-age=0\r\n"
+           "\r\n";
+}
+
+// close to the longest request the proxy takes, most of it is cookies
+std::string make_large_request()
+{
+    std::string request = "GET http://shop.example.com/catalog/search?q=proxy&category=books&page=3&per_page=48 HTTP/1.1\r\n"
+                          "Host: shop.example.com\r\n"
+                          "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/54.0.2840.71 Safari/537.36\r\n"
+                          "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+                          "Accept-Encoding: gzip, deflate, sdch\r\n"
+                          "Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
+                          "Referer: http://shop.example.com/catalog/search?q=proxy&category=books&page=2&per_page=48\r\n"
+                          "Proxy-Connection: keep-alive\r\n"
+                          "Cookie: ";
+    for (int i = 0; i < 24; ++i)
+    {
+        request += "cookie" + std::to_string(i) + "=0123456789abcdef0123456789abcdef0123456789; ";
+    }
+    request += "last=1\r\n\r\n";
+    return request;
+}
+
+std::string make_response_header(const std::string& framing)
+{
+    return "HTTP/1.1 200 OK\r\n"
+           "Date: Sat, 15 Oct 2016 10:00:00 GMT\r\n"
+           "Server: nginx/1.10.1\r\n"
+           "Content-Type: text/html; charset=utf-8\r\n"
+           "Cache-Control: max-age=600\r\n"
+           "ETag: \"3f9a1c-5d2e\"\r\n"
+           "Last-Modified: Sat, 15 Oct 2016 09:00:00 GMT\r\n"
+           "Connection: keep-alive\r\n"
+           + framing + "\r\n"
+           "\r\n";
+}
+
+std::string make_length_response(const std::size_t body)
+{
+    return make_response_header("Content-Length: " + std::to_string(body)) + std::string(body, 'x');
+}
+
+std::string make_chunked_response(const std::size_t body, const std::size_t chunk)
+{
+    std::string response = make_response_header("Transfer-Encoding: chunked");
+    for (std::size_t offset = 0; offset < body; offset += chunk)
+    {
+        const std::size_t size = std::min(chunk, body - offset);
+        char line[32];
+        std::snprintf(line, sizeof(line), "%zx\r\n", size);
+        response += line;
+        response.append(size, 'x');
+        response += "\r\n";
+    }
+    return response + "0\r\n\r\n";
+}
+
+struct Corpus
+{
+    const char* name;
+    std::string data;
+};
+
+void add_parser_benchmarks(std::vector<Benchmark>* benchmarks)
+{
+    const auto requests = std::make_shared<std::vector<Corpus>>(std::vector<Corpus>
+    {
+        {"small", make_small_request()},
+        {"browser", make_browser_request()},
+        {"large", make_large_request()}
+    });
+
+    for (const auto& request : *requests)
+    {
+        const std::string* data = &request.data;
+        benchmarks->push_back(Benchmark{std::string("http_parser/parse/") + request.name, data->size(),
+            [requests, data](const std::size_t iterations)
+            {
+                uint64_t checksum = 0;
+                for (std::size_t i = 0; i < iterations; ++i)
+                {
+                    checksum += HttpParser::parse(*data).port;
+                }
+                return checksum;
+            }});
+    }
+
+    // the request arrives in pieces, the parser goes on after every one of them as it does in the proxy,
+    // the end of the request is found by the parser, the header is taken when it is done
+    const std::size_t pieces[] = { 0, 1460, 64, 16 };
+    for (const auto& request : *requests)
+    {
+        for (const auto piece : pieces)
+        {
+            const std::string* data = &request.data;
+            const std::string name = std::string("http_parser/parse_incremental/") + request.name + "/piece="
+                    + (piece == 0 ? std::string("all") : std::to_string(piece));
+            benchmarks->push_back(Benchmark{name, data->size(),
+                [requests, data, piece](const std::size_t iterations)
+                {
+                    const std::size_t step = piece == 0 ? data->size() : piece;
+                    RequestParser parser;
+                    uint64_t checksum = 0;
+                    for (std::size_t i = 0; i < iterations; ++i)
+                    {
+                        parser.reset();
+                        for (std::size_t received = step; ; received += step)
+                        {
+                            received = std::min(received, data->size());
+                            if (parser.parse(data->data(), received) != RequestParser::Status::INCOMPLETE)
+                            {
+                                break;
+                            }
+                        }
+                        checksum += HttpParser::parse(parser, data->data()).port;
+                    }
+                    return checksum;
+                }});
+        }
+    }
+
+    for (const auto& request : *requests)
+    {
+        const std::string* data = &request.data;
+        const auto header = std::make_shared<HttpParser::Header>(HttpParser::parse(*data));
+        benchmarks->push_back(Benchmark{std::string("http_parser/make_server_request/") + request.name, data->size(),
+            [requests, data, header](const std::size_t iterations)
+            {
+                uint64_t checksum = 0;
+                for (std::size_t i = 0; i < iterations; ++i)
+                {
+                    checksum += HttpParser::make_server_request(*data, *header, true).size();
+                }
+                return checksum;
+            }});
+    }
+
+    const auto header = std::make_shared<std::string>(make_response_header("Content-Length: 1024"));
+    benchmarks->push_back(Benchmark{"http_parser/make_client_response", header->size(),
+        [header](const std::size_t iterations)
+        {
+            uint64_t checksum = 0;
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                checksum += HttpParser::make_client_response(*header, true).size();
+            }
+            return checksum;
+        }});
+    benchmarks->push_back(Benchmark{"http_parser/content_length", header->size(),
+        [header](const std::size_t iterations)
+        {
+            uint64_t checksum = 0;
+            uint64_t length = 0;
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                checksum += HttpParser::content_length(*header, &length) ? length : 0;
+            }
+            return checksum;
+        }});
+}
+
+// where a response ends, what query_is_end used to answer by searching the whole buffer:
+// the header is found, then the framer counts or walks the body as its pieces arrive
+void add_framer_benchmarks(std::vector<Benchmark>* benchmarks)
+{
+    const auto responses = std::make_shared<std::vector<Corpus>>(std::vector<Corpus>
+    {
+        {"length_1k", make_length_response(1024)},
+        {"length_64k", make_length_response(64 * 1024)},
+        {"chunked_64k_by_4k", make_chunked_response(64 * 1024, 4096)},
+        {"chunked_64k_by_256", make_chunked_response(64 * 1024, 256)}
+    });
+
+    const std::size_t pieces[] = { 16 * 1024, 1460 };
+    for (const auto& response : *responses)
+    {
+        for (const auto piece : pieces)
+        {
+            const std::string* data = &response.data;
+            const std::string name = std::string("response_framer/") + response.name + "/piece=" + std::to_string(piece);
+            benchmarks->push_back(Benchmark{name, data->size(),
+                [responses, data, piece](const std::size_t iterations)
+                {
+                    ResponseFramer framer;
+                    std::string header;
+                    uint64_t checksum = 0;
+                    for (std::size_t i = 0; i < iterations; ++i)
+                    {
+                        framer.reset();
+                        header.clear();
+                        for (std::size_t offset = 0; offset < data->size() && !framer.is_done(); )
+                        {
+                            std::size_t size = std::min(piece, data->size() - offset);
+                            const char* bytes = data->data() + offset;
+                            offset += size;
+
+                            if (framer.get_status() == ResponseFramer::Status::HEADER)
+                            {
+                                // the end of the header may be split between the pieces
+                                const std::size_t from = header.size() < 3 ? 0 : header.size() - 3;
+                                header.append(bytes, size);
+                                const auto end = header.find("\r\n\r\n", from);
+                                if (end == std::string::npos)
+                                {
+                                    continue;
+                                }
+
+                                const std::size_t body = header.size() - end - 4;
+                                header.resize(end + 4);
+                                framer.start(header);
+                                bytes += size - body;
+                                size = body;
+                            }
+                            checksum += framer.consume(framer.needs_data() ? bytes : nullptr, size);
+                        }
+                    }
+                    return checksum;
+                }});
+        }
+    }
+}
+
+// the handler of a socketpair drains the byte the other end has written, as a proxy's handler would read
+class DrainingHandler final : public Selector::Handler
+{
+public:
+    DrainingHandler(const int fd, uint64_t* count)
+        : m_fd(fd)
+        , m_count(count)
+    {}
+
+    void handle_event(const uint32_t) override
+    {
+        char buffer[64];
+        while (::recv(m_fd, buffer, sizeof(buffer), 0) > 0)
+        {
+            ++*m_count;
+        }
+    }
+
+private:
+    int m_fd;
+    uint64_t* m_count;
+};
+
+struct SocketPairs
+{
+    explicit SocketPairs(const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == -1)
+            {
+                perror("socketpair");
+                std::exit(EXIT_FAILURE);
+            }
+            watched.push_back(fds[0]);
+            peers.push_back(fds[1]);
+        }
+    }
+
+    ~SocketPairs()
+    {
+        for (std::size_t i = 0; i < watched.size(); ++i)
+        {
+            ::close(watched[i]);
+            ::close(peers[i]);
+        }
+    }
+
+    SocketPairs(const SocketPairs&) = delete;
+    SocketPairs& operator= (const SocketPairs&) = delete;
+
+    std::vector<int> watched;
+    std::vector<int> peers;
+};
+
+// socketpairs added to a selector, the handlers count the bytes they read
+struct SelectorLoad
+{
+    explicit SelectorLoad(const std::size_t sockets)
+        : pairs(sockets)
+        , count(0)
+        , selector(get_logger())
+    {
+        handlers.reserve(sockets);
+        for (const int fd : pairs.watched)
+        {
+            handlers.emplace_back(fd, &count);
+            selector.add(fd, EPOLLIN, &handlers.back());
+        }
+    }
+
+    SocketPairs pairs;
+    uint64_t count;
+    std::vector<DrainingHandler> handlers;
+    Selector selector;
+};
+
+void add_selector_benchmarks(std::vector<Benchmark>* benchmarks)
+{
+    benchmarks->push_back(Benchmark{"selector/add_remove", 0,
+        [](const std::size_t iterations)
+        {
+            SocketPairs pair(1);
+            Selector selector(get_logger());
+            uint64_t count = 0;
+            DrainingHandler handler(pair.watched[0], &count);
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                selector.add(pair.watched[0], EPOLLIN, &handler);
+                selector.remove(pair.watched[0]);
+            }
+            return selector.size() + 1;
+        }});
+
+    // what the proxy does when a connection turns from receiving to sending and back
+    benchmarks->push_back(Benchmark{"selector/change_mode", 0,
+        [](const std::size_t iterations)
+        {
+            SocketPairs pair(1);
+            Selector selector(get_logger());
+            uint64_t count = 0;
+            DrainingHandler handler(pair.watched[0], &count);
+            selector.add(pair.watched[0], EPOLLIN, &handler);
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                selector.change_mode(pair.watched[0], (i & 1) ? EPOLLIN : EPOLLOUT);
+            }
+            selector.remove(pair.watched[0]);
+            return selector.size() + 1;
+        }});
+
+    // an operation is one readable socket: the peer writes a byte, epoll reports it, the handler reads it,
+    // the sockets stay added between the runs, so adding a thousand of them isn't counted
+    const std::size_t counts[] = { 1, 64, 1024 };
+    for (const auto sockets : counts)
+    {
+        auto load = std::make_shared<SelectorLoad>(sockets);
+        benchmarks->push_back(Benchmark{"selector/do_iteration/sockets=" + std::to_string(sockets), 0,
+            [load](const std::size_t iterations)
+            {
+                const std::size_t sockets = load->pairs.peers.size();
+                for (std::size_t done = 0; done < iterations; )
+                {
+                    const std::size_t round = std::min(sockets, iterations - done);
+                    for (std::size_t i = 0; i < round; ++i)
+                    {
+                        if (::send(load->pairs.peers[i], "x", 1, 0) != 1)
+                        {
+                            perror("send");
+                            std::exit(EXIT_FAILURE);
+                        }
+                    }
+
+                    // every byte is read before the next round
+                    const uint64_t expected = load->count + round;
+                    while (load->count < expected)
+                    {
+                        load->selector.do_iteration();
+                    }
+                    done += round;
+                }
+                return load->count;
+            }});
+    }
+}
+
+// a connected pair of loopback TCP sockets
+struct Connection
+{
+    Connection()
+        : client(-1)
+        , server(-1)
+    {
+        const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t size = sizeof(address);
+        const int client_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listener == -1 || client_fd == -1
+                || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1
+                || ::listen(listener, 1) == -1
+                || ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &size) == -1
+                || (::connect(client_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 && errno != EINPROGRESS))
+        {
+            perror("loopback connection");
+            std::exit(EXIT_FAILURE);
+        }
+
+        const int server_fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+        ::close(listener);
+        if (server_fd == -1)
+        {
+            perror("accept");
+            std::exit(EXIT_FAILURE);
+        }
+
+        client = TcpSocket(client_fd);
+        server = TcpSocket(server_fd);
+        client.setNoDelay();
+        server.setNoDelay();
+    }
+
+    TcpSocket client;
+    TcpSocket server;
+};
+
+// sends the bytes while receiving them on the other side, the sockets are non-blocking,
+// so a message larger than the socket buffers is relayed in turns
+uint64_t transfer(TcpSocket* from, TcpSocket* to, const std::string& message, std::string* buffer)
+{
+    std::size_t sent = 0;
+    std::size_t received = 0;
+    while (received < message.size())
+    {
+        std::size_t size = 0;
+        if (sent < message.size() && from->send(message.data() + sent, message.size() - sent, &size) == TcpSocket::Status::DONE)
+        {
+            sent += size;
+        }
+
+        const auto status = to->receive(&(*buffer)[0], buffer->size(), &size);
+        if (status == TcpSocket::Status::ERROR || (status == TcpSocket::Status::DONE && size == 0))
+        {
+            std::fprintf(stderr, "the loopback connection has failed\n");
+            std::exit(EXIT_FAILURE);
+        }
+        if (status == TcpSocket::Status::DONE)
+        {
+            received += size;
+        }
+    }
+    return received;
+}
+
+void add_socket_benchmarks(std::vector<Benchmark>* benchmarks)
+{
+    // an operation is a request there and a response of the same size back
+    const std::size_t sizes[] = { 64, 4096, 64 * 1024 };
+    for (const auto size : sizes)
+    {
+        auto connection = std::make_shared<Connection>();
+        auto message = std::make_shared<std::string>(size, 'x');
+        benchmarks->push_back(Benchmark{"tcp_socket/round_trip/bytes=" + std::to_string(size), 2 * size,
+            [connection, message](const std::size_t iterations)
+            {
+                std::string buffer(64 * 1024, '\0');
+                uint64_t checksum = 0;
+                for (std::size_t i = 0; i < iterations; ++i)
+                {
+                    checksum += transfer(&connection->client, &connection->server, *message, &buffer);
+                    checksum += transfer(&connection->server, &connection->client, *message, &buffer);
+                }
+                return checksum;
+            }});
+    }
+}
+
+void usage(const char* name)
+{
+    std::fprintf(stderr, "usage: %s [-r repetitions] [-w warmup repetitions] [-t milliseconds per repetition] [-f filter]\n", name);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    int option = 0;
+    while ((option = ::getopt(argc, argv, "r:w:t:f:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'r':
+            options.repetitions = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'w':
+            options.warmup = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 't':
+            options.repetition_seconds = std::strtod(optarg, nullptr) / 1000;
+            break;
+        case 'f':
+            options.filter = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (options.repetitions == 0 || options.repetition_seconds <= 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Benchmark> benchmarks;
+    add_parser_benchmarks(&benchmarks);
+    add_framer_benchmarks(&benchmarks);
+    add_selector_benchmarks(&benchmarks);
+    add_socket_benchmarks(&benchmarks);
+
+    std::fprintf(stderr, "%-50s | %12s | %12s | %8s | %10s\n", "benchmark", "median ns/op", "min ns/op", "stddev %", "MB/s");
+    std::printf("{\"repetitions\": %zu, \"warmup\": %zu, \"repetition_ms\": %.0f, \"benchmarks\": [\n",
+                options.repetitions, options.warmup, options.repetition_seconds * 1000);
+
+    bool is_first = true;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (benchmark.name.find(options.filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        const auto result = run(benchmark, options);
+        const double bytes_per_second = result.bytes_per_op * 1e9 / result.median;
+        std::fprintf(stderr, "%-50s | %12.1f | %12.1f | %8.2f | %10.1f\n", result.name.c_str(), result.median, result.min,
+                     result.mean == 0 ? 0.0 : result.stddev * 100 / result.mean, bytes_per_second / 1e6);
+        std::printf("%s  {\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": {\"median\": %.2f, \"min\": %.2f, "
+                    "\"mean\": %.2f, \"stddev\": %.2f}, \"bytes_per_op\": %zu, \"bytes_per_second\": %.0f}",
+                    is_first ? "" : ",\n", result.name.c_str(), result.iterations, result.median, result.min,
+                    result.mean, result.stddev, result.bytes_per_op, bytes_per_second);
+        std::fflush(stdout);
+        is_first = false;
+    }
+
+    std::printf("\n]}\n");
+    return sink == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,26 @@
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += micro_bench.cpp \
+    ../httpparser.cpp \
+    ../requestparser.cpp \
+    ../responseframer.cpp \
+    ../selector.cpp \
+    ../iouring.cpp \
+    ../timerwheel.cpp \
+    ../tcpsocket.cpp \
+    ../ipaddress.cpp
+
+HEADERS += \
+    ../httpparser.hpp \
+    ../requestparser.hpp \
+    ../responseframer.hpp \
+    ../selector.hpp \
+    ../iouring.hpp \
+    ../timerwheel.hpp \
+    ../tcpsocket.hpp \
+    ../ipaddress.hpp
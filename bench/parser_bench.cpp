@@ -0,0 +1,232 @@
+// Compares the incremental RequestParser with the former stringstream based parser.
+// Every request of the corpus is fed either at once or in pieces of the given size,
+// the former parser runs from scratch on every piece just as the proxy used to do on every recv.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "httpparser.hpp"
+#include "requestparser.hpp"
+
+namespace
+{
+
+std::size_t allocations = 0;
+
+}
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* ptr = std::malloc(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace
+{
+
+const char* const corpus[] =
+{
+    // curl
+    "GET http://example.com/ HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "Proxy-Connection: Keep-Alive\r\n"
+    "\r\n",
+
+    // a browser loading a page
+    "GET http://www.example.org/news/2016/10/index.html?page=2&sort=date HTTP/1.1\r\n"
+    "Host: www.example.org\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:49.0) Gecko/20100101 Firefox/49.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.org/news/2016/10/\r\n"
+    "Cookie: session=5f2b9c1e7a4d4e0f8c3b2a1d; theme=dark; _ga=GA1.2.1234567890.1476000000; lang=en\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n",
+
+    // a browser loading a resource of the page
+    "GET http://static.example.org:8080/assets/app.3f9a1c.js HTTP/1.1\r\n"
+    "Host: static.example.org:8080\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/54.0.2840.71 Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Referer: http://www.example.org/news/2016/10/index.html?page=2&sort=date\r\n"
+    "Accept-Encoding: gzip, deflate, sdch\r\n"
+    "Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
+    "If-None-Match: \"3f9a1c-5d2e\"\r\n"
+    "If-Modified-Since: Sat, 15 Oct 2016 10:00:00 GMT\r\n"
+    "Proxy-Connection: keep-alive\r\n"
+    "\r\n",
+
+    // an old HTTP/1.0 client
+    "GET http://ya.ru/ HTTP/1.0\r\n"
+    "Host: ya.ru\r\n"
+    "User-Agent: curl/7.43.0\r\n"
+    "Accept: application/json\r\n"
+    "\r\n"
+};
+
+// the parser the proxy had before RequestParser, it reads only the request line
+HttpParser::Header legacy_parse(const std::string& request)
+{
+    std::string str;
+    std::stringstream ss(request);
+
+    HttpParser::Header header;
+    if (!(ss >> str) || str != "GET")
+    {
+        return header;
+    }
+    header.method = HttpParser::Method::GET;
+
+    if (!(ss >> str) || str.compare(0, 7, "http://") != 0 || str.size() <= 7)
+    {
+        return header;
+    }
+
+    str = str.substr(7);
+    if (str.back() == '/')
+    {
+        str.pop_back();
+    }
+    header.URI = str;
+
+    auto slash = str.find('/');
+    header.path = slash == std::string::npos ? "/" : str.substr(slash);
+
+    auto authority = str.substr(0, slash);
+    auto colon = authority.find(':');
+    header.host = authority.substr(0, colon);
+    if (colon != std::string::npos)
+    {
+        header.port = static_cast<uint16_t>(std::strtoul(authority.c_str() + colon + 1, nullptr, 10));
+    }
+
+    if (ss >> str)
+    {
+        header.version = str == "HTTP/1.1" ? HttpParser::Version::HTTP_1_1 : HttpParser::Version::HTTP_1_0;
+    }
+
+    return header;
+}
+
+struct Result
+{
+    double ns_per_request;
+    double allocations_per_request;
+};
+
+template <typename Feed>
+Result run(const std::size_t iterations, Feed feed)
+{
+    const std::vector<std::string> requests(std::begin(corpus), std::end(corpus));
+    std::size_t checksum = 0;
+
+    const auto allocations_before = allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        checksum += feed(requests[i % requests.size()]);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (checksum == 0)
+    {
+        std::cerr << "nothing was parsed\n";
+    }
+
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return Result{static_cast<double>(ns) / iterations,
+                  static_cast<double>(allocations - allocations_before) / iterations};
+}
+
+// the connection buffer receives the request in pieces, the parser runs after each of them
+Result run_legacy(const std::size_t iterations, const std::size_t piece)
+{
+    std::string input;
+    input.reserve(4096);
+
+    return run(iterations, [&input, piece](const std::string& request)
+    {
+        input.clear();
+
+        std::size_t parsed = 0;
+        for (std::size_t offset = 0; offset < request.size(); offset += piece)
+        {
+            input.append(request, offset, piece);
+            if (input.find("\r\n\r\n") != std::string::npos)
+            {
+                parsed = legacy_parse(input).port;
+            }
+        }
+        return parsed;
+    });
+}
+
+Result run_incremental(const std::size_t iterations, const std::size_t piece)
+{
+    std::string input;
+    input.reserve(4096);
+    RequestParser parser;
+
+    return run(iterations, [&input, &parser, piece](const std::string& request)
+    {
+        input.clear();
+        parser.reset();
+
+        std::size_t parsed = 0;
+        for (std::size_t offset = 0; offset < request.size(); offset += piece)
+        {
+            input.append(request, offset, piece);
+
+            if (parser.parse(input.data(), input.size()) == RequestParser::Status::DONE)
+            {
+                parsed = parser.get_fields_count();
+            }
+        }
+        return parsed;
+    });
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    const std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const std::size_t pieces[] = { 4096, 64, 16, 1 };
+
+    std::cout << "piece bytes | legacy ns/req | legacy allocs/req | incremental ns/req | incremental allocs/req\n";
+    for (auto piece : pieces)
+    {
+        // fewer iterations for small pieces, the legacy parser is quadratic there
+        const std::size_t n = piece >= 64 ? iterations : iterations / 20;
+        const auto legacy = run_legacy(n, piece);
+        const auto incremental = run_incremental(n, piece);
+
+        std::cout << piece
+                  << " | " << legacy.ns_per_request << " | " << legacy.allocations_per_request
+                  << " | " << incremental.ns_per_request << " | " << incremental.allocations_per_request
+                  << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+CONFIG -= qt
+
+INCLUDEPATH += ..
+
+SOURCES += parser_bench.cpp \
+    ../requestparser.cpp \
+    ../httpparser.cpp
+
+HEADERS += \
+    ../requestparser.hpp \
+    ../httpparser.hpp
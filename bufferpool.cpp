@@ -0,0 +1,227 @@
+#include "bufferpool.hpp"
+#include "counter.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+BufferPool::Counters& BufferPool::Counters::operator+= (const Counters& other)
+{
+    allocated_chunks += other.allocated_chunks;
+    reused_chunks += other.reused_chunks;
+    used_chunks += other.used_chunks;
+    idle_chunks += other.idle_chunks;
+    return *this;
+}
+
+BufferPool::BufferPool(const std::size_t max_idle_chunks)
+    : m_max_idle_chunks(max_idle_chunks)
+    , m_idle(nullptr)
+    , m_idle_count(0)
+    , m_allocated_chunks(0)
+    , m_reused_chunks(0)
+    , m_used_chunks(0)
+    , m_idle_chunks(0)
+{}
+
+BufferPool::~BufferPool()
+{
+    assert(m_used_chunks.load(std::memory_order_relaxed) == 0); // all buffers must be cleared before the pool
+    while (m_idle != nullptr)
+    {
+        auto chunk = m_idle;
+        m_idle = chunk->next;
+        delete chunk;
+    }
+}
+
+BufferPool::Chunk* BufferPool::acquire()
+{
+    Chunk* chunk = m_idle;
+    if (chunk != nullptr)
+    {
+        m_idle = chunk->next;
+        --m_idle_count;
+        add_counter(m_reused_chunks, 1);
+        add_counter(m_idle_chunks, -1);
+    }
+    else
+    {
+        chunk = new Chunk;
+        add_counter(m_allocated_chunks, 1);
+    }
+
+    chunk->next = nullptr;
+    add_counter(m_used_chunks, 1);
+    return chunk;
+}
+
+void BufferPool::release(Chunk* chunk)
+{
+    add_counter(m_used_chunks, -1);
+    if (m_idle_count >= m_max_idle_chunks)
+    {
+        delete chunk;
+        return;
+    }
+
+    chunk->next = m_idle;
+    m_idle = chunk;
+    ++m_idle_count;
+    add_counter(m_idle_chunks, 1);
+}
+
+BufferPool::Counters BufferPool::get_counters() const
+{
+    Counters counters;
+    counters.allocated_chunks = m_allocated_chunks.load(std::memory_order_relaxed);
+    counters.reused_chunks = m_reused_chunks.load(std::memory_order_relaxed);
+    counters.used_chunks = m_used_chunks.load(std::memory_order_relaxed);
+    counters.idle_chunks = m_idle_chunks.load(std::memory_order_relaxed);
+    return counters;
+}
+
+ChunkBuffer::ChunkBuffer()
+    : ChunkBuffer(nullptr)
+{}
+
+ChunkBuffer::ChunkBuffer(BufferPool* pool)
+    : m_pool(pool)
+    , m_head(nullptr)
+    , m_tail(nullptr)
+    , m_begin(0)
+    , m_end(0)
+    , m_size(0)
+{}
+
+ChunkBuffer::~ChunkBuffer() { clear(); }
+
+ChunkBuffer::ChunkBuffer(ChunkBuffer&& other)
+    : ChunkBuffer(other.m_pool)
+{
+    *this = std::move(other);
+}
+
+ChunkBuffer& ChunkBuffer::operator= (ChunkBuffer&& other)
+{
+    if (this != &other)
+    {
+        clear();
+        m_pool = other.m_pool;
+        m_head = other.m_head;
+        m_tail = other.m_tail;
+        m_begin = other.m_begin;
+        m_end = other.m_end;
+        m_size = other.m_size;
+
+        other.m_head = other.m_tail = nullptr;
+        other.m_begin = other.m_end = other.m_size = 0;
+    }
+    return *this;
+}
+
+void ChunkBuffer::append(const char* data, std::size_t size)
+{
+    while (size != 0)
+    {
+        std::size_t free_size = 0;
+        auto free_space = prepare(&free_size);
+        const auto part = std::min(size, free_size);
+        std::memcpy(free_space, data, part);
+        commit(part);
+        data += part;
+        size -= part;
+    }
+}
+
+void ChunkBuffer::append(const std::string& data) { append(data.data(), data.size()); }
+
+char* ChunkBuffer::prepare(std::size_t* size)
+{
+    if (m_tail == nullptr || m_end == BufferPool::chunk_size)
+    {
+        push_chunk();
+    }
+
+    *size = BufferPool::chunk_size - m_end;
+    return m_tail->data + m_end;
+}
+
+void ChunkBuffer::commit(const std::size_t size)
+{
+    assert(m_tail != nullptr && m_end + size <= BufferPool::chunk_size);
+    m_end += size;
+    m_size += size;
+}
+
+const char* ChunkBuffer::front() const { return m_head != nullptr ? m_head->data + m_begin : nullptr; }
+
+std::size_t ChunkBuffer::front_size() const
+{
+    if (m_head == nullptr)
+    {
+        return 0;
+    }
+
+    return (m_head == m_tail ? m_end : BufferPool::chunk_size) - m_begin;
+}
+
+void ChunkBuffer::consume(std::size_t size)
+{
+    assert(size <= m_size);
+    m_size -= size;
+    while (size != 0)
+    {
+        const auto part = std::min(size, front_size());
+        m_begin += part;
+        size -= part;
+
+        if (m_head != m_tail && m_begin == BufferPool::chunk_size)
+        {
+            auto chunk = m_head;
+            m_head = chunk->next;
+            m_begin = 0;
+            m_pool->release(chunk);
+        }
+    }
+
+    // the last chunk is kept for the data that comes next
+    if (m_size == 0 && m_head != nullptr)
+    {
+        m_begin = m_end = 0;
+    }
+}
+
+bool ChunkBuffer::empty() const { return m_size == 0; }
+
+std::size_t ChunkBuffer::size() const { return m_size; }
+
+void ChunkBuffer::clear()
+{
+    while (m_head != nullptr)
+    {
+        auto chunk = m_head;
+        m_head = chunk->next;
+        m_pool->release(chunk);
+    }
+
+    m_tail = nullptr;
+    m_begin = m_end = m_size = 0;
+}
+
+void ChunkBuffer::push_chunk()
+{
+    assert(m_pool != nullptr); // the buffer must be created with a pool
+    auto chunk = m_pool->acquire();
+    if (m_tail != nullptr)
+    {
+        m_tail->next = chunk;
+    }
+    else
+    {
+        m_head = chunk;
+    }
+
+    m_tail = chunk;
+    m_end = 0;
+}
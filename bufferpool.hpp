@@ -0,0 +1,115 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Fixed-size chunks for the data a connection relays, a single recv or send moves a whole chunk.
+// Released chunks are kept on a free list for the next connections instead of going back to malloc.
+// A pool belongs to one proxy thread, only the counters may be read by other threads.
+class BufferPool final
+{
+public:
+    static const std::size_t chunk_size = 16 * 1024;
+
+    struct Chunk
+    {
+        Chunk* next;
+        char data[chunk_size];
+    };
+
+    struct Counters
+    {
+        Counters()
+            : allocated_chunks(0)
+            , reused_chunks(0)
+            , used_chunks(0)
+            , idle_chunks(0)
+        {}
+
+        Counters& operator+= (const Counters& other);
+
+        uint64_t allocated_chunks; // taken from malloc
+        uint64_t reused_chunks;    // taken from the free list
+        uint64_t used_chunks;
+        uint64_t idle_chunks;
+    };
+
+public:
+    explicit BufferPool(const std::size_t max_idle_chunks);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator= (const BufferPool&) = delete;
+
+    Chunk* acquire();
+    void release(Chunk* chunk);
+
+    // may be called from any thread
+    Counters get_counters() const;
+
+private:
+    std::size_t m_max_idle_chunks;
+
+    Chunk* m_idle;
+    std::size_t m_idle_count;
+
+    // written only by the thread owning the pool
+    std::atomic<uint64_t> m_allocated_chunks;
+    std::atomic<uint64_t> m_reused_chunks;
+    std::atomic<uint64_t> m_used_chunks;
+    std::atomic<uint64_t> m_idle_chunks;
+};
+
+// A queue of bytes kept in a chain of pooled chunks, it never moves the data it holds.
+// Data may be received straight into the free space at the end and sent from the first chunk.
+class ChunkBuffer final
+{
+public:
+    ChunkBuffer();
+    explicit ChunkBuffer(BufferPool* pool);
+    ~ChunkBuffer();
+
+    ChunkBuffer(ChunkBuffer&& other);
+    ChunkBuffer& operator= (ChunkBuffer&& other);
+
+    ChunkBuffer(const ChunkBuffer&) = delete;
+    ChunkBuffer& operator= (const ChunkBuffer&) = delete;
+
+    void append(const char* data, std::size_t size);
+    void append(const std::string& data);
+
+    // the free space at the end, a new chunk is taken if the last one is full,
+    // the data written there belongs to the buffer after commit
+    char* prepare(std::size_t* size);
+    void commit(const std::size_t size);
+
+    // the data is consumed from the first chunk
+    const char* front() const;
+    std::size_t front_size() const;
+    void consume(std::size_t size);
+
+    bool empty() const;
+    std::size_t size() const;
+
+    // all chunks go back to the pool
+    void clear();
+
+private:
+    void push_chunk();
+
+private:
+    BufferPool* m_pool;
+
+    BufferPool::Chunk* m_head;
+    BufferPool::Chunk* m_tail;
+
+    // the data starts in the first chunk and ends in the last one, the chunks between are full
+    std::size_t m_begin;
+    std::size_t m_end;
+    std::size_t m_size;
+};
+
+#endif // BUFFER_POOL_HPP
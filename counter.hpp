@@ -0,0 +1,14 @@
+#ifndef COUNTER_HPP
+#define COUNTER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// Changes a counter that only the thread owning it writes and the others may read.
+// With a single writer a relaxed load and store are enough and cheaper than fetch_add.
+inline void add_counter(std::atomic<uint64_t>& counter, const int64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+#endif // COUNTER_HPP
@@ -0,0 +1,659 @@
+#include "diskcache.hpp"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+const char* const segment_prefix = "segment.";
+
+// a single segment takes this part of the cache, so eviction never drops too much at once
+const uint64_t segments_count = 16;
+const uint64_t min_segment_size = 1024 * 1024;
+
+// the parts waiting for the disk take no more memory, the responses that don't fit aren't stored
+const std::size_t max_pending_bytes = 64 * 1024 * 1024;
+
+// the fields of a journal line are separated by tabs
+std::string escape(const std::string& str)
+{
+    std::string result;
+    result.reserve(str.size());
+    for (auto c : str)
+    {
+        switch (c)
+        {
+        case '%': result += "%25"; break;
+        case '\t': result += "%09"; break;
+        case '\n': result += "%0A"; break;
+        case '\r': result += "%0D"; break;
+        default: result += c;
+        }
+    }
+
+    return result;
+}
+
+std::string unescape(const std::string& str)
+{
+    std::string result;
+    result.reserve(str.size());
+    for (std::size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '%' && i + 2 < str.size())
+        {
+            result += static_cast<char>(std::strtoul(str.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        }
+        else
+        {
+            result += str[i];
+        }
+    }
+
+    return result;
+}
+
+std::vector<std::string> split_line(const std::string& line)
+{
+    // an empty field is kept even at the end of the line, e.g. a Vary field the request hasn't sent
+    std::vector<std::string> fields;
+    std::size_t begin = 0;
+    for (auto tab = line.find('\t'); tab != std::string::npos; tab = line.find('\t', begin))
+    {
+        fields.push_back(unescape(line.substr(begin, tab - begin)));
+        begin = tab + 1;
+    }
+    fields.push_back(unescape(line.substr(begin)));
+
+    return fields;
+}
+
+bool write_all(const int fd, const char* data, std::size_t size)
+{
+    while (size != 0)
+    {
+        auto written = ::write(fd, data, size);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+}
+
+DiskCache::Segment::Segment(const uint64_t _id, const int _fd, const std::string& _path, const uint64_t _size)
+    : id(_id)
+    , fd(_fd)
+    , path(_path)
+    , size(_size)
+    , is_evicted(false)
+{}
+
+DiskCache::Segment::~Segment()
+{
+    ::close(fd);
+}
+
+DiskCache::DiskCache(const std::string& directory, const uint64_t max_bytes)
+    : m_directory(directory)
+    , m_max_bytes(max_bytes)
+    , m_segment_size(std::min(max_bytes, std::max(max_bytes / segments_count, min_segment_size)))
+    , m_bytes(0)
+    , m_journal_fd(-1)
+    , m_journal_lines(0)
+    , m_unfinished_jobs(0)
+    , m_pending_bytes(0)
+    , m_stopped(false)
+{}
+
+DiskCache::~DiskCache()
+{
+    if (m_thread.joinable())
+    {
+        // the queued responses are still written
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_stopped = true;
+        }
+        m_jobs_condition.notify_one();
+        m_thread.join();
+    }
+
+    if (m_journal_fd != -1)
+    {
+        ::close(m_journal_fd);
+    }
+}
+
+bool DiskCache::open()
+{
+    if (::mkdir(m_directory.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+        perror("mkdir:DiskCache");
+        return false;
+    }
+
+    DIR* dir = ::opendir(m_directory.c_str());
+    if (dir == nullptr)
+    {
+        perror("opendir:DiskCache");
+        return false;
+    }
+
+    std::unordered_map<uint64_t, std::shared_ptr<Segment> > segments;
+    while (auto entry = ::readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        if (name.compare(0, std::strlen(segment_prefix), segment_prefix) != 0)
+        {
+            continue;
+        }
+
+        const auto id = std::strtoull(name.c_str() + std::strlen(segment_prefix), nullptr, 10);
+        auto segment = open_segment(id, false);
+        if (segment)
+        {
+            segments[id] = segment;
+        }
+    }
+    ::closedir(dir);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto& segment : segments)
+        {
+            m_segments.push_back(segment.second);
+            m_bytes += segment.second->size;
+        }
+        m_segments.sort([](const std::shared_ptr<Segment>& a, const std::shared_ptr<Segment>& b) { return a->id < b->id; });
+
+        load_journal(segments);
+        evict_segments();
+    }
+
+    // the journal starts over with the live entries only
+    if (!write_journal())
+    {
+        return false;
+    }
+
+    m_thread = std::thread(&DiskCache::run, this);
+    return true;
+}
+
+bool DiskCache::find(const std::string& key, const std::string& request, Hit* hit)
+{
+    const auto now = std::time(nullptr);
+    uint64_t header_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            ++m_counters.misses;
+            return false;
+        }
+
+        const auto& entry = it->second;
+        if (entry.expires <= now)
+        {
+            m_index.erase(it);
+            ++m_counters.misses;
+            return false;
+        }
+
+        if (!ResponseCache::matches_vary(entry.vary, request))
+        {
+            ++m_counters.misses;
+            return false;
+        }
+
+        ++m_counters.hits;
+        m_counters.bytes_saved += entry.header_size + entry.body_size;
+
+        hit->segment = entry.segment;
+        hit->offset = entry.offset + entry.header_size;
+        hit->size = entry.body_size;
+        hit->age = entry.age + static_cast<long>(now - entry.stored);
+        header_size = entry.header_size;
+    }
+
+    // the header is small and is likely in the page cache, the body is never read by the proxy
+    hit->header.resize(header_size);
+    auto code = ::pread(hit->segment->fd, &hit->header[0], header_size, hit->offset - header_size);
+    if (code != static_cast<ssize_t>(header_size))
+    {
+        perror("pread:DiskCache");
+        hit->segment.reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool DiskCache::reserve(const uint64_t size, Writer* writer)
+{
+    if (size > m_segment_size)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_segments.empty() || m_segments.back()->size + size > m_segment_size)
+    {
+        const uint64_t id = m_segments.empty() ? 1 : m_segments.back()->id + 1;
+        auto segment = open_segment(id, true);
+        if (!segment)
+        {
+            return false;
+        }
+        m_segments.push_back(segment);
+    }
+
+    auto& segment = m_segments.back();
+    writer->segment = segment;
+    writer->offset = segment->size;
+    writer->size = size;
+    writer->written = 0;
+    writer->has_failed = std::make_shared<bool>(false);
+
+    segment->size += size;
+    m_bytes += size;
+    evict_segments();
+    return true;
+}
+
+bool DiskCache::write(Writer* writer, const char* data, const std::size_t size)
+{
+    if (writer->written + size > writer->size)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mutex);
+        if (m_pending_bytes + size > max_pending_bytes)
+        {
+            return false;
+        }
+        m_pending_bytes += size;
+    }
+
+    Job job;
+    job.type = Job::Type::WRITE;
+    job.segment = writer->segment;
+    job.has_failed = writer->has_failed;
+    job.offset = writer->offset + writer->written;
+    job.data.assign(data, size);
+    push_job(std::move(job));
+
+    writer->written += size;
+    return true;
+}
+
+void DiskCache::commit(const Writer& writer, const std::string& key, const std::string& request, const std::string& header,
+                       const long lifetime, const long age)
+{
+    if (writer.written != writer.size || header.size() > writer.size)
+    {
+        return;
+    }
+
+    Entry entry;
+    if (!ResponseCache::get_vary(header, request, &entry.vary))
+    {
+        return;
+    }
+
+    entry.segment = writer.segment;
+    entry.offset = writer.offset;
+    entry.header_size = header.size();
+    entry.body_size = writer.size - header.size();
+    entry.stored = std::time(nullptr);
+    entry.expires = entry.stored + (lifetime - age);
+    entry.age = age;
+
+    // the parts are written before, so the index never points to missing data
+    Job job;
+    job.type = Job::Type::COMMIT;
+    job.segment = writer.segment;
+    job.has_failed = writer.has_failed;
+    job.offset = writer.offset;
+    job.data = key;
+    job.entry = std::move(entry);
+    push_job(std::move(job));
+}
+
+void DiskCache::flush()
+{
+    std::unique_lock<std::mutex> lock(m_jobs_mutex);
+    m_done_condition.wait(lock, [this]() { return m_unfinished_jobs == 0; });
+}
+
+uint64_t DiskCache::get_max_response_bytes() const { return m_segment_size; }
+
+DiskCache::Counters DiskCache::get_counters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto counters = m_counters;
+    counters.entries = m_index.size();
+    counters.bytes = m_bytes;
+    return counters;
+}
+
+std::shared_ptr<DiskCache::Segment> DiskCache::open_segment(const uint64_t id, const bool create)
+{
+    const auto path = get_segment_path(id);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd == -1)
+    {
+        perror("open:DiskCache");
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1)
+    {
+        perror("fstat:DiskCache");
+        ::close(fd);
+        return nullptr;
+    }
+
+    return std::make_shared<Segment>(id, fd, path, static_cast<uint64_t>(st.st_size));
+}
+
+bool DiskCache::load_journal(const std::unordered_map<uint64_t, std::shared_ptr<Segment> >& segments)
+{
+    std::ifstream journal(get_journal_path());
+    if (!journal)
+    {
+        return false;
+    }
+
+    const auto now = std::time(nullptr);
+    std::string line;
+    while (std::getline(journal, line))
+    {
+        // key segment offset header_size body_size stored expires age [vary_name vary_value]...
+        const auto fields = split_line(line);
+        if (fields.size() < 8 || fields.size() % 2 != 0)
+        {
+            continue; // a line that was being written when the proxy stopped
+        }
+
+        Entry entry;
+        auto segment = segments.find(std::strtoull(fields[1].c_str(), nullptr, 10));
+        entry.offset = std::strtoull(fields[2].c_str(), nullptr, 10);
+        entry.header_size = std::strtoull(fields[3].c_str(), nullptr, 10);
+        entry.body_size = std::strtoull(fields[4].c_str(), nullptr, 10);
+        entry.stored = static_cast<std::time_t>(std::strtoll(fields[5].c_str(), nullptr, 10));
+        entry.expires = static_cast<std::time_t>(std::strtoll(fields[6].c_str(), nullptr, 10));
+        entry.age = std::strtol(fields[7].c_str(), nullptr, 10);
+        for (std::size_t i = 8; i < fields.size(); i += 2)
+        {
+            entry.vary.emplace_back(fields[i], fields[i + 1]);
+        }
+
+        // the later lines replace the earlier ones, the responses from evicted segments are gone
+        if (segment == segments.end()
+                || entry.offset + entry.header_size + entry.body_size > segment->second->size
+                || entry.expires <= now)
+        {
+            m_index.erase(fields[0]);
+            continue;
+        }
+
+        entry.segment = segment->second;
+        entry.segment->keys.push_back(fields[0]);
+        m_index[fields[0]] = std::move(entry);
+    }
+
+    return true;
+}
+
+bool DiskCache::write_journal()
+{
+    // the new journal replaces the old one at once, so a crash never leaves a partial journal
+    const auto path = get_journal_path();
+    const auto temporary_path = path + ".tmp";
+
+    int fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        perror("open:DiskCache:journal");
+        return false;
+    }
+
+    std::string lines;
+    std::size_t lines_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& entry : m_index)
+        {
+            lines += make_journal_line(entry.first, entry.second);
+        }
+        lines_count = m_index.size();
+    }
+
+    if (!write_all(fd, lines.data(), lines.size()) || ::rename(temporary_path.c_str(), path.c_str()) == -1)
+    {
+        perror("write:DiskCache:journal");
+        ::close(fd);
+        return false;
+    }
+
+    ::close(fd);
+
+    if (m_journal_fd != -1)
+    {
+        ::close(m_journal_fd);
+    }
+
+    m_journal_fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    m_journal_lines = lines_count;
+    return m_journal_fd != -1;
+}
+
+void DiskCache::evict_segments()
+{
+    // the last segment is the one being filled, it is never evicted
+    while (m_bytes > m_max_bytes && m_segments.size() > 1)
+    {
+        auto segment = m_segments.front();
+        m_segments.pop_front();
+
+        segment->is_evicted = true;
+        m_bytes -= segment->size;
+        ++m_counters.evicted_segments;
+
+        for (const auto& key : segment->keys)
+        {
+            auto it = m_index.find(key);
+            if (it != m_index.end() && it->second.segment == segment)
+            {
+                m_index.erase(it);
+            }
+        }
+        segment->keys.clear();
+
+        Job job;
+        job.type = Job::Type::UNLINK;
+        job.offset = 0;
+        job.data = segment->path;
+        push_job(std::move(job));
+    }
+}
+
+void DiskCache::push_job(Job&& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mutex);
+        m_jobs.push_back(std::move(job));
+        ++m_unfinished_jobs;
+    }
+    m_jobs_condition.notify_one();
+}
+
+void DiskCache::run()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobs_mutex);
+            m_jobs_condition.wait(lock, [this]() { return m_stopped || !m_jobs.empty(); });
+            if (m_jobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        switch (job.type)
+        {
+        case Job::Type::WRITE:
+            write_part(job);
+            break;
+        case Job::Type::COMMIT:
+            store(job);
+            break;
+        case Job::Type::UNLINK:
+            ::unlink(job.data.c_str());
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            if (job.type == Job::Type::WRITE)
+            {
+                m_pending_bytes -= job.data.size();
+            }
+            --m_unfinished_jobs;
+        }
+        m_done_condition.notify_all();
+    }
+}
+
+void DiskCache::write_part(const Job& job)
+{
+    // a failed part leaves a hole in the segment, the response is just not stored
+    if (*job.has_failed)
+    {
+        return;
+    }
+
+    std::size_t done = 0;
+    while (done < job.data.size())
+    {
+        auto code = ::pwrite(job.segment->fd, job.data.data() + done, job.data.size() - done, job.offset + done);
+        if (code == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("pwrite:DiskCache");
+            *job.has_failed = true;
+            return;
+        }
+        done += code;
+    }
+}
+
+void DiskCache::store(const Job& job)
+{
+    if (*job.has_failed)
+    {
+        return;
+    }
+
+    const auto& key = job.data;
+    std::string line;
+    bool is_rewritten = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (job.segment->is_evicted)
+        {
+            return; // the cache has been filled up while the response was being written
+        }
+
+        m_index[key] = job.entry;
+        job.segment->keys.push_back(key);
+        ++m_counters.stores;
+
+        is_rewritten = m_journal_lines > 2 * m_index.size() + 1024;
+        if (!is_rewritten)
+        {
+            line = make_journal_line(key, job.entry);
+        }
+    }
+
+    if (is_rewritten)
+    {
+        write_journal();
+        return;
+    }
+
+    // the response is written before its line, so the journal never points to missing data
+    if (m_journal_fd == -1 || !write_all(m_journal_fd, line.data(), line.size()))
+    {
+        perror("write:DiskCache:journal");
+        return;
+    }
+
+    ++m_journal_lines;
+}
+
+std::string DiskCache::get_segment_path(const uint64_t id) const
+{
+    return m_directory + "/" + segment_prefix + std::to_string(id);
+}
+
+std::string DiskCache::get_journal_path() const { return m_directory + "/journal"; }
+
+std::string DiskCache::make_journal_line(const std::string& key, const Entry& entry)
+{
+    std::string line = escape(key)
+            + "\t" + std::to_string(entry.segment->id)
+            + "\t" + std::to_string(entry.offset)
+            + "\t" + std::to_string(entry.header_size)
+            + "\t" + std::to_string(entry.body_size)
+            + "\t" + std::to_string(static_cast<long long>(entry.stored))
+            + "\t" + std::to_string(static_cast<long long>(entry.expires))
+            + "\t" + std::to_string(entry.age);
+
+    for (const auto& field : entry.vary)
+    {
+        line += "\t" + escape(field.first) + "\t" + escape(field.second);
+    }
+
+    return line + "\n";
+}
@@ -0,0 +1,220 @@
+#ifndef DISK_CACHE_HPP
+#define DISK_CACHE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "responsecache.hpp"
+
+// Responses kept on disk between restarts, shared by all proxies. Responses are appended to large
+// segment files and are sent to clients straight from them with sendfile(2). The index lives in memory
+// and is rebuilt at startup from a journal that gets a line for every stored response.
+// When the cache is full the oldest segment is deleted with all of its responses.
+// The proxies only queue the parts of responses, a thread of the cache writes them, the journal and deletes
+// the evicted segments, so the event loops never wait for the disk.
+class DiskCache final
+{
+public:
+    struct Counters
+    {
+        Counters()
+            : hits(0)
+            , misses(0)
+            , stores(0)
+            , evicted_segments(0)
+            , bytes_saved(0)
+            , entries(0)
+            , bytes(0)
+        {}
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stores;
+        uint64_t evicted_segments;
+        uint64_t bytes_saved;
+        uint64_t entries;
+        uint64_t bytes;
+    };
+
+    // the file is closed when the last user releases it,
+    // so a response may be sent from a segment that has just been evicted
+    struct Segment
+    {
+        Segment(const uint64_t _id, const int _fd, const std::string& _path, const uint64_t _size);
+        ~Segment();
+
+        Segment(const Segment&) = delete;
+        Segment& operator= (const Segment&) = delete;
+
+        uint64_t id;
+        int fd;
+        std::string path;
+
+        // the end of the reserved space
+        uint64_t size;
+
+        bool is_evicted;
+
+        // the keys of the responses stored in the segment, some of them may point elsewhere by now
+        std::vector<std::string> keys;
+    };
+
+    // the body of a found response is sent from the segment
+    struct Hit
+    {
+        Hit()
+            : offset(0)
+            , size(0)
+            , age(0)
+        {}
+
+        std::shared_ptr<const Segment> segment;
+        std::string header;
+        uint64_t offset;
+        uint64_t size;
+        long age;
+    };
+
+    // the space reserved for a response, the response is written while it is relayed to the client
+    struct Writer
+    {
+        Writer()
+            : offset(0)
+            , size(0)
+            , written(0)
+        {}
+
+        std::shared_ptr<Segment> segment;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t written;
+
+        // set by the thread of the cache if a part can't be written, the response isn't committed then
+        std::shared_ptr<bool> has_failed;
+    };
+
+public:
+    DiskCache(const std::string& directory, const uint64_t max_bytes);
+    ~DiskCache();
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator= (const DiskCache&) = delete;
+
+    // reads the segments and the journal and starts the thread, false if the directory can't be used
+    bool open();
+
+    bool find(const std::string& key, const std::string& request, Hit* hit);
+
+    // the header and the body of the response must fit in the size
+    bool reserve(const uint64_t size, Writer* writer);
+
+    // queues the next part of the response for the reserved space, false if it doesn't fit
+    // or too much is waiting for the disk already
+    bool write(Writer* writer, const char* data, const std::size_t size);
+
+    // the response becomes visible when its parts are written and the reserved space is filled, the header must be
+    // the first thing written and must come from ResponseCache::make_stored_header
+    void commit(const Writer& writer, const std::string& key, const std::string& request, const std::string& header,
+                const long lifetime, const long age);
+
+    // waits until the queued parts and commits are done
+    void flush();
+
+    uint64_t get_max_response_bytes() const;
+
+    Counters get_counters() const;
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<Segment> segment;
+        uint64_t offset;
+        uint64_t header_size;
+        uint64_t body_size;
+        std::time_t stored;
+        std::time_t expires;
+        long age;
+        ResponseCache::Vary vary;
+    };
+
+    // the work of the thread, done in the order it is queued
+    struct Job
+    {
+        enum class Type
+        {
+            WRITE,
+            COMMIT,
+            UNLINK
+        };
+
+        Type type;
+        std::shared_ptr<Segment> segment;
+        std::shared_ptr<bool> has_failed;
+        uint64_t offset;
+
+        // the part of the response, the key of the committed one or the path of the evicted segment
+        std::string data;
+        Entry entry;
+    };
+
+private:
+    std::shared_ptr<Segment> open_segment(const uint64_t id, const bool create);
+    bool load_journal(const std::unordered_map<uint64_t, std::shared_ptr<Segment> >& segments);
+    bool write_journal();
+    void evict_segments();
+
+    void push_job(Job&& job);
+    void run();
+    void write_part(const Job& job);
+    void store(const Job& job);
+
+    std::string get_segment_path(const uint64_t id) const;
+    std::string get_journal_path() const;
+
+    static std::string make_journal_line(const std::string& key, const Entry& entry);
+
+private:
+    std::string m_directory;
+    uint64_t m_max_bytes;
+    uint64_t m_segment_size;
+
+    mutable std::mutex m_mutex;
+
+    // the oldest segments are at the front, responses are appended to the last one
+    std::list< std::shared_ptr<Segment> > m_segments;
+    uint64_t m_bytes;
+
+    std::unordered_map<std::string, Entry> m_index;
+
+    Counters m_counters;
+
+    // the journal belongs to the thread once it is started
+    int m_journal_fd;
+
+    // the journal is rewritten with the live entries only when it has too many stale lines
+    std::size_t m_journal_lines;
+
+    std::mutex m_jobs_mutex;
+    std::condition_variable m_jobs_condition;
+    std::condition_variable m_done_condition;
+    std::deque<Job> m_jobs;
+
+    // queued or being done
+    std::size_t m_unfinished_jobs;
+    std::size_t m_pending_bytes;
+    bool m_stopped;
+
+    std::thread m_thread;
+};
+
+#endif // DISK_CACHE_HPP
@@ -0,0 +1,103 @@
+#include "dnscache.hpp"
+#include <cassert>
+
+DnsCache::DnsCache(const std::size_t max_entries, const Clock::duration ttl, const Clock::duration negative_ttl)
+    : m_max_entries(max_entries)
+    , m_ttl(ttl)
+    , m_negative_ttl(negative_ttl)
+{
+    assert(m_max_entries > 0);
+}
+
+DnsCache::Lookup DnsCache::find(const std::string& host, const uint16_t port, std::vector<IpAddress>* addresses)
+{
+    // steady_clock is read through vDSO, so a hit costs no system call
+    const auto now = Clock::now();
+    const auto key = make_key(host, port);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        ++m_counters.misses;
+        return Lookup::MISS;
+    }
+
+    auto entry = it->second;
+    if (entry->expires <= now)
+    {
+        m_entries.erase(entry);
+        m_index.erase(it);
+        ++m_counters.misses;
+        return Lookup::MISS;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+    *addresses = entry->addresses;
+
+    if (entry->addresses.empty())
+    {
+        ++m_counters.negative_hits;
+        return Lookup::HIT;
+    }
+
+    ++m_counters.hits;
+    if (!entry->is_refreshing && entry->refresh <= now)
+    {
+        // only one caller refreshes the entry, the others keep using it until the new addresses arrive
+        entry->is_refreshing = true;
+        ++m_counters.refreshes;
+        return Lookup::HIT_REFRESH;
+    }
+
+    return Lookup::HIT;
+}
+
+void DnsCache::insert(const std::string& host, const uint16_t port, const std::vector<IpAddress>& addresses)
+{
+    const auto now = Clock::now();
+    const auto key = make_key(host, port);
+    const auto ttl = addresses.empty() ? m_negative_ttl : m_ttl;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        // a failed refresh keeps the old addresses until they expire
+        if (addresses.empty() && !it->second->addresses.empty())
+        {
+            it->second->is_refreshing = false;
+            return;
+        }
+
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+
+    // refresh starts when 90% of the time to live has passed
+    m_entries.push_front(Entry{key, addresses, now + ttl, now + ttl - ttl / 10, false});
+    m_index[key] = m_entries.begin();
+
+    while (m_entries.size() > m_max_entries)
+    {
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+        ++m_counters.evictions;
+    }
+}
+
+DnsCache::Counters DnsCache::get_counters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto counters = m_counters;
+    counters.entries = m_entries.size();
+    return counters;
+}
+
+std::string DnsCache::make_key(const std::string& host, const uint16_t port)
+{
+    return host + ":" + std::to_string(port);
+}
@@ -0,0 +1,90 @@
+#ifndef DNS_CACHE_HPP
+#define DNS_CACHE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ipaddress.hpp"
+
+// Resolved addresses shared by all proxies, bounded by the number of entries with LRU eviction.
+// Failed lookups are kept too, but for a shorter time.
+class DnsCache final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Lookup
+    {
+        MISS,
+        HIT,
+        HIT_REFRESH // the entry expires soon, the caller should resolve the name again in background
+    };
+
+    struct Counters
+    {
+        Counters()
+            : hits(0)
+            , negative_hits(0)
+            , misses(0)
+            , refreshes(0)
+            , evictions(0)
+            , entries(0)
+        {}
+
+        uint64_t hits;
+        uint64_t negative_hits;
+        uint64_t misses;
+        uint64_t refreshes;
+        uint64_t evictions;
+        uint64_t entries;
+    };
+
+public:
+    DnsCache(const std::size_t max_entries, const Clock::duration ttl, const Clock::duration negative_ttl);
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache& operator= (const DnsCache&) = delete;
+
+    // empty addresses on a hit mean that the name is known to be unresolvable
+    Lookup find(const std::string& host, const uint16_t port, std::vector<IpAddress>* addresses);
+
+    void insert(const std::string& host, const uint16_t port, const std::vector<IpAddress>& addresses);
+
+    Counters get_counters() const;
+
+private:
+    struct Entry
+    {
+        std::string key;
+        std::vector<IpAddress> addresses;
+        Clock::time_point expires;
+        Clock::time_point refresh;
+        bool is_refreshing;
+    };
+
+    using Entries = std::list<Entry>;
+
+private:
+    static std::string make_key(const std::string& host, const uint16_t port);
+
+private:
+    std::size_t m_max_entries;
+    Clock::duration m_ttl;
+    Clock::duration m_negative_ttl;
+
+    mutable std::mutex m_mutex;
+
+    // the most recently used entries are at the front
+    Entries m_entries;
+    std::unordered_map<std::string, Entries::iterator> m_index;
+
+    Counters m_counters;
+};
+
+#endif // DNS_CACHE_HPP
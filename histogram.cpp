@@ -0,0 +1,64 @@
+#include "histogram.hpp"
+#include "counter.hpp"
+
+LatencyHistogram::Snapshot::Snapshot()
+    : buckets()
+    , count(0)
+    , sum_microseconds(0)
+{}
+
+LatencyHistogram::Snapshot& LatencyHistogram::Snapshot::operator+= (const Snapshot& other)
+{
+    for (std::size_t i = 0; i < buckets_count; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum_microseconds += other.sum_microseconds;
+    return *this;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_sum_microseconds(0)
+{
+    for (auto& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(const std::chrono::steady_clock::duration duration)
+{
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    const uint64_t value = microseconds > 0 ? static_cast<uint64_t>(microseconds) : 0;
+
+    add_counter(m_buckets[get_bucket(value)], 1);
+    add_counter(m_sum_microseconds, value);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::get_snapshot() const
+{
+    // the count is the sum of the buckets, so it always agrees with them
+    Snapshot snapshot;
+    for (std::size_t i = 0; i < buckets_count; ++i)
+    {
+        snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.sum_microseconds = m_sum_microseconds.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::get_upper_bound(const std::size_t bucket) { return uint64_t(1) << bucket; }
+
+std::size_t LatencyHistogram::get_bucket(const uint64_t microseconds)
+{
+    // the smallest power of two that is not less than the duration
+    if (microseconds <= 1)
+    {
+        return 0;
+    }
+
+    const std::size_t bucket = 64 - __builtin_clzll(microseconds - 1);
+    return bucket < buckets_count - 1 ? bucket : buckets_count - 1;
+}
@@ -0,0 +1,51 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Counts durations in buckets whose bounds double from 1 microsecond up to about a minute,
+// the last bucket takes everything longer. Recording a duration is a few relaxed stores,
+// a histogram has only one writer, the thread that owns it, the others take snapshots.
+class LatencyHistogram final
+{
+public:
+    static const std::size_t buckets_count = 28;
+
+    struct Snapshot
+    {
+        Snapshot();
+
+        Snapshot& operator+= (const Snapshot& other);
+
+        // not cumulative, the i-th bucket counts the durations between the bounds of the previous and its own
+        uint64_t buckets[buckets_count];
+        uint64_t count;
+        uint64_t sum_microseconds;
+    };
+
+public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator= (const LatencyHistogram&) = delete;
+
+    void record(const std::chrono::steady_clock::duration duration);
+
+    // may be called from any thread
+    Snapshot get_snapshot() const;
+
+    // the largest duration the bucket counts, the last bucket has no bound
+    static uint64_t get_upper_bound(const std::size_t bucket);
+
+private:
+    static std::size_t get_bucket(const uint64_t microseconds);
+
+private:
+    std::atomic<uint64_t> m_buckets[buckets_count];
+    std::atomic<uint64_t> m_sum_microseconds;
+};
+
+#endif // HISTOGRAM_HPP
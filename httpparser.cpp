@@ -1,117 +1,348 @@
 #include "httpparser.hpp"
-#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
 
-HttpParser::Header HttpParser::parse(const std::string& request)
+namespace
 {
-    std::string str;
-    std::stringstream ss(request);
 
-    Header header;
+bool equals(const char* data, const RequestParser::Span& span, const char* str)
+{
+    return std::strlen(str) == span.size && std::memcmp(data + span.offset, str, span.size) == 0;
+}
 
-    if (ss >> str)
+bool icontains(const char* data, const RequestParser::Span& span, const char* lowercase)
+{
+    const std::size_t size = std::strlen(lowercase);
+    for (std::size_t i = 0; i + size <= span.size; ++i)
     {
-        if (str == "GET")
+        if (RequestParser::iequals(data, RequestParser::Span(span.offset + i, size), lowercase))
         {
-            header.method = Method::GET;
+            return true;
         }
-        else if (str == "HEAD")
+    }
+
+    return false;
+}
+
+bool iequals(const std::string& str, const std::size_t pos, const std::size_t size, const char* lowercase)
+{
+    std::size_t i = 0;
+    for (; i < size && lowercase[i] != '\0'; ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(str[pos + i])) != lowercase[i])
         {
-            header.method = Method::HEAD;
+            return false;
         }
-        else if (str == "POST")
+    }
+
+    return i == size && lowercase[i] == '\0';
+}
+
+// finds the field after the given line, which is then moved to the line of the field, 0 stands for the start line
+bool find_next_field(const std::string& header, const char* name, std::size_t* line, std::string* value)
+{
+    // the first line is the start line, fields follow it one per line
+    auto end_of_line = header.find("\r\n", *line);
+    while (end_of_line != std::string::npos)
+    {
+        const auto begin_of_line = end_of_line + 2; // sizeof "\r\n"
+        end_of_line = header.find("\r\n", begin_of_line);
+        if (end_of_line == std::string::npos || end_of_line == begin_of_line)
         {
-            header.method = Method::POST;
+            break;
         }
-        else
+
+        auto colon = header.find(':', begin_of_line);
+        if (colon < end_of_line && iequals(header, begin_of_line, colon - begin_of_line, name))
         {
-            if (str.size() >= 3)
-            {
-                header.method = Method::UNKNOWN;
-            }
+            auto begin = header.find_first_not_of(" \t", colon + 1);
+            auto end = header.find_last_not_of(" \t", end_of_line - 1);
+            *value = (begin < end_of_line && end != std::string::npos && end >= begin)
+                    ? header.substr(begin, end - begin + 1) : std::string();
+            *line = begin_of_line;
+            return true;
+        }
+    }
 
-            return header;
+    return false;
+}
+
+// copies all fields except the hop-by-hop ones, the start line must end before end_of_header
+void copy_end_to_end_fields(const std::string& message, const std::size_t end_of_header, std::string* result, bool* has_host)
+{
+    static const char* const hop_by_hop_fields[] = { "connection", "proxy-connection", "keep-alive" };
+
+    auto end_of_line = message.find("\r\n");
+    while (end_of_line < end_of_header)
+    {
+        auto line = end_of_line + 2; // sizeof "\r\n"
+        end_of_line = message.find("\r\n", line);
+
+        auto colon = message.find(':', line);
+        if (colon > end_of_line)
+        {
+            continue; // malformed field
         }
 
-        if (ss >> str)
+        bool is_hop_by_hop = false;
+        for (auto name : hop_by_hop_fields)
         {
-            str = str.substr(7); // erase http://
-            if (str.back() == '/')
-            {
-                str.pop_back(); // erase the last slash
-            }
-            header.URI = str;
+            is_hop_by_hop = is_hop_by_hop || iequals(message, line, colon - line, name);
         }
-        else
+
+        if (!is_hop_by_hop)
         {
-            return header;
+            *has_host = *has_host || iequals(message, line, colon - line, "host");
+            result->append(message, line, end_of_line - line + 2);
+        }
+    }
+}
+
+}
+
+HttpParser::Header HttpParser::parse(const std::string& request)
+{
+    RequestParser parser;
+    if (parser.parse(request.data(), request.size()) != RequestParser::Status::DONE)
+    {
+        return Header();
+    }
+
+    return parse(parser, request.data());
+}
+
+HttpParser::Header HttpParser::parse(const RequestParser& parser, const char* data)
+{
+    Header header;
+
+    const auto& method = parser.get_method();
+    if (equals(data, method, "GET"))
+    {
+        header.method = Method::GET;
+    }
+    else if (equals(data, method, "HEAD"))
+    {
+        header.method = Method::HEAD;
+    }
+    else if (equals(data, method, "POST"))
+    {
+        header.method = Method::POST;
+    }
+    else if (equals(data, method, "PUT"))
+    {
+        header.method = Method::PUT;
+    }
+    else
+    {
+        return header;
+    }
+
+    const auto& version = parser.get_version();
+    if (equals(data, version, "HTTP/1.0"))
+    {
+        header.version = Version::HTTP_1_0;
+    }
+    else if (equals(data, version, "HTTP/1.1"))
+    {
+        header.version = Version::HTTP_1_1;
+    }
+    else
+    {
+        return header;
+    }
+
+    // only the absolute form is expected from a client of the proxy
+    auto target = parser.get_target();
+    if (target.size <= 7 || !RequestParser::iequals(data, RequestParser::Span(target.offset, 7), "http://"))
+    {
+        return header;
+    }
+
+    target.offset += 7; // erase http://
+    target.size -= 7;
+
+    // the path goes to the server as it is sent, /dir and /dir/ are different resources
+    const char* begin = data + target.offset;
+    const char* end = begin + target.size;
+    const char* slash = std::find(begin, end, '/');
+    const char* colon = std::find(begin, slash, ':');
+
+    header.path = slash == end ? "/" : std::string(slash, end);
+    header.host.assign(begin, colon);
+    if (colon != slash)
+    {
+        unsigned long port = 0;
+        for (auto c = colon + 1; c != slash && port <= 65535; ++c)
+        {
+            port = std::isdigit(static_cast<unsigned char>(*c)) ? port * 10 + (*c - '0') : 65536;
         }
 
-        if (ss >> str)
+        if (port == 0 || port > 65535)
         {
-            if (str == "HTTP/1.0")
-            {
-                header.version = Version::HTTP_1_0;
-            }
-            else if (str == "HTTP/1.1")
-            {
-                header.version = Version::HTTP_1_1;
-            }
-            else
-            {
-                return header;
-            }
+            return header;
         }
+        header.port = static_cast<uint16_t>(port);
     }
 
+    // the URI of the root is logged without the slash
+    header.URI.assign(begin, slash + 1 == end ? slash : end);
     return header;
 }
 
-bool HttpParser::query_is_end(const std::string& request)
+bool HttpParser::content_length(const std::string& header, uint64_t* length)
 {
-    auto pos = request.find("Content-Length: ");
-    if (pos != std::string::npos)
+    // RFC 7230 3.3.3, Content-Length lines that differ make the message length unknown
+    bool is_found = false;
+    uint64_t result = 0;
+    std::string value;
+    std::size_t line = 0;
+    while (find_next_field(header, "content-length", &line, &value))
     {
-        pos += 16; // sizeof "Content-Length: "
-        auto end_of_content_length = request.find("\r\n", pos);
-        if (end_of_content_length != std::string::npos)
+        if (value.empty())
         {
-            auto length_string = request.substr(pos, end_of_content_length - pos);
-            auto content_length = std::stoul(length_string);
+            return false;
+        }
 
-            auto end_of_http_header = request.find("\r\n\r\n");
-            if (end_of_http_header != std::string::npos
-                    && ((request.size() - end_of_http_header - 4 /* sizeof "\r\n\r\n" */) >= content_length))
+        uint64_t next = 0;
+        for (auto c : value)
+        {
+            if (!std::isdigit(static_cast<unsigned char>(c)) || next > (std::numeric_limits<uint64_t>::max() - 9) / 10)
             {
-                return true;
+                return false;
             }
+            next = next * 10 + (c - '0');
+        }
+
+        if (is_found && next != result)
+        {
+            return false;
+        }
+
+        is_found = true;
+        result = next;
+    }
+
+    if (!is_found)
+    {
+        return false;
+    }
+
+    *length = result;
+    return true;
+}
+
+bool HttpParser::find_field(const std::string& header, const char* name, std::string* value)
+{
+    std::size_t line = 0;
+    return find_next_field(header, name, &line, value);
+}
+
+int HttpParser::status_code(const std::string& header)
+{
+    // HTTP/1.x NNN
+    if (header.size() < 12 || header.compare(0, 5, "HTTP/") != 0 || header[8] != ' ')
+    {
+        return 0;
+    }
+
+    int code = 0;
+    for (std::size_t i = 9; i < 12; ++i)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(header[i])))
+        {
+            return 0;
         }
+        code = code * 10 + (header[i] - '0');
+    }
+
+    return code;
+}
+
+bool HttpParser::is_keep_alive(const std::string& header)
+{
+    std::string value;
+    const bool has_connection = find_field(header, "connection", &value);
+    for (auto& c : value)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    if (has_connection && value.find("close") != std::string::npos)
+    {
+        return false;
+    }
+
+    // HTTP/1.1 connections are persistent by default, HTTP/1.0 ones only on request
+    return header.compare(0, 8, "HTTP/1.1") == 0
+            || (has_connection && value.find("keep-alive") != std::string::npos);
+}
+
+std::string HttpParser::make_server_request(const std::string& request, const Header& header, const bool keep_alive)
+{
+    auto end_of_header = request.find("\r\n\r\n");
+    if (end_of_header == std::string::npos)
+    {
+        return request;
+    }
+
+    std::string result;
+    result.reserve(request.size() + 32);
+    result += request.substr(0, request.find(' ') + 1);
+    result += header.path;
+
+    // the client's version is kept, so an HTTP/1.0 client never gets a chunked response
+    result += header.version == Version::HTTP_1_1 ? " HTTP/1.1\r\n" : " HTTP/1.0\r\n";
+
+    bool has_host = false;
+    copy_end_to_end_fields(request, end_of_header, &result, &has_host);
+    if (!has_host)
+    {
+        result += "Host: " + header.host + (header.port == 80 ? "" : ":" + std::to_string(header.port)) + "\r\n";
+    }
+
+    result += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    result += "\r\n";
+    result.append(request, end_of_header + 4, std::string::npos); // the body
+    return result;
+}
+
+std::string HttpParser::make_client_response(const std::string& header, const bool keep_alive)
+{
+    auto end_of_header = header.find("\r\n\r\n");
+    if (end_of_header == std::string::npos)
+    {
+        return header;
+    }
+
+    std::string result;
+    result.reserve(header.size() + 32);
+    result.append(header, 0, header.find("\r\n") + 2); // the status line
+
+    bool has_host = false;
+    copy_end_to_end_fields(header, end_of_header, &result, &has_host);
+
+    result += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    result += "\r\n";
+    result.append(header, end_of_header + 4, std::string::npos);
+    return result;
+}
+
+bool HttpParser::is_keep_alive(const RequestParser& parser, const char* data, const Header& header)
+{
+    // a client talking to a proxy may use either field
+    RequestParser::Span value;
+    if (!parser.find_field(data, "proxy-connection", &value) && !parser.find_field(data, "connection", &value))
+    {
+        return header.version == Version::HTTP_1_1;
+    }
+
+    if (icontains(data, value, "close"))
+    {
+        return false;
     }
 
-    bool is_end_by_default = (request.size() > 4
-                              && request[request.size() - 4] == '\r'
-                              && request[request.size() - 3] == '\n'
-                              && request[request.size() - 2] == '\r'
-                              && request[request.size() - 1] == '\n');
-
-    bool is_end_by_html = (request.size() > 7
-                           && request[request.size() - 1] == '>'
-                           && request[request.size() - 2] == 'l'
-                           && request[request.size() - 3] == 'm'
-                           && request[request.size() - 4] == 't'
-                           && request[request.size() - 5] == 'h'
-                           && request[request.size() - 6] == '/'
-                           && request[request.size() - 7] == '<');
-
-    bool is_end_by_html_with_eol = (request.size() > 9
-                                    && request[request.size() - 1] == '\n'
-                                    && request[request.size() - 2] == '\r'
-                                    && request[request.size() - 3] == '>'
-                                    && request[request.size() - 4] == 'L'
-                                    && request[request.size() - 5] == 'M'
-                                    && request[request.size() - 6] == 'T'
-                                    && request[request.size() - 7] == 'H'
-                                    && request[request.size() - 8] == '/'
-                                    && request[request.size() - 9] == '<');
-
-    return is_end_by_default || is_end_by_html || is_end_by_html_with_eol;
+    return header.version == Version::HTTP_1_1 || icontains(data, value, "keep-alive");
 }
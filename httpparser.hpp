@@ -1,9 +1,12 @@
 #ifndef HTTP_PARSER_HPP
 #define HTTP_PARSER_HPP
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "requestparser.hpp"
+
 class HttpParser
 {
 public:
@@ -12,6 +15,7 @@ public:
         GET,
         HEAD,
         POST,
+        PUT,
         UNKNOWN
     };
 
@@ -27,6 +31,7 @@ public:
         Header()
             : method(Method::UNKNOWN)
             , version(Version::UNKNOWN)
+            , port(80)
         {}
 
         operator bool() const
@@ -37,11 +42,43 @@ public:
         Method method;
         Version version;
         std::string URI;
+
+        // the authority part of the URI
+        std::string host;
+        uint16_t port;
+
+        // the URI without scheme and authority, as it is sent to the server
+        std::string path;
     };
 
 public:
     static Header parse(const std::string& request);
-    static bool query_is_end(const std::string& request);
+
+    // the header of a request that the parser has finished, data is the parsed buffer
+    static Header parse(const RequestParser& parser, const char* data);
+
+
+    // looks for Content-Length among the header fields, returns false if there is no valid one or the ones found differ
+    static bool content_length(const std::string& header, uint64_t* length);
+
+    // the value of the first field with the given name, the name must be in lower case
+    static bool find_field(const std::string& header, const char* name, std::string* value);
+
+    // the status code of a response header, 0 if the status line is malformed
+    static int status_code(const std::string& header);
+
+    // whether the server keeps the connection open after the response
+    static bool is_keep_alive(const std::string& header);
+
+    // whether the client wants to send more requests over the connection
+    static bool is_keep_alive(const RequestParser& parser, const char* data, const Header& header);
+
+    // the complete client request rewritten for the server: the origin-form URI,
+    // no hop-by-hop fields and a connection field that asks the server to keep connection or to close it
+    static std::string make_server_request(const std::string& request, const Header& header, const bool keep_alive);
+
+    // the response header rewritten for the client in the same way
+    static std::string make_client_response(const std::string& header, const bool keep_alive);
 };
 
 #endif // HTTP_PARSER_HPP
@@ -0,0 +1,262 @@
+#include "iouring.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+struct IoUring::Sqe : io_uring_sqe {};
+
+namespace
+{
+
+// the user data of the requests whose completions nobody waits for
+const uint64_t no_user_data = ~uint64_t(0);
+
+}
+
+IoUring::IoUring()
+    : m_fd(-1)
+    , m_enter_fd(-1)
+    , m_enter_flags(0)
+    , m_is_registration_tried(false)
+    , m_ring(MAP_FAILED)
+    , m_ring_size(0)
+    , m_sqes(MAP_FAILED)
+    , m_sqes_size(0)
+    , m_sq_head(nullptr)
+    , m_sq_tail(nullptr)
+    , m_sq_mask(0)
+    , m_sq_entries(0)
+    , m_sq_local_tail(0)
+    , m_cq_head(nullptr)
+    , m_cq_tail(nullptr)
+    , m_cq_mask(0)
+    , m_cqes(nullptr)
+{}
+
+IoUring::~IoUring()
+{
+    if (m_sqes != MAP_FAILED)
+    {
+        ::munmap(m_sqes, m_sqes_size);
+    }
+    if (m_ring != MAP_FAILED)
+    {
+        ::munmap(m_ring, m_ring_size);
+    }
+    if (m_fd != -1)
+    {
+        ::close(m_fd);
+    }
+}
+
+bool IoUring::init(const unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (m_fd == -1)
+    {
+        return false;
+    }
+
+    // the resource tags came with 5.13 together with multishot polls, which have no feature bit of their own
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+    if ((params.features & required) != required)
+    {
+        return false;
+    }
+
+    // both queues are in one mapping
+    m_ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                           params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    m_ring = ::mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_ring == MAP_FAILED || m_sqes == MAP_FAILED)
+    {
+        perror("mmap:io_uring");
+        return false;
+    }
+
+    char* ring = static_cast<char*>(m_ring);
+    m_sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+    m_cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    m_cqes = ring + params.cq_off.cqes;
+
+    // the entries are taken in order, so the i-th slot of the array always points to the i-th entry
+    unsigned* array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; ++i)
+    {
+        array[i] = i;
+    }
+
+    m_enter_fd = m_fd;
+    return true;
+}
+
+void IoUring::register_ring()
+{
+    m_is_registration_tried = true;
+
+    // kernels before 5.18 can't register the ring, then its descriptor is looked up on every enter
+    io_uring_rsrc_update update;
+    std::memset(&update, 0, sizeof(update));
+    update.offset = ~0U;
+    update.data = static_cast<uint64_t>(m_fd);
+    if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_RING_FDS, &update, 1) == 1)
+    {
+        m_enter_fd = static_cast<int>(update.offset);
+        m_enter_flags = IORING_ENTER_REGISTERED_RING;
+    }
+}
+
+IoUring::Sqe* IoUring::get_sqe()
+{
+    if (m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+    {
+        // the queue is full, what is queued goes to the kernel without waiting for anything
+        __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+        if (enter(m_sq_entries, 0, 0, nullptr, 0) == -1
+                || m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+        {
+            perror("io_uring_enter:submit");
+            return nullptr;
+        }
+    }
+
+    auto sqe = static_cast<Sqe*>(m_sqes) + (m_sq_local_tail & m_sq_mask);
+    ++m_sq_local_tail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool IoUring::add_poll(const int fd, const uint32_t events, const uint64_t user_data)
+{
+    auto sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::remove_poll(const uint64_t target)
+{
+    auto sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        return false;
+    }
+
+    // POLL_REMOVE fails with -EALREADY while the poll is completing, a cancellation ends it in any case
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = no_user_data;
+    return true;
+}
+
+bool IoUring::update_poll(const uint64_t target, const uint32_t events, const uint64_t user_data)
+{
+    auto sqe = get_sqe();
+    if (sqe == nullptr)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::submit_and_wait(const int timeout)
+{
+    if (!m_is_registration_tried)
+    {
+        register_ring();
+    }
+
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    const unsigned to_submit = m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    const bool is_ready = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) != *m_cq_head;
+    if (is_ready && to_submit == 0)
+    {
+        return true;
+    }
+
+    int result = 0;
+    if (is_ready)
+    {
+        result = enter(to_submit, 0, 0, nullptr, 0);
+    }
+    else
+    {
+        __kernel_timespec ts;
+        io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        if (timeout >= 0)
+        {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        result = enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    // a signal, the timeout or a full completion queue are no errors, the completions are taken anyway
+    if (result == -1 && errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+    {
+        perror("io_uring_enter");
+        return false;
+    }
+    return true;
+}
+
+std::size_t IoUring::take_completions(Completion* completions, const std::size_t max)
+{
+    unsigned head = *m_cq_head;
+    const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    std::size_t count = 0;
+    for (; head != tail && count < max; ++head)
+    {
+        const auto& cqe = static_cast<const io_uring_cqe*>(m_cqes)[head & m_cq_mask];
+        if (cqe.user_data == no_user_data)
+        {
+            continue;
+        }
+
+        completions[count].user_data = cqe.user_data;
+        completions[count].result = cqe.res;
+        completions[count].has_more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        ++count;
+    }
+
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+int IoUring::enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags, void* arg, const std::size_t arg_size)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, m_enter_fd, to_submit, min_complete, flags | m_enter_flags, arg, arg_size));
+}
@@ -0,0 +1,91 @@
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// A submission and a completion queue shared with the kernel over the raw io_uring system calls,
+// only polls are submitted. The requests are queued in the ring and reach the kernel together
+// with the next wait, so any number of them costs one io_uring_enter.
+class IoUring final
+{
+public:
+    struct Completion
+    {
+        uint64_t user_data;
+
+        // the ready events of a poll or a negative errno
+        int32_t result;
+
+        // the poll goes on, otherwise the kernel has ended it and it has to be added again
+        bool has_more;
+    };
+
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator= (const IoUring&) = delete;
+
+    // false if the kernel has no io_uring, forbids it or is older than 5.13, which brought multishot polls
+    bool init(const unsigned entries);
+
+    // a multishot poll that completes every time the descriptor gets one of the events,
+    // false if the queue is full and can't be submitted
+    bool add_poll(const int fd, const uint32_t events, const uint64_t user_data);
+
+    // the poll added with the target's user data is cancelled, its last completion has -ECANCELED,
+    // the completion of the removal itself isn't taken
+    bool remove_poll(const uint64_t target);
+
+    // the poll added with the target's user data waits for the new events from now on, the update completes
+    // with the given user data and fails with -EALREADY when the poll is completing at the same moment
+    bool update_poll(const uint64_t target, const uint32_t events, const uint64_t user_data);
+
+    // submits the queued requests, then waits for a completion unless one is ready already,
+    // timeout is in milliseconds, -1 waits without limit
+    bool submit_and_wait(const int timeout);
+
+    // moves the ready completions out of the ring, no more than max of them
+    std::size_t take_completions(Completion* completions, const std::size_t max);
+
+private:
+    struct Sqe;
+
+    Sqe* get_sqe();
+
+    // the registration belongs to the thread that makes it, so the ring is registered by the thread that waits on it
+    void register_ring();
+
+    // io_uring_enter that retries nothing, returns -1 with errno on error
+    int enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags, void* arg, const std::size_t arg_size);
+
+private:
+    int m_fd;
+
+    // the index of the registered ring descriptor, enter doesn't have to look it up
+    int m_enter_fd;
+    unsigned m_enter_flags;
+    bool m_is_registration_tried;
+
+    void* m_ring;
+    std::size_t m_ring_size;
+    void* m_sqes;
+    std::size_t m_sqes_size;
+
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+
+    // the tail of the queued requests, the kernel sees it on the next submit
+    unsigned m_sq_local_tail;
+
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    void* m_cqes;
+};
+
+#endif // IO_URING_HPP
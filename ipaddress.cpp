@@ -1,6 +1,9 @@
 #include "ipaddress.hpp"
 #include <algorithm>
 #include <iostream>
+#include <cassert>
+#include <cstring>
+#include <netinet/in.h>
 #include <arpa/inet.h>
 
 namespace
@@ -32,13 +35,91 @@ addrinfo* dns_lookup(const std::string& address, const uint16_t port)
 
 }
 
+IpAddress::IpAddress()
+{
+    assign(nullptr, 0);
+}
+
 IpAddress::IpAddress(const std::string& address, const uint16_t port)
-    : m_address_info(dns_lookup(address, port))
-{}
+    : IpAddress()
+{
+    addrinfo* address_info = dns_lookup(address, port);
+    if (address_info != nullptr)
+    {
+        assign(address_info->ai_addr, address_info->ai_addrlen);
+        freeaddrinfo(address_info);
+    }
+}
+
+IpAddress::IpAddress(const sockaddr* address, const socklen_t length)
+{
+    assign(address, length);
+}
 
-IpAddress::~IpAddress()
+IpAddress::IpAddress(const IpAddress& other)
 {
-    if (m_address_info != nullptr) { freeaddrinfo(m_address_info); }
+    assign(other.m_address_info.ai_addr, other.m_address_info.ai_addrlen);
 }
 
-addrinfo *IpAddress::get_address_info() const { return m_address_info; }
+IpAddress& IpAddress::operator= (const IpAddress& other)
+{
+    if (this != &other)
+    {
+        assign(other.m_address_info.ai_addr, other.m_address_info.ai_addrlen);
+    }
+
+    return *this;
+}
+
+const addrinfo* IpAddress::get_address_info() const
+{
+    return m_address_info.ai_addr == nullptr ? nullptr : &m_address_info;
+}
+
+std::vector<IpAddress> IpAddress::lookup(const std::string& address, const uint16_t port)
+{
+    std::vector<IpAddress> addresses;
+
+    addrinfo* address_info = dns_lookup(address, port);
+    for (auto info = address_info; info != nullptr; info = info->ai_next)
+    {
+        addresses.emplace_back(info->ai_addr, info->ai_addrlen);
+    }
+
+    if (address_info != nullptr) { freeaddrinfo(address_info); }
+    return addresses;
+}
+
+bool IpAddress::from_numeric(const std::string& address, const uint16_t port, IpAddress* ip_address)
+{
+    sockaddr_in in_address;
+    std::memset(&in_address, 0, sizeof(in_address));
+    in_address.sin_family = AF_INET;
+    in_address.sin_port = htons(port);
+
+    if (::inet_pton(AF_INET, address.c_str(), &in_address.sin_addr) != 1)
+    {
+        return false;
+    }
+
+    ip_address->assign(reinterpret_cast<const sockaddr*>(&in_address), sizeof(in_address));
+    return true;
+}
+
+void IpAddress::assign(const sockaddr* address, const socklen_t length)
+{
+    assert(length <= sizeof(m_address));
+
+    std::memset(&m_address_info, 0, sizeof(m_address_info));
+    std::memset(&m_address, 0, sizeof(m_address));
+    if (address == nullptr)
+    {
+        return;
+    }
+
+    std::memcpy(&m_address, address, length);
+    m_address_info.ai_family = address->sa_family;
+    m_address_info.ai_socktype = SOCK_STREAM;
+    m_address_info.ai_addrlen = length;
+    m_address_info.ai_addr = reinterpret_cast<sockaddr*>(&m_address);
+}
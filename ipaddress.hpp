@@ -8,17 +8,38 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 
 class IpAddress final
 {
 public:
+    // invalid address, get_address_info returns nullptr for it
+    IpAddress();
+
+    // resolves the address, blocks the calling thread until the lookup is done
     IpAddress(const std::string& address, const uint16_t port);
-    ~IpAddress();
 
-    addrinfo* get_address_info() const;
+    IpAddress(const sockaddr* address, const socklen_t length);
+
+    IpAddress(const IpAddress& other);
+    IpAddress& operator= (const IpAddress& other);
+
+    const addrinfo* get_address_info() const;
+
+    // all IPv4 addresses of the host, blocks the calling thread
+    static std::vector<IpAddress> lookup(const std::string& address, const uint16_t port);
+
+    // parses a numeric IPv4 address without any lookup
+    static bool from_numeric(const std::string& address, const uint16_t port, IpAddress* ip_address);
+
+private:
+    void assign(const sockaddr* address, const socklen_t length);
 
 private:
-    addrinfo* m_address_info;
+    sockaddr_storage m_address;
+
+    // points to m_address, nullptr ai_addr means that the address is invalid
+    addrinfo m_address_info;
 };
 
 #endif // IPADDRESS_HPP
@@ -1,20 +1,380 @@
 #include "logger.hpp"
-#include <iostream>
-#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+// A ring of bytes with one writer, the thread that logs, and one reader, the background thread.
+// The positions only grow, a record may wrap around the end of the ring.
+class Logger::Ring
+{
+public:
+    static const std::size_t capacity = 256 * 1024;
+
+    Ring()
+        : m_data(new char[capacity])
+        , m_head(0)
+        , m_tail(0)
+        , m_dropped(0)
+    {}
+
+    bool push(const Record& record)
+    {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail + record.size - m_head.load(std::memory_order_acquire) > capacity)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        copy_in(tail, reinterpret_cast<const char*>(&record), record.size);
+        m_tail.store(tail + record.size, std::memory_order_release);
+        return true;
+    }
+
+    // false if the ring is empty
+    bool pop(Record* record)
+    {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        uint32_t size = 0;
+        copy_out(head, reinterpret_cast<char*>(&size), sizeof(size));
+        copy_out(head, reinterpret_cast<char*>(record), size);
+        m_head.store(head + size, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+    uint64_t take_dropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    void copy_in(const uint64_t position, const char* data, const std::size_t size)
+    {
+        const auto offset = position % capacity;
+        const auto first = std::min(size, capacity - offset);
+        std::memcpy(m_data.get() + offset, data, first);
+        std::memcpy(m_data.get(), data + first, size - first);
+    }
+
+    void copy_out(const uint64_t position, char* data, const std::size_t size) const
+    {
+        const auto offset = position % capacity;
+        const auto first = std::min(size, capacity - offset);
+        std::memcpy(data, m_data.get() + offset, first);
+        std::memcpy(data + first, m_data.get(), size - first);
+    }
+
+private:
+    std::unique_ptr<char[]> m_data;
+
+    // the reader and the writer move different positions, so they are kept on different cache lines,
+    // padding does it since new of C++14 doesn't follow alignas
+    char m_head_padding[64];
+    std::atomic<uint64_t> m_head;
+    char m_tail_padding[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint64_t> m_dropped;
+};
+
+const std::size_t Logger::Ring::capacity;
+
+struct Logger::Core
+{
+    Core(const int _fd, const LOG_LEVEL _level)
+        : id(next_id.fetch_add(1) + 1)
+        , level(static_cast<int>(_level))
+        , fd(_fd)
+        , stopped(false)
+        , thread(&Core::run, this)
+    {}
+
+    ~Core()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+
+    Ring* get_ring();
+
+    void run();
+
+    // formats all records that are in the rings, false if there are none
+    bool drain(std::string* batch);
+
+    void format(const Record& record, std::string* batch) const;
+
+    void write_out(const std::string& batch) const;
+
+    static std::atomic<uint64_t> next_id;
+
+    // tells cores apart for the rings cached by threads, an address of a destroyed core may be taken again
+    const uint64_t id;
+
+    std::atomic<int> level;
+    const int fd;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopped;
+
+    // a ring for every thread that has ever logged, they stay until the core is destroyed
+    std::unordered_map<std::thread::id, std::unique_ptr<Ring>> rings;
+
+    std::thread thread;
+};
+
+std::atomic<uint64_t> Logger::Core::next_id(0);
+
+namespace
+{
+
+// how long the background thread sleeps when there is nothing to write
+const auto idle_period = std::chrono::milliseconds(5);
+
+const char* get_level_name(const Logger::LOG_LEVEL level)
+{
+    switch (level)
+    {
+    case Logger::LOG_LEVEL::DEBUG:
+        return "DEBUG";
+    case Logger::LOG_LEVEL::INFO:
+        return "INFO";
+    case Logger::LOG_LEVEL::WARNING:
+        return "WARNING";
+    case Logger::LOG_LEVEL::ERROR:
+        return "ERROR";
+    }
+    return "";
+}
+
+// the ring of the calling thread, kept for the core that has been used last
+thread_local uint64_t cached_core_id = 0;
+thread_local void* cached_ring = nullptr;
+
+}
+
+Logger::Ring* Logger::Core::get_ring()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& ring = rings[std::this_thread::get_id()];
+    if (!ring)
+    {
+        ring.reset(new Ring);
+    }
+    return ring.get();
+}
+
+void Logger::Core::run()
+{
+    std::string batch;
+    while (true)
+    {
+        // the records written before the stop are still drained
+        bool is_stopped = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_stopped = stopped;
+        }
+
+        const bool has_records = drain(&batch);
+        if (!batch.empty())
+        {
+            write_out(batch);
+            batch.clear();
+        }
+
+        if (is_stopped)
+        {
+            break;
+        }
+
+        if (!has_records)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait_for(lock, idle_period, [this]() { return stopped; });
+        }
+    }
+}
+
+bool Logger::Core::drain(std::string* batch)
+{
+    // the rings of new threads are taken next time
+    std::vector<Ring*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& pair : rings)
+        {
+            snapshot.push_back(pair.second.get());
+        }
+    }
+
+    bool has_records = false;
+    Record record;
+    for (auto ring : snapshot)
+    {
+        while (ring->pop(&record))
+        {
+            format(record, batch);
+            has_records = true;
+        }
+
+        const auto dropped = ring->take_dropped();
+        if (dropped != 0)
+        {
+            batch->append("WARNING " + std::to_string(dropped) + " log records are dropped, the ring is full\n");
+        }
+    }
+    return has_records;
+}
+
+void Logger::Core::format(const Record& record, std::string* batch) const
+{
+    const std::time_t seconds = static_cast<std::time_t>(record.time / 1000000000);
+    std::tm time;
+    ::localtime_r(&seconds, &time);
+    char prefix[64];
+    const auto length = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &time);
+    std::snprintf(prefix + length, sizeof(prefix) - length, ".%03d %s ",
+                  static_cast<int>(record.time / 1000000 % 1000), get_level_name(record.level));
+    batch->append(prefix);
+
+    auto argument = record.arguments;
+    const auto end = reinterpret_cast<const char*>(&record) + record.size;
+    for (auto format = record.format; *format != '\0'; ++format)
+    {
+        if (format[0] != '{' || format[1] != '}' || argument >= end)
+        {
+            batch->push_back(*format);
+            continue;
+        }
+
+        ++format;
+        const char tag = *argument++;
+        if (tag == 's')
+        {
+            uint16_t size = 0;
+            std::memcpy(&size, argument, sizeof(size));
+            batch->append(argument + sizeof(size), size);
+            argument += sizeof(size) + size;
+            continue;
+        }
+
+        char value[32];
+        uint64_t bits = 0;
+        std::memcpy(&bits, argument, sizeof(bits));
+        argument += sizeof(bits);
+        if (tag == 'i')
+        {
+            std::snprintf(value, sizeof(value), "%lld", static_cast<long long>(bits));
+        }
+        else if (tag == 'd')
+        {
+            double number = 0;
+            std::memcpy(&number, &bits, sizeof(number));
+            std::snprintf(value, sizeof(value), "%g", number);
+        }
+        else if (tag == 'b')
+        {
+            std::snprintf(value, sizeof(value), "%s", bits != 0 ? "true" : "false");
+        }
+        else
+        {
+            std::snprintf(value, sizeof(value), "%llu", static_cast<unsigned long long>(bits));
+        }
+        batch->append(value);
+    }
+    batch->push_back('\n');
+}
+
+void Logger::Core::write_out(const std::string& batch) const
+{
+    std::size_t written = 0;
+    while (written < batch.size())
+    {
+        auto result = ::write(fd, batch.data() + written, batch.size() - written);
+        if (result == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            return;
+        }
+        written += result;
+    }
+}
 
 Logger::Logger()
-    : out(nullptr)
+    : Logger(STDOUT_FILENO)
 {}
 
-Logger::Logger(std::shared_ptr<std::ostream> &stream)
-    : out(stream)
+Logger::Logger(const int fd, const LOG_LEVEL level)
+    : m_core(std::make_shared<Core>(fd, level))
+    , m_level(&m_core->level)
 {}
 
-std::ostream& Logger::get_stream(LOG_LEVEL) {
-    if (out == nullptr)
+void Logger::set_level(const LOG_LEVEL level) { m_core->level.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+void Logger::flush()
+{
+    while (true)
+    {
+        bool is_empty = true;
+        {
+            std::lock_guard<std::mutex> lock(m_core->mutex);
+            for (auto& pair : m_core->rings)
+            {
+                is_empty = is_empty && pair.second->empty();
+            }
+        }
+
+        if (is_empty)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Logger::append_string(Record& record, const char* value, std::size_t size)
+{
+    const std::size_t header = 1 + sizeof(uint16_t);
+    if (record.size + header > Record::max_size)
+    {
+        return;
+    }
+
+    size = std::min(size, Record::max_size - record.size - header);
+    auto data = reinterpret_cast<char*>(&record) + record.size;
+    const auto length = static_cast<uint16_t>(size);
+    data[0] = 's';
+    std::memcpy(data + 1, &length, sizeof(length));
+    std::memcpy(data + header, value, size);
+    record.size += header + size;
+}
+
+void Logger::push(const Record& record)
+{
+    if (cached_core_id != m_core->id)
     {
-        return std::cout;
+        cached_ring = m_core->get_ring();
+        cached_core_id = m_core->id;
     }
 
-    return *out;
+    static_cast<Ring*>(cached_ring)->push(record);
 }
@@ -1,27 +1,143 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
-#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <type_traits>
 
+// the records below this level are compiled out, 0 keeps all of them, 1 drops DEBUG, 2 drops INFO too and so on
+#ifndef PROXY_LOG_LEVEL
+#define PROXY_LOG_LEVEL 0
+#endif
+
+// the format must be a string literal, every "{}" in it stands for the next argument,
+// the arguments are not evaluated if the level is disabled
+#define LOG_AT(logger, level, format, ...) \
+    do { if ((logger).is_enabled(level)) { (logger).write(level, "" format, ##__VA_ARGS__); } } while (false)
+
+#define LOG_DEBUG(logger, format, ...) LOG_AT(logger, Logger::LOG_LEVEL::DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(logger, format, ...) LOG_AT(logger, Logger::LOG_LEVEL::INFO, format, ##__VA_ARGS__)
+#define LOG_WARNING(logger, format, ...) LOG_AT(logger, Logger::LOG_LEVEL::WARNING, format, ##__VA_ARGS__)
+#define LOG_ERROR(logger, format, ...) LOG_AT(logger, Logger::LOG_LEVEL::ERROR, format, ##__VA_ARGS__)
+
+// A record is written in binary form into a lock-free ring of the calling thread: the time, the level,
+// the pointer to the format and the arguments, only strings are copied. A background thread formats
+// the records and writes them in batches, so a thread never waits for the output. A record that doesn't
+// fit into the ring is dropped and counted. Copies of a logger share its rings and its thread.
 class Logger
 {
 public:
     enum class LOG_LEVEL
     {
-        INFO
+        DEBUG,
+        INFO,
+        WARNING,
+        ERROR
+    };
+
+    // the staging area of a record, only its used part goes to the ring
+    struct Record
+    {
+        static const std::size_t max_size = 1024;
+
+        uint32_t size;
+        LOG_LEVEL level;
+        int64_t time; // nanoseconds since the epoch
+        const char* format;
+
+        // a type tag and the value for every argument
+        char arguments[max_size - 3 * sizeof(uint64_t)];
     };
 
 public:
+    // writes to the standard output from INFO on
     Logger();
+    explicit Logger(const int fd, const LOG_LEVEL level = LOG_LEVEL::INFO);
+
+    void set_level(const LOG_LEVEL level);
+
+    bool is_enabled(const LOG_LEVEL level) const
+    {
+        return static_cast<int>(level) >= PROXY_LOG_LEVEL
+                && static_cast<int>(level) >= m_level->load(std::memory_order_relaxed);
+    }
+
+    template <typename... Args>
+    void write(const LOG_LEVEL level, const char* format, const Args&... args)
+    {
+        Record record;
+        record.size = offsetof(Record, arguments);
+        record.level = level;
+        record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        record.format = format;
+        append(record, args...);
+        push(record);
+    }
+
+    // waits until the records written so far are out
+    void flush();
 
-    Logger(std::shared_ptr<std::ostream>& stream);
+private:
+    struct Core;
+    class Ring;
+
+private:
+    static void append(Record&) {}
+
+    template <typename T, typename... Args>
+    static void append(Record& record, const T& value, const Args&... args)
+    {
+        append_value(record, value);
+        append(record, args...);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    append_value(Record& record, const T value)
+    {
+        append_number(record, 'i', static_cast<int64_t>(value));
+    }
 
-    std::ostream& get_stream(LOG_LEVEL);
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+    append_value(Record& record, const T value)
+    {
+        append_number(record, 'u', static_cast<uint64_t>(value));
+    }
+
+    static void append_value(Record& record, const bool value) { append_number(record, 'b', static_cast<uint64_t>(value)); }
+    static void append_value(Record& record, const double value) { append_number(record, 'd', value); }
+    static void append_value(Record& record, const char* value) { append_string(record, value, std::strlen(value)); }
+    static void append_value(Record& record, const std::string& value) { append_string(record, value.data(), value.size()); }
+
+    template <typename T>
+    static void append_number(Record& record, const char tag, const T value)
+    {
+        auto data = reinterpret_cast<char*>(&record) + record.size;
+        if (record.size + 1 + sizeof(value) <= Record::max_size)
+        {
+            data[0] = tag;
+            std::memcpy(data + 1, &value, sizeof(value));
+            record.size += 1 + sizeof(value);
+        }
+    }
+
+    // a string is cut to the room left in the record
+    static void append_string(Record& record, const char* value, std::size_t size);
+
+    void push(const Record& record);
 
 private:
-    std::shared_ptr<std::ostream> out;
+    std::shared_ptr<Core> m_core;
+
+    // of the core, read on every record
+    const std::atomic<int>* m_level;
 };
 
 #endif // LOGGER_HPP
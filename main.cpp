@@ -1,11 +1,281 @@
-#include "proxy.hpp"
+#include "proxygroup.hpp"
+#include "metricsserver.hpp"
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
 
-int main()
+namespace
 {
+
+// a decimal number that fits the value, e.g. a port above 65535 is refused instead of being cut
+template <typename T>
+bool parse_number(const char* text, T* value)
+{
+    if (!std::isdigit(static_cast<unsigned char>(text[0])))
+    {
+        return false;
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    const auto number = std::strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || number > std::numeric_limits<T>::max())
+    {
+        return false;
+    }
+
+    *value = static_cast<T>(number);
+    return true;
+}
+
+void usage(const char* name)
+{
+    std::cerr << "usage: " << name << " [-p port] [-t threads] [-a] [-r seconds] [-s] [-H hosts] [-D entries] [-k connections] [-C megabytes] [-d directory] [-S megabytes] [-N] [-T seconds] [-U seconds] [-b kilobytes] [-m port] [-e backend] [-v]\n"
+              << "  -p  port to listen on (7777 by default)\n"
+              << "  -t  number of worker threads (number of cpus by default)\n"
+              << "  -a  pin worker threads to cpus\n"
+              << "  -r  print aggregated counters every given number of seconds\n"
+              << "  -s  relay response bodies with splice(2) instead of copying them\n"
+              << "  -H  resolve names only from the given file in /etc/hosts format, without DNS\n"
+              << "  -D  number of names in the DNS cache, 0 disables the cache (1024 by default)\n"
+              << "  -k  idle keep-alive connections kept for every server, 0 disables reusing (8 by default)\n"
+              << "  -C  size of the response cache in megabytes, 0 disables the cache (64 by default)\n"
+              << "  -d  directory of the persistent response cache, the cache is disabled without it\n"
+              << "  -S  size of the persistent response cache in megabytes (1024 by default)\n"
+              << "  -N  sends every request to the server, concurrent requests for the same URL aren't collapsed\n"
+              << "  -T  seconds a client may take to send a request or to read a part of the response,\n"
+              << "      a keep-alive connection is closed after being idle as long (30 by default)\n"
+              << "  -U  seconds a server may take to accept a connection, to start the response\n"
+              << "      or to send the next part of it, 504 Gateway Timeout is sent if nothing has come (30 by default)\n"
+              << "  -b  kilobytes of a response a connection holds for its client, the server isn't read\n"
+              << "      while the client is behind (64 by default)\n"
+              << "  -m  port to serve the metrics on in the Prometheus text format, disabled by default\n"
+              << "  -e  how the events of the sockets are waited for: epoll or io_uring_poll, multishot polls in io_uring,\n"
+              << "      which needs Linux 5.13, epoll is used if io_uring isn't available (epoll by default)\n"
+              << "  -v  log every event of every connection, only the clients and the errors are logged by default\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    uint16_t port = 7777;
+    std::size_t threads = ProxyGroup::default_threads_count();
+    bool pin_threads = false;
+    unsigned long report_interval = 0;
+    bool use_splice = false;
+    std::string hosts_file;
+    std::size_t dns_cache_entries = 1024;
+    std::size_t max_idle_servers = 8;
+    std::size_t response_cache_megabytes = 64;
+    std::string disk_cache_directory;
+    uint64_t disk_cache_megabytes = 1024;
+    bool collapse_requests = true;
+    unsigned long client_timeout = 30;
+    unsigned long server_timeout = 30;
+    std::size_t buffered_kilobytes = 64;
+    uint16_t metrics_port = 0;
+    auto event_backend = Selector::Backend::EPOLL;
+    bool verbose = false;
+
+    int option = 0;
+    while ((option = ::getopt(argc, argv, "p:t:ar:sH:D:k:C:d:S:NT:U:b:m:e:vh")) != -1)
+    {
+        bool is_valid = true;
+        switch (option)
+        {
+        case 'p':
+            is_valid = parse_number(optarg, &port);
+            break;
+        case 't':
+            is_valid = parse_number(optarg, &threads);
+            break;
+        case 'a':
+            pin_threads = true;
+            break;
+        case 'r':
+            is_valid = parse_number(optarg, &report_interval);
+            break;
+        case 's':
+            use_splice = true;
+            break;
+        case 'H':
+            hosts_file = optarg;
+            break;
+        case 'D':
+            is_valid = parse_number(optarg, &dns_cache_entries);
+            break;
+        case 'k':
+            is_valid = parse_number(optarg, &max_idle_servers);
+            break;
+        case 'C':
+            is_valid = parse_number(optarg, &response_cache_megabytes);
+            break;
+        case 'd':
+            disk_cache_directory = optarg;
+            break;
+        case 'S':
+            is_valid = parse_number(optarg, &disk_cache_megabytes);
+            break;
+        case 'N':
+            collapse_requests = false;
+            break;
+        case 'T':
+            is_valid = parse_number(optarg, &client_timeout);
+            break;
+        case 'U':
+            is_valid = parse_number(optarg, &server_timeout);
+            break;
+        case 'b':
+            is_valid = parse_number(optarg, &buffered_kilobytes);
+            break;
+        case 'm':
+            is_valid = parse_number(optarg, &metrics_port);
+            break;
+        case 'e':
+            if (std::string(optarg) == "io_uring_poll")
+            {
+                event_backend = Selector::Backend::IO_URING_POLL;
+            }
+            else
+            {
+                is_valid = std::string(optarg) == "epoll";
+            }
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (!is_valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (threads == 0 || disk_cache_megabytes == 0 || client_timeout == 0 || server_timeout == 0 || buffered_kilobytes == 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // a client that goes away while its response is being sent must not kill the proxy
+    std::signal(SIGPIPE, SIG_IGN);
+
     Logger l;
-    Proxy proxy(7777, l);
-    proxy.start();
+    if (verbose)
+    {
+        l.set_level(Logger::LOG_LEVEL::DEBUG);
+    }
+    ProxyGroup proxies(port, threads, l);
+    proxies.set_cpu_pinning(pin_threads);
+    proxies.set_splice(use_splice);
+    if (proxies.set_event_backend(event_backend) != event_backend)
+    {
+        LOG_INFO(l, "io_uring isn't available, epoll is used");
+    }
+    proxies.set_max_idle_servers(max_idle_servers);
+    proxies.set_request_collapsing(collapse_requests);
+
+    Proxy::Timeouts timeouts;
+    timeouts.client = std::chrono::seconds(client_timeout);
+    timeouts.server = std::chrono::seconds(server_timeout);
+    proxies.set_timeouts(timeouts);
+    proxies.set_max_buffered_bytes(buffered_kilobytes * 1024);
+
+    if (dns_cache_entries != 0)
+    {
+        proxies.set_dns_cache(dns_cache_entries);
+    }
+    if (response_cache_megabytes != 0)
+    {
+        proxies.set_response_cache(response_cache_megabytes * 1024 * 1024);
+    }
+    if (!disk_cache_directory.empty() && !proxies.set_disk_cache(disk_cache_directory, disk_cache_megabytes * 1024 * 1024))
+    {
+        std::cerr << "can't use the cache directory " << disk_cache_directory << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!hosts_file.empty() && !proxies.set_hosts_file(hosts_file))
+    {
+        return EXIT_FAILURE;
+    }
+
+    MetricsServer metrics(metrics_port, proxies, l);
+    if (metrics_port != 0 && !metrics.start())
+    {
+        std::cerr << "can't serve the metrics on " << metrics_port << " port" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    proxies.start();
+
+    while (report_interval != 0)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(report_interval));
+
+        auto counters = proxies.get_counters();
+        auto dns_counters = proxies.get_dns_counters();
+        auto cache_counters = proxies.get_cache_counters();
+        const auto cache_lookups = cache_counters.hits + cache_counters.misses;
+        auto disk_counters = proxies.get_disk_counters();
+        LOG_INFO(l, "STATS threads : {} accepted : {} active : {} received bytes : {} sent bytes : {} "
+                 "collapsed : {} timed out : {} buffer chunks allocated : {} reused : {} used : {} "
+                 "idle : {} server connections reused : {} missed : {} expired : {} broken : {} dns hits : {} dns negative hits : {} dns misses : {} dns refreshes : {} "
+                 "dns evictions : {} dns entries : {} cache hits : {} cache misses : {} "
+                 "cache hit ratio : {} cache bytes saved : {} cache stores : {} cache evictions : {} "
+                 "cache entries : {} cache bytes : {} disk hits : {} disk misses : {} disk bytes saved : {} "
+                 "disk stores : {} disk evicted segments : {} disk entries : {} disk bytes : {}",
+                 proxies.size(),
+                 counters.accepted_connections,
+                 counters.active_connections,
+                 counters.received_bytes,
+                 counters.sent_bytes,
+                 counters.collapsed_requests,
+                 counters.timed_out_connections,
+                 counters.buffers.allocated_chunks,
+                 counters.buffers.reused_chunks,
+                 counters.buffers.used_chunks,
+                 counters.buffers.idle_chunks,
+                 counters.servers.reused,
+                 counters.servers.missed,
+                 counters.servers.expired,
+                 counters.servers.broken,
+                 dns_counters.hits,
+                 dns_counters.negative_hits,
+                 dns_counters.misses,
+                 dns_counters.refreshes,
+                 dns_counters.evictions,
+                 dns_counters.entries,
+                 cache_counters.hits,
+                 cache_counters.misses,
+                 (cache_lookups == 0 ? 0.0 : static_cast<double>(cache_counters.hits) / cache_lookups),
+                 cache_counters.bytes_saved,
+                 cache_counters.stores,
+                 cache_counters.evictions,
+                 cache_counters.entries,
+                 cache_counters.bytes,
+                 disk_counters.hits,
+                 disk_counters.misses,
+                 disk_counters.bytes_saved,
+                 disk_counters.stores,
+                 disk_counters.evicted_segments,
+                 disk_counters.entries,
+                 disk_counters.bytes);
+    }
+
+    proxies.join();
 
     return 0;
 }
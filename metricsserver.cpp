@@ -0,0 +1,270 @@
+#include "metricsserver.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstdio>
+#include <utility>
+
+namespace
+{
+
+void write_help(std::string* out, const char* name, const char* type, const char* help)
+{
+    out->append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out->append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void write_value(std::string* out, const char* name, const uint64_t value)
+{
+    out->append(name).append(" ").append(std::to_string(value)).append("\n");
+}
+
+void write_metric(std::string* out, const char* name, const char* type, const char* help, const uint64_t value)
+{
+    write_help(out, name, type, help);
+    write_value(out, name, value);
+}
+
+// the durations are counted in microseconds, Prometheus expects seconds
+std::string to_seconds(const uint64_t microseconds)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6f", microseconds / 1e6);
+    return text;
+}
+
+void write_histogram(std::string* out, const char* name, const char* phase, const LatencyHistogram::Snapshot& histogram)
+{
+    const std::string labels = std::string("{phase=\"") + phase + "\"";
+
+    // the buckets of the exposition are cumulative
+    uint64_t count = 0;
+    for (std::size_t i = 0; i < LatencyHistogram::buckets_count; ++i)
+    {
+        count += histogram.buckets[i];
+        const bool is_last = i + 1 == LatencyHistogram::buckets_count;
+        const std::string bound = is_last ? "+Inf" : to_seconds(LatencyHistogram::get_upper_bound(i));
+        out->append(name).append("_bucket").append(labels).append(",le=\"").append(bound).append("\"} ")
+                .append(std::to_string(count)).append("\n");
+    }
+
+    out->append(name).append("_sum").append(labels).append("} ").append(to_seconds(histogram.sum_microseconds)).append("\n");
+    out->append(name).append("_count").append(labels).append("} ").append(std::to_string(histogram.count)).append("\n");
+}
+
+}
+
+const std::chrono::seconds MetricsServer::m_client_timeout(10);
+
+MetricsServer::MetricsServer(const uint16_t port, const ProxyGroup& proxies, const Logger& log)
+    : m_port(port)
+    , m_proxies(proxies)
+    , m_stop_fd(-1)
+    , m_running(false)
+    , m_selector(log)
+    , m_incoming_handler(this, &MetricsServer::handle_incoming_connection)
+    , m_stop_handler(this, &MetricsServer::handle_stop)
+    , m_clients(m_clients_per_slab)
+{}
+
+MetricsServer::~MetricsServer()
+{
+    if (m_thread.joinable())
+    {
+        const uint64_t one = 1;
+        if (::write(m_stop_fd, &one, sizeof(one)) == sizeof(one))
+        {
+            m_thread.join();
+        }
+        else
+        {
+            m_thread.detach();
+        }
+    }
+
+    if (m_stop_fd != -1)
+    {
+        ::close(m_stop_fd);
+    }
+}
+
+bool MetricsServer::start()
+{
+    if (m_server_socket.listen(m_port) != TcpSocket::Status::DONE)
+    {
+        return false;
+    }
+
+    m_stop_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_stop_fd == -1)
+    {
+        perror("eventfd");
+        return false;
+    }
+
+    m_selector.add(m_server_socket, EPOLLIN, &m_incoming_handler);
+    m_selector.add(m_stop_fd, EPOLLIN, &m_stop_handler);
+
+    m_running = true;
+    m_thread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::run()
+{
+    while (m_running && m_selector.do_iteration());
+}
+
+void MetricsServer::handle_incoming_connection(const uint32_t)
+{
+    while (true)
+    {
+        TcpSocket socket(-1);
+        if (m_server_socket.accept(&socket) != TcpSocket::Status::DONE)
+        {
+            break;
+        }
+
+        Client* client = m_clients.create(this, std::move(socket));
+        client->timer.handler = [this, client]() { close_client(client); };
+        m_selector.get_timers().arm(&client->timer, m_client_timeout);
+        m_selector.add(client->socket, EPOLLIN, client);
+    }
+}
+
+void MetricsServer::handle_stop(const uint32_t) { m_running = false; }
+
+void MetricsServer::Client::handle_event(const uint32_t events) { server->handle_client(this, events); }
+
+void MetricsServer::handle_client(Client* client, const uint32_t events)
+{
+    const bool is_receiving = client->output.empty();
+    if ((events & (EPOLLERR | EPOLLHUP)) || !(is_receiving ? receive_request(client) : send_response(client)))
+    {
+        close_client(client);
+    }
+}
+
+bool MetricsServer::receive_request(Client* client)
+{
+    char buffer[1024];
+    std::size_t received = 0;
+    auto status = TcpSocket::Status::DONE;
+    while ((status = client->socket.receive(buffer, sizeof(buffer), &received)) == TcpSocket::Status::DONE)
+    {
+        if (received == 0 || client->input.size() + received > m_max_request_length)
+        {
+            return false;
+        }
+
+        client->input.append(buffer, received);
+        if (client->input.find("\r\n\r\n") == std::string::npos)
+        {
+            continue;
+        }
+
+        // the metrics are taken when they are asked for, so they are as fresh as they can be
+        const std::string body = make_metrics(m_proxies);
+        client->output = "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "Connection: close\r\n"
+                         "\r\n" + body;
+        m_selector.change_mode(client->socket, EPOLLOUT);
+        return send_response(client);
+    }
+
+    return status == TcpSocket::Status::NOT_READY;
+}
+
+bool MetricsServer::send_response(Client* client)
+{
+    std::size_t sent = 0;
+    auto status = TcpSocket::Status::DONE;
+    while (client->sent < client->output.size()
+           && (status = client->socket.send(client->output.data() + client->sent, client->output.size() - client->sent, &sent))
+              == TcpSocket::Status::DONE)
+    {
+        client->sent += sent;
+    }
+
+    // the client is kept only while the rest of the response waits for room in the socket
+    return status == TcpSocket::Status::NOT_READY;
+}
+
+void MetricsServer::close_client(Client* client)
+{
+    m_selector.remove(client->socket);
+    m_clients.destroy(client);
+}
+
+std::string MetricsServer::make_metrics(const ProxyGroup& proxies)
+{
+    const auto counters = proxies.get_counters();
+    const auto dns_counters = proxies.get_dns_counters();
+    const auto cache_counters = proxies.get_cache_counters();
+    const auto disk_counters = proxies.get_disk_counters();
+
+    std::string out;
+    write_metric(&out, "proxy_threads", "gauge", "Worker threads.", proxies.size());
+    write_metric(&out, "proxy_accepted_connections_total", "counter", "Client connections accepted.",
+                 counters.accepted_connections);
+    write_metric(&out, "proxy_active_connections", "gauge", "Client connections open.", counters.active_connections);
+
+    write_help(&out, "proxy_connections", "gauge", "Client connections open by the state of their request.");
+    for (std::size_t i = 0; i < Proxy::states_count; ++i)
+    {
+        out.append("proxy_connections{state=\"").append(Proxy::get_state_name(static_cast<Proxy::ConnectionState>(i)))
+                .append("\"} ").append(std::to_string(counters.connections_by_state[i])).append("\n");
+    }
+
+    write_metric(&out, "proxy_received_bytes_total", "counter", "Bytes received from clients and servers.",
+                 counters.received_bytes);
+    write_metric(&out, "proxy_sent_bytes_total", "counter", "Bytes sent to clients and servers.", counters.sent_bytes);
+    write_metric(&out, "proxy_collapsed_requests_total", "counter", "Requests served with the response to another request.",
+                 counters.collapsed_requests);
+    write_metric(&out, "proxy_timed_out_connections_total", "counter", "Connections that have run out of time.",
+                 counters.timed_out_connections);
+
+    write_help(&out, "proxy_error_responses_total", "counter", "Error responses of the proxy itself by status.");
+    for (std::size_t i = 0; i < Proxy::error_statuses_count; ++i)
+    {
+        if (counters.error_responses[i] != 0)
+        {
+            out.append("proxy_error_responses_total{status=\"").append(std::to_string(Proxy::first_error_status + i))
+                    .append("\"} ").append(std::to_string(counters.error_responses[i])).append("\n");
+        }
+    }
+
+    write_help(&out, "proxy_phase_duration_seconds", "histogram", "Durations of the phases of requests.");
+    for (std::size_t i = 0; i < Proxy::phases_count; ++i)
+    {
+        write_histogram(&out, "proxy_phase_duration_seconds", Proxy::get_phase_name(static_cast<Proxy::Phase>(i)),
+                        counters.latencies[i]);
+    }
+
+    write_metric(&out, "proxy_buffer_chunks_allocated_total", "counter", "Buffer chunks taken from malloc.",
+                 counters.buffers.allocated_chunks);
+    write_metric(&out, "proxy_buffer_chunks_reused_total", "counter", "Buffer chunks taken from the free lists.",
+                 counters.buffers.reused_chunks);
+    write_metric(&out, "proxy_buffer_chunks_used", "gauge", "Buffer chunks held by connections.", counters.buffers.used_chunks);
+    write_metric(&out, "proxy_buffer_chunks_idle", "gauge", "Buffer chunks on the free lists.", counters.buffers.idle_chunks);
+
+    write_metric(&out, "proxy_server_connections_reused_total", "counter", "Idle server connections used again.",
+                 counters.servers.reused);
+    write_metric(&out, "proxy_server_connections_missed_total", "counter", "Requests that found no idle server connection.",
+                 counters.servers.missed);
+    write_metric(&out, "proxy_server_connections_expired_total", "counter", "Idle server connections closed after the timeout.",
+                 counters.servers.expired);
+    write_metric(&out, "proxy_server_connections_broken_total", "counter",
+                 "Idle server connections closed by the server or found dead.", counters.servers.broken);
+
+    write_metric(&out, "proxy_dns_cache_hits_total", "counter", "Names found in the DNS cache.", dns_counters.hits);
+    write_metric(&out, "proxy_dns_cache_misses_total", "counter", "Names looked up by the resolver.", dns_counters.misses);
+    write_metric(&out, "proxy_cache_hits_total", "counter", "Responses served from the memory cache.", cache_counters.hits);
+    write_metric(&out, "proxy_cache_misses_total", "counter", "Responses not found in the memory cache.", cache_counters.misses);
+    write_metric(&out, "proxy_cache_bytes", "gauge", "Bytes held by the memory cache.", cache_counters.bytes);
+    write_metric(&out, "proxy_disk_cache_hits_total", "counter", "Responses served from the disk cache.", disk_counters.hits);
+    write_metric(&out, "proxy_disk_cache_misses_total", "counter", "Responses not found in the disk cache.", disk_counters.misses);
+    write_metric(&out, "proxy_disk_cache_bytes", "gauge", "Bytes held by the disk cache.", disk_counters.bytes);
+    return out;
+}
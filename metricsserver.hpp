@@ -0,0 +1,96 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "proxygroup.hpp"
+#include "selector.hpp"
+#include "slabpool.hpp"
+#include "tcpsocket.hpp"
+#include "timerwheel.hpp"
+
+// Serves the counters and the latency histograms of the proxies on its own port in the Prometheus text format.
+// It runs in its own thread with its own selector and only reads the counters, so the workers never wait for it.
+// Every request gets the metrics, whatever its path, and the connection is closed after the response.
+class MetricsServer final
+{
+public:
+    MetricsServer(const uint16_t port, const ProxyGroup& proxies, const Logger& log);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator= (const MetricsServer&) = delete;
+
+    // false if the port can't be listened on
+    bool start();
+
+    // the text the server answers with
+    static std::string make_metrics(const ProxyGroup& proxies);
+
+private:
+    struct Client final : public Selector::Handler
+    {
+        Client(MetricsServer* _server, TcpSocket&& _socket)
+            : server(_server)
+            , socket(std::move(_socket))
+            , sent(0)
+        {}
+
+        void handle_event(const uint32_t events) override;
+
+        MetricsServer* server;
+        TcpSocket socket;
+        std::string input;
+        std::string output;
+        std::size_t sent;
+        TimerWheel::Timer timer;
+    };
+
+private:
+    void run();
+
+    void handle_incoming_connection(const uint32_t events);
+    void handle_stop(const uint32_t events);
+    void handle_client(Client* client, const uint32_t events);
+
+    // false if the client is done with or has failed
+    bool receive_request(Client* client);
+    bool send_response(Client* client);
+
+    void close_client(Client* client);
+
+private:
+    uint16_t m_port;
+
+    const ProxyGroup& m_proxies;
+
+    TcpSocket m_server_socket;
+
+    // tells the thread to stop
+    int m_stop_fd;
+
+    std::atomic_bool m_running;
+
+    Selector m_selector;
+
+    Selector::MemberHandler<MetricsServer> m_incoming_handler;
+    Selector::MemberHandler<MetricsServer> m_stop_handler;
+
+    static const std::size_t m_clients_per_slab = 16;
+
+    SlabPool<Client> m_clients;
+
+    static const std::size_t m_max_request_length = 8192;
+
+    // a client that doesn't send its request or doesn't take the response is closed
+    static const std::chrono::seconds m_client_timeout;
+
+    std::thread m_thread;
+};
+
+#endif // METRICS_SERVER_HPP
@@ -0,0 +1,75 @@
+#include "pipepool.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+
+PipePool::PipePool(const std::size_t max_idle_pipes, const std::size_t pipe_capacity)
+    : m_max_idle_pipes(max_idle_pipes)
+    , m_pipe_capacity(pipe_capacity)
+{}
+
+PipePool::~PipePool()
+{
+    for (auto& pipe : m_idle_pipes)
+    {
+        close(&pipe);
+    }
+}
+
+bool PipePool::acquire(Pipe* pipe)
+{
+    if (!m_idle_pipes.empty())
+    {
+        *pipe = m_idle_pipes.back();
+        m_idle_pipes.pop_back();
+        return true;
+    }
+
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        return false;
+    }
+
+    pipe->read_fd = fds[0];
+    pipe->write_fd = fds[1];
+    pipe->size = 0;
+
+    // the kernel may refuse the capacity, then the default one is used
+    int capacity = ::fcntl(pipe->write_fd, F_SETPIPE_SZ, static_cast<int>(m_pipe_capacity));
+    if (capacity != -1)
+    {
+        m_pipe_capacity = capacity;
+    }
+
+    return true;
+}
+
+void PipePool::release(Pipe* pipe)
+{
+    if (!*pipe)
+    {
+        return;
+    }
+
+    // a pipe with data in it can't be given to another connection
+    if (pipe->size == 0 && m_idle_pipes.size() < m_max_idle_pipes)
+    {
+        m_idle_pipes.push_back(*pipe);
+    }
+    else
+    {
+        close(pipe);
+    }
+
+    *pipe = Pipe();
+}
+
+std::size_t PipePool::get_pipe_capacity() const { return m_pipe_capacity; }
+
+void PipePool::close(Pipe* pipe)
+{
+    ::close(pipe->read_fd);
+    ::close(pipe->write_fd);
+}
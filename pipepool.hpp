@@ -0,0 +1,51 @@
+#ifndef PIPE_POOL_HPP
+#define PIPE_POOL_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Pipes for moving data between sockets with splice(2),
+// empty pipes are kept for the next connections instead of being closed
+class PipePool final
+{
+public:
+    struct Pipe
+    {
+        Pipe()
+            : read_fd(-1)
+            , write_fd(-1)
+            , size(0)
+        {}
+
+        operator bool() const { return read_fd != -1; }
+
+        int read_fd;
+        int write_fd;
+
+        // bytes that were spliced into the pipe and not spliced out yet
+        std::size_t size;
+    };
+
+public:
+    PipePool(const std::size_t max_idle_pipes, const std::size_t pipe_capacity);
+    ~PipePool();
+
+    PipePool(const PipePool&) = delete;
+    PipePool& operator= (const PipePool&) = delete;
+
+    bool acquire(Pipe* pipe);
+    void release(Pipe* pipe);
+
+    std::size_t get_pipe_capacity() const;
+
+private:
+    static void close(Pipe* pipe);
+
+private:
+    std::size_t m_max_idle_pipes;
+    std::size_t m_pipe_capacity;
+
+    std::vector<Pipe> m_idle_pipes;
+};
+
+#endif // PIPE_POOL_HPP
@@ -1,14 +1,17 @@
 #include "proxy.hpp"
+#include "counter.hpp"
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <utility>
-#include <iostream>
 #include <cassert>
 #include <cstddef>
 #include <string>
 #include <unistd.h>
 #include <functional>
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
 
 namespace
 {
@@ -18,70 +21,387 @@ bool is_die_events(const uint32_t events)
     return (events & EPOLLERR) || (events & EPOLLHUP) || (events & EPOLLRDHUP);
 }
 
+std::size_t get_index(const Proxy::ConnectionState state) { return static_cast<std::size_t>(state); }
+
 }
 
+const std::chrono::seconds Proxy::m_pool_check_period(1);
+
 Proxy::Proxy(const uint16_t port, const Logger& log)
     : m_port(port)
+    , m_reuse_port(false)
+    , m_use_splice(false)
+    , m_collapse_requests(true)
+    , m_max_buffered_bytes(64 * 1024)
     , m_running(false)
+    , m_buffers(m_max_idle_chunks)
+    , m_connections(m_connections_per_slab)
+    , m_selector(log)
+    , m_incoming_handler(this, &Proxy::handle_incoming_connection)
+    , m_resolved_handler(this, &Proxy::handle_resolved_addresses)
+    , m_server_pool(m_selector, m_default_max_idle_servers, std::chrono::seconds(15))
+    , m_pipes(m_max_idle_pipes, m_pipe_capacity)
     , m_logger(log)
+    , m_resolver(m_resolver_threads)
 {
     m_transitions =
     {
         {ConnectionState::RECEIVING_REQUEST,       &Proxy::handle_receiving_request},
+        {ConnectionState::RESOLVING_ADDRESS,       &Proxy::handle_resolving_address},
         {ConnectionState::CONNECTING_TO_SERVER,    &Proxy::handle_connecting_to_server},
         {ConnectionState::SENDING_REQUEST,         &Proxy::handle_sending_request},
         {ConnectionState::RECEIVING_RESPONSE,      &Proxy::handle_receiving_response},
         {ConnectionState::SENDING_RESPONSE,        &Proxy::handle_sending_response},
-        {ConnectionState::SENDING_ERROR,           &Proxy::handle_sending_error}
+        {ConnectionState::SENDING_ERROR,           &Proxy::handle_sending_error},
+        {ConnectionState::SHARING_RESPONSE,        &Proxy::handle_sharing_response}
     };
+
+    m_pool_timer.handler = std::bind(&Proxy::handle_pool_timer, this);
 }
 
 void Proxy::start()
 {
+    if (m_reuse_port && m_server_socket.setReusePort() != TcpSocket::Status::DONE)
+    {
+        LOG_ERROR(m_logger, "error on reuse port");
+        return;
+    }
+
     auto code = m_server_socket.listen(m_port);
     if (code != TcpSocket::Status::DONE)
     {
-        std::cerr << "error on listen\n";
+        LOG_ERROR(m_logger, "error on listen");
         return;
     }
 
-    std::cout << "proxy starts at " << m_port << " port" << std::endl;
+    LOG_INFO(m_logger, "proxy starts at {} port", m_port);
 
-    auto incoming_handler = std::bind(&Proxy::handle_incoming_connection, this, std::placeholders::_1);
-    m_selector.add(m_server_socket, EPOLLIN, incoming_handler);
+    m_selector.add(m_server_socket, EPOLLIN, &m_incoming_handler);
+    m_selector.add(m_resolver.get_fd(), EPOLLIN, &m_resolved_handler);
+
+    m_selector.get_timers().arm(&m_pool_timer, m_pool_check_period);
 
     m_running = true;
-    while (m_running && m_selector.do_iteration());
+    while (m_running)
+    {
+        LOG_DEBUG(m_logger, "epoll wait {}", m_selector.size());
+        if (!m_selector.do_iteration())
+        {
+            break;
+        }
+    }
 }
 
 void Proxy::set_port(const uint16_t port) { m_port = port; }
 
+void Proxy::set_reuse_port(const bool reuse_port) { m_reuse_port = reuse_port; }
+
+void Proxy::set_splice(const bool use_splice) { m_use_splice = use_splice; }
+
+Selector::Backend Proxy::set_event_backend(const Selector::Backend backend) { return m_selector.set_backend(backend); }
+
+bool Proxy::set_hosts_file(const std::string& path) { return m_resolver.load_hosts_file(path); }
+
+void Proxy::set_dns_cache(const std::shared_ptr<DnsCache>& dns_cache) { m_dns_cache = dns_cache; }
+
+void Proxy::set_response_cache(const std::shared_ptr<ResponseCache>& response_cache) { m_response_cache = response_cache; }
+
+void Proxy::set_disk_cache(const std::shared_ptr<DiskCache>& disk_cache) { m_disk_cache = disk_cache; }
+
+void Proxy::set_max_idle_servers(const std::size_t max_idle_servers) { m_server_pool.set_max_idle_per_host(max_idle_servers); }
+
+void Proxy::set_request_collapsing(const bool collapse_requests) { m_collapse_requests = collapse_requests; }
+
+void Proxy::set_timeouts(const Timeouts& timeouts) { m_timeouts = timeouts; }
+
+void Proxy::set_max_buffered_bytes(const std::size_t max_buffered_bytes) { m_max_buffered_bytes = max_buffered_bytes; }
+
+Proxy::Counters Proxy::get_counters() const
+{
+    // closed connections are read first, so they never exceed the accepted ones
+    const auto closed_connections = m_statistics.closed_connections.load(std::memory_order_relaxed);
+
+    Counters counters;
+    counters.accepted_connections = m_statistics.accepted_connections.load(std::memory_order_relaxed);
+    counters.active_connections = counters.accepted_connections - closed_connections;
+    counters.received_bytes = m_statistics.received_bytes.load(std::memory_order_relaxed);
+    counters.sent_bytes = m_statistics.sent_bytes.load(std::memory_order_relaxed);
+    counters.collapsed_requests = m_statistics.collapsed_requests.load(std::memory_order_relaxed);
+    counters.timed_out_connections = m_statistics.timed_out_connections.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < states_count; ++i)
+    {
+        counters.connections_by_state[i] = m_statistics.connections_by_state[i].load(std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < error_statuses_count; ++i)
+    {
+        counters.error_responses[i] = m_statistics.error_responses[i].load(std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < phases_count; ++i)
+    {
+        counters.latencies[i] = m_statistics.latencies[i].get_snapshot();
+    }
+    counters.buffers = m_buffers.get_counters();
+    counters.servers = m_server_pool.get_counters();
+    return counters;
+}
+
+Proxy::Counters& Proxy::Counters::operator+= (const Counters& other)
+{
+    accepted_connections += other.accepted_connections;
+    active_connections += other.active_connections;
+    received_bytes += other.received_bytes;
+    sent_bytes += other.sent_bytes;
+    collapsed_requests += other.collapsed_requests;
+    timed_out_connections += other.timed_out_connections;
+    for (std::size_t i = 0; i < states_count; ++i)
+    {
+        connections_by_state[i] += other.connections_by_state[i];
+    }
+    for (std::size_t i = 0; i < error_statuses_count; ++i)
+    {
+        error_responses[i] += other.error_responses[i];
+    }
+    for (std::size_t i = 0; i < phases_count; ++i)
+    {
+        latencies[i] += other.latencies[i];
+    }
+    buffers += other.buffers;
+    servers += other.servers;
+    return *this;
+}
+
+const char* Proxy::get_state_name(const ConnectionState state)
+{
+    switch (state)
+    {
+    case ConnectionState::RECEIVING_REQUEST:
+        return "receiving_request";
+    case ConnectionState::RESOLVING_ADDRESS:
+        return "resolving_address";
+    case ConnectionState::CONNECTING_TO_SERVER:
+        return "connecting_to_server";
+    case ConnectionState::SENDING_REQUEST:
+        return "sending_request";
+    case ConnectionState::RECEIVING_RESPONSE:
+        return "receiving_response";
+    case ConnectionState::SENDING_RESPONSE:
+        return "sending_response";
+    case ConnectionState::SENDING_ERROR:
+        return "sending_error";
+    case ConnectionState::SHARING_RESPONSE:
+        return "sharing_response";
+    case ConnectionState::CLOSING:
+        return "closing";
+    }
+    return "";
+}
+
+const char* Proxy::get_phase_name(const Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::REQUEST:
+        return "request";
+    case Phase::DNS:
+        return "dns";
+    case Phase::CONNECT:
+        return "connect";
+    case Phase::FIRST_BYTE:
+        return "first_byte";
+    case Phase::TOTAL:
+        return "total";
+    }
+    return "";
+}
+
 void Proxy::handle_receiving_request(Connection* connection)
 {
     assert(connection->state == ConnectionState::RECEIVING_REQUEST);
-    std::cerr << "handle_receiving_request\n";
-    std::fill(m_buffer, m_buffer + m_size_of_buffer, '\0');
+    LOG_DEBUG(m_logger, "handle_receiving_request");
 
     std::size_t received = 0;
     auto& socket = connection->request_socket;
     assert(m_size_of_buffer > 0); // buffer size must be more than zero
 
+    // pipelined requests are read ahead while the current one is served, but only up to a limit,
+    // the rest waits in the socket until the client is in RECEIVING_REQUEST again
+    const std::size_t max_input = m_max_request_legnth * 4;
     auto status = TcpSocket::Status::ERROR;
-    while ((status = socket->receive(m_buffer, m_size_of_buffer - 1, &received)) == TcpSocket::Status::DONE
-           && connection->state != ConnectionState::CLOSING)
+    while (connection->state != ConnectionState::CLOSING
+           && connection->input.size() < max_input
+           && (status = socket.receive(m_buffer, std::min(sizeof(m_buffer), max_input - connection->input.size()), &received))
+              == TcpSocket::Status::DONE)
     {
+        if (received == 0)
+        {
+            // the client has closed the connection, the current response is still sent
+            connection->client_keep_alive = false;
+            if (connection->state == ConnectionState::RECEIVING_REQUEST)
+            {
+                set_state(connection, ConnectionState::CLOSING);
+            }
+            return;
+        }
+
+        add_counter(m_statistics.received_bytes, received);
         handle_received_data(connection, m_buffer, received);
     }
 
     if (status == TcpSocket::Status::ERROR)
     {
-        std::cerr << "error on receive\n";
+        LOG_DEBUG(m_logger, "error on receive");
+        set_state(connection, ConnectionState::CLOSING);
+    }
+}
+
+void Proxy::handle_resolving_address(Connection*)
+{
+    // nothing to do until the resolver answers, see handle_resolved_addresses
+}
+
+void Proxy::handle_resolved_addresses(const uint32_t)
+{
+    m_resolved.clear();
+    m_resolver.take_results(&m_resolved);
+
+    for (auto& result : m_resolved)
+    {
+        if (m_dns_cache)
+        {
+            m_dns_cache->insert(result.host, result.port, result.addresses);
+        }
+
+        // a background refresh or the client has gone while its request was being resolved,
+        // a lookup the connection has given up answers its next one only if it is for the same name
+        Connection* connection = m_connections.find(SlabPool<Connection>::Handle::from_id(result.id));
+        if (connection == nullptr || connection->resolve_id != result.id
+                || connection->address != result.host || connection->port != result.port)
+        {
+            continue;
+        }
+
+        connection->resolve_id = 0;
+        assert(connection->state == ConnectionState::RESOLVING_ADDRESS);
+
+        connect_to_server(connection, result.addresses);
+        settle_connection(connection);
+    }
+}
+
+void Proxy::reuse_server(Connection* connection, std::unique_ptr<TcpSocket>&& socket)
+{
+    connection->is_server_reused = true;
+    connection->response_socket = std::move(socket);
+    connection->have_connect_called = true;
+
+    m_selector.add(*connection->response_socket, EPOLLOUT, &connection->server_handler);
+
+    connection->phase_start = Clock::now();
+    set_state(connection, ConnectionState::SENDING_REQUEST);
+    handle_sending_request(connection);
+}
+
+bool Proxy::retry_with_new_server(Connection* connection)
+{
+    // a pooled connection may be closed by the server at any moment, the request is repeated only
+    // if nothing of the response has been received
+    if (!connection->is_server_reused || connection->response_header_received || !connection->response_header.empty())
+    {
+        return false;
+    }
+
+    if (!connection->is_repeatable)
+    {
+        // the server may have acted on the request already -> 502 Bad Gateway
+        LOG_DEBUG(m_logger, "reused server connection has been closed, the request isn't repeated");
+        if (connection->is_uploading)
+        {
+            stop_uploading(connection);
+        }
+        drop_server(connection);
+        send_error(connection, "HTTP/1.0 502 Bad Gateway\r\n\r\n");
+        return true;
+    }
+
+    LOG_DEBUG(m_logger, "reused server connection has been closed, retry");
+
+    m_selector.remove(*connection->response_socket);
+    connection->response_socket.reset();
+    connection->is_server_reused = false;
+    connection->have_connect_called = false;
+    connection->is_server_reading = false;
+    connection->is_server_writing = false;
+
+    connection->buffer.clear();
+    connection->buffer.append(connection->request);
+
+    resolve_address(connection);
+    return true;
+}
+
+void Proxy::resolve_address(Connection* connection)
+{
+    connection->phase_start = Clock::now();
+    if (m_dns_cache)
+    {
+        auto lookup = m_dns_cache->find(connection->address, connection->port, &m_cached_addresses);
+        if (lookup == DnsCache::Lookup::HIT_REFRESH)
+        {
+            // nobody waits for the refresh, its result only updates the cache
+            m_resolver.resolve(0, connection->address, connection->port);
+        }
+
+        if (lookup != DnsCache::Lookup::MISS)
+        {
+            connect_to_server(connection, m_cached_addresses);
+            return;
+        }
+    }
+
+    set_state(connection, ConnectionState::RESOLVING_ADDRESS);
+    connection->resolve_id = m_connections.get_handle(connection).to_id();
+    m_resolver.resolve(connection->resolve_id, connection->address, connection->port);
+}
+
+void Proxy::connect_to_server(Connection* connection, const std::vector<IpAddress>& addresses)
+{
+    const auto now = Clock::now();
+    record_latency(Phase::DNS, connection->phase_start, now);
+    connection->phase_start = now;
+
+    if (addresses.empty())
+    {
+        // the name can't be resolved -> 502 Bad Gateway
+        LOG_DEBUG(m_logger, "can't resolve {}", connection->address);
+        send_error(connection, "HTTP/1.0 502 Bad Gateway\r\n\r\n");
+        return;
+    }
+
+    connection->server_addresses = addresses;
+    connection->server_address_index = 0;
+    connection->response_socket = std::make_unique<TcpSocket>();
+    set_state(connection, ConnectionState::CONNECTING_TO_SERVER);
+    handle_connecting_to_server(connection);
+}
+
+bool Proxy::connect_to_next_address(Connection* connection)
+{
+    if (connection->server_address_index + 1 >= connection->server_addresses.size())
+    {
+        return false;
     }
+
+    m_selector.remove(*connection->response_socket);
+    connection->response_socket = std::make_unique<TcpSocket>();
+    connection->have_connect_called = false;
+    ++connection->server_address_index;
+    handle_connecting_to_server(connection);
+    return true;
 }
 
 void Proxy::handle_connecting_to_server(Proxy::Connection* connection)
 {
-    std::cerr << "handle_connecting_to_server\n";
+    LOG_DEBUG(m_logger, "handle_connecting_to_server");
 
     assert(connection->state == ConnectionState::CONNECTING_TO_SERVER);
     assert(connection->response_socket != nullptr);
@@ -91,332 +411,1410 @@ void Proxy::handle_connecting_to_server(Proxy::Connection* connection)
     if (connection->have_connect_called)
     {
         status = socket->isConnected();
-        if (status == TcpSocket::Status::DONE)
-        {
-            connection->state = ConnectionState::SENDING_REQUEST;
-            handle_sending_request(connection);
-        }
-        else if (status == TcpSocket::Status::ERROR)
-        {
-            std::cerr << "can't connect in handle_connecting_to_server:connect\n";
-            connection->state = ConnectionState::CLOSING;
-        }
+    }
+    else
+    {
+        // the socket is watched before connecting, so the next handlers may change its mode
+        m_selector.add(*socket, EPOLLOUT, &connection->server_handler);
+        connection->have_connect_called = true;
 
-        return;
+        status = socket->connect(connection->server_addresses[connection->server_address_index]);
     }
 
-    status = socket->connect(IpAddress(connection->address, HTTP_PORT));
     if (status == TcpSocket::Status::DONE)
     {
-        connection->state = ConnectionState::SENDING_REQUEST;
+        const auto now = Clock::now();
+        record_latency(Phase::CONNECT, connection->phase_start, now);
+        connection->phase_start = now;
+
+        set_state(connection, ConnectionState::SENDING_REQUEST);
         handle_sending_request(connection);
     }
     else if (status == TcpSocket::Status::ERROR)
     {
-        std::cerr << "can't connect in handle_connecting_to_server:connect\n";
-        connection->state = ConnectionState::CLOSING;
+        LOG_DEBUG(m_logger, "can't connect to the address {} of {}", connection->server_address_index, connection->address);
+        if (!connect_to_next_address(connection))
+        {
+            // none of the addresses accepts the connection -> 502 Bad Gateway
+            fail_fetch(connection, "HTTP/1.0 502 Bad Gateway\r\n\r\n");
+        }
     }
-
-    auto handler = std::bind(&Proxy::handle_connection, this, std::placeholders::_1);
-    m_selector.add(*connection->response_socket, EPOLLOUT, handler);
-    connection->have_connect_called = true;
 }
 
 void Proxy::handle_sending_request(Connection* connection)
 {
-    std::cerr << "handle_sending_request\n";
+    LOG_DEBUG(m_logger, "handle_sending_request");
 
     assert(connection->state == ConnectionState::SENDING_REQUEST);
     assert(connection->response_socket != nullptr);
 
     auto socket = connection->response_socket.get();
-    std::size_t sent = 0;
-    auto status = TcpSocket::Status::ERROR;
-    while (connection->idx != connection->buffer.size())
+    auto status = send_buffer(&connection->buffer, socket);
+    if (status == TcpSocket::Status::ERROR)
     {
-        status = socket->send(connection->buffer.data() + connection->idx, connection->buffer.size() - connection->idx, &sent);
-        if (status != TcpSocket::Status::DONE)
+        if (retry_with_new_server(connection))
         {
-            break;
+            return;
         }
-        connection->idx += sent;
-    }
 
-    if (status == TcpSocket::Status::ERROR)
-    {
-        std::cerr << "error on handle_sending_request::send\n";
-        connection->state = ConnectionState::CLOSING;
+        LOG_DEBUG(m_logger, "error on handle_sending_request::send");
+        set_state(connection, ConnectionState::CLOSING);
         return;
     }
 
-    if (connection->idx == connection->buffer.size())
+    if (status == TcpSocket::Status::DONE)
     {
+        // from now on the response is relayed to the client as soon as it arrives,
+        // so the server is watched for reading and the client for writing at the same time
         connection->buffer.clear();
-        connection->idx = 0;
-        connection->state = ConnectionState::RECEIVING_RESPONSE;
-        m_selector.change_mode(*socket, EPOLLIN);
+        set_state(connection, ConnectionState::RECEIVING_RESPONSE);
+        set_server_reading(connection, true);
+
+        // the rest of the request body is relayed in the other direction meanwhile
+        connection->is_client_reading = connection->is_uploading;
+        m_selector.change_mode(connection->request_socket, connection->is_uploading ? EPOLLIN | EPOLLOUT : EPOLLOUT);
         handle_receiving_response(connection);
     }
-
 }
 
 void Proxy::handle_sending_response(Connection* connection)
 {
-    std::cerr << "handle_sending_response\n";
+    LOG_DEBUG(m_logger, "handle_sending_response");
     assert(connection->state == ConnectionState::SENDING_RESPONSE);
-    assert(connection->request_socket != nullptr);
-
-    auto request_socket = connection->request_socket.get();
-    std::size_t sent = 0;
-    auto* vector = &connection->buffer;
-    auto status = TcpSocket::Status::DONE;
-    while (vector->size() > connection->idx && status == TcpSocket::Status::DONE)
-    {
-        status = request_socket->send(vector->data(), vector->size() - connection->idx, &sent);
-        connection->idx += sent;
-    }
+    assert(connection->request_socket.m_socket_fd != -1);
 
+    auto status = send_response(connection);
     if (status == TcpSocket::Status::ERROR)
     {
-        std::cerr << "error on handle_sending_response::send\n";
-        connection->state = ConnectionState::CLOSING;
+        LOG_DEBUG(m_logger, "error on handle_sending_response::send");
+        set_state(connection, ConnectionState::CLOSING);
         return;
     }
 
-    if (vector->size() == connection->idx)
+    if (status == TcpSocket::Status::DONE)
     {
-        connection->state = ConnectionState::CLOSING;
+        finish_request(connection);
     }
 }
 
-void Proxy::handle_sending_error(Connection* connection)
+void Proxy::finish_request(Connection* connection)
 {
-    std::cerr << "handle_sending_error\n";
-    assert(connection->state == ConnectionState::SENDING_ERROR);
-    assert(connection->request_socket != nullptr);
+    record_latency(Phase::TOTAL, connection->request_start, Clock::now());
 
-    auto request_socket = connection->request_socket.get();
-    std::size_t sent = 0;
-    auto* vector = &connection->buffer;
-    auto status = TcpSocket::Status::DONE;
-    while (vector->size() > connection->idx && status == TcpSocket::Status::DONE)
+    if (!connection->client_keep_alive)
     {
-        status = request_socket->send(vector->data(), vector->size() - connection->idx, &sent);
-        connection->idx += sent;
+        set_state(connection, ConnectionState::CLOSING);
+        return;
     }
 
-    if (status == TcpSocket::Status::ERROR)
+    // the connection starts over, only the client and its unprocessed input are kept
+    m_pipes.release(&connection->pipe);
+    assert(connection->response_socket == nullptr && connection->resolve_id == 0);
+
+    auto client_socket = std::move(connection->request_socket);
+    auto input = std::move(connection->input);
+    set_state(connection, ConnectionState::RECEIVING_REQUEST);
+    *connection = Connection(std::move(client_socket), &m_buffers);
+    connection->input = std::move(input);
+
+    // a pipelined request has already come, the next one starts with its first byte
+    if (!connection->input.empty())
     {
-        std::cerr << "error on handle_sending_error::send\n";
-        connection->state = ConnectionState::CLOSING;
-        return;
+        connection->request_start = Clock::now();
     }
 
-    if (vector->size() == connection->idx)
+    m_selector.change_mode(connection->request_socket, EPOLLIN);
+
+    // pipelined requests are served one by one in the order of arrival
+    process_request(connection);
+    if (connection->state == ConnectionState::RECEIVING_REQUEST)
     {
-        connection->state = ConnectionState::CLOSING;
+        handle_receiving_request(connection);
     }
 }
 
-void Proxy::handle_receiving_response(Connection* connection)
+void Proxy::handle_sending_error(Connection* connection)
 {
-    std::cerr << "handle_receiving_response\n";
-    assert(connection->state == ConnectionState::RECEIVING_RESPONSE);
-    assert(connection->response_socket != nullptr);
+    LOG_DEBUG(m_logger, "handle_sending_error");
+    assert(connection->state == ConnectionState::SENDING_ERROR);
+    assert(connection->request_socket.m_socket_fd != -1);
 
-    auto resposne_socket = connection->response_socket.get();
-    std::size_t received = m_size_of_buffer - 1;
-    auto status = TcpSocket::Status::DONE;
-    while (received != 0 && status == TcpSocket::Status::DONE)
+    auto status = send_buffer(&connection->buffer, &connection->request_socket);
+    if (status == TcpSocket::Status::ERROR)
     {
-        std::fill(m_buffer, m_buffer + m_size_of_buffer, 0);
-        status = resposne_socket->receive(m_buffer, m_size_of_buffer - 1, &received);
-
-        std::cerr << received << std::endl;
-
-        if (received != 0) {
-            // TODO : potential buffer overflow
-            connection->buffer.insert(connection->buffer.end(), m_buffer, m_buffer + received);
-        }
-
-        if (HttpParser::query_is_end(connection->buffer))
-        {
-            connection->state = ConnectionState::SENDING_RESPONSE;
-            m_selector.change_mode(*connection->request_socket, EPOLLOUT);
-            handle_sending_response(connection);
-            return;
-        }
+        LOG_DEBUG(m_logger, "error on handle_sending_error::send");
+        set_state(connection, ConnectionState::CLOSING);
+        return;
     }
 
-    if (status == TcpSocket::Status::ERROR)
+    if (status == TcpSocket::Status::DONE)
     {
-        std::cerr << "error on handle_receiving_response::receive\n";
-        connection->state = ConnectionState::CLOSING;
-        return;
+        set_state(connection, ConnectionState::CLOSING);
     }
 }
 
-void Proxy::handle_received_data(Connection* connection, char* buffer, const std::size_t received)
+void Proxy::handle_sharing_response(Connection* connection)
 {
-    std::cerr << "handle_received_data " << received << "\n";
+    LOG_DEBUG(m_logger, "handle_sharing_response");
+    assert(connection->state == ConnectionState::SHARING_RESPONSE);
 
-    buffer[received] = '\0';
-
-    if (connection->buffer.size() > m_max_request_legnth)
+    // the leader appends the response as it arrives and tells when it is over, see finish_sharing,
+    // nothing is to be sent until the header comes
+    if (!connection->response_header_received)
     {
-        // too large request, it must be an attack -> send 500 Internal Server Error
-        send_error(connection, "HTTP/1.0 500 Internal Server Error\r\n\r\n");
+        return;
     }
 
-    connection->buffer.insert(connection->buffer.end(), buffer, buffer + received);
-
-    HttpParser::Header header = HttpParser::parse(connection->buffer);
-    if (!header && connection->buffer.size() >= 4)
+    if (send_response(connection) == TcpSocket::Status::ERROR)
     {
-        connection->state = ConnectionState::CLOSING;
+        LOG_DEBUG(m_logger, "error on handle_sharing_response::send");
+        set_state(connection, ConnectionState::CLOSING);
         return;
     }
 
-    if (HttpParser::query_is_end(connection->buffer) && connection->address.empty())
+    if (connection->leader != nullptr && connection->buffer.size() < m_max_buffered_bytes)
     {
-        if (header)
-        {
-            if (header.method == HttpParser::Method::GET && header.version == HttpParser::Version::HTTP_1_0)
-            {
-                // initialize new socket and add it to the selector
-                connection->address = header.URI;
-
-                // log
-                auto address = connection->request_socket->getRemoteAddress();
-                auto port = connection->request_socket->getRemotePort();
-                m_logger.get_stream(Logger::LOG_LEVEL::INFO)
-                        << "NEW CLIENT "
-                        << "Address : " << address
-                        << " Port : " + std::to_string(port)
-                        << " URL : " + header.URI << std::endl;
-
-                assert(connection->response_socket == nullptr);
-                connection->response_socket = std::make_unique<TcpSocket>();
-                connection->state = ConnectionState::CONNECTING_TO_SERVER;
-                handle_connecting_to_server(connection);
-            }
-            else
-            {
-                // not suppoted -> 405 Method Not Allowed
-                send_error(connection, "HTTP/1.0 405 Method Not Allowed\r\n\r\n");
-            }
-        }
-        else
-        {
-            // server can't parse request -> 400 Bad Request
-            send_error(connection, "HTTP/1.0 400 Bad Request\r\n\r\n");
-        }
+        resume_response(connection->leader);
     }
 }
 
-void Proxy::send_error(Connection* connection, const std::string& message)
+void Proxy::handle_timeout(Connection* connection)
 {
-    connection->state = ConnectionState::SENDING_ERROR;
-    connection->buffer.clear();
-    connection->buffer.insert(connection->buffer.begin(), message.begin(), message.end());
-    connection->idx = 0;
-    m_selector.change_mode(*connection->request_socket, EPOLLOUT);
-    handle_sending_error(connection);
+    LOG_DEBUG(m_logger, "handle_timeout");
+    add_counter(m_statistics.timed_out_connections, 1);
+
+    switch (connection->timeout)
+    {
+    case Timeout::REQUEST:
+        // the client is too slow to send its request -> 408 Request Timeout
+        connection->client_keep_alive = false;
+        send_error(connection, "HTTP/1.0 408 Request Timeout\r\n\r\n");
+        break;
+
+    case Timeout::CONNECT:
+    case Timeout::FIRST_BYTE:
+        // the server can't be reached in time -> 504 Gateway Timeout
+        fail_fetch(connection, "HTTP/1.0 504 Gateway Timeout\r\n\r\n");
+        break;
+
+    case Timeout::READ:
+        // the stalled server isn't handed over to the waiters, they get what has come
+        drop_server(connection);
+        set_state(connection, ConnectionState::CLOSING);
+        break;
+
+    default:
+        set_state(connection, ConnectionState::CLOSING);
+        break;
+    }
+
+    connection->timeout = Timeout::NONE;
+    settle_connection(connection);
+}
+
+void Proxy::handle_pool_timer()
+{
+    m_server_pool.close_expired();
+    m_selector.get_timers().arm(&m_pool_timer, m_pool_check_period);
 }
 
-void Proxy::handle_incoming_connection(const epoll_event& event)
+void Proxy::handle_receiving_response(Connection* connection)
 {
-    std::cerr << "handle_incoming_connection\n";
+    LOG_DEBUG(m_logger, "handle_receiving_response");
+    assert(connection->state == ConnectionState::RECEIVING_RESPONSE);
+    assert(connection->response_socket != nullptr);
 
-    if (is_die_events(event.events))
+    if (connection->is_uploading && !relay_request_body(connection))
     {
-        (event.events & EPOLLERR) ? std::cerr << "EPOLLERR\n" : std::cerr << "goodby\n";
-        ::close(event.data.fd);
         return;
     }
 
-    assert(event.events & EPOLLIN);
-    Connection connection(std::make_unique<TcpSocket>(-1));
-    auto client_socket = connection.request_socket.get();
-
-    auto status = TcpSocket::Status::DONE;
-    while ( (status = m_server_socket.accept(client_socket) ) == TcpSocket::Status::DONE)
+    while (true)
     {
-        // Add the new connection to the selector so that we will
-        // be notified when it sends something
-        auto client_handler = std::bind(&Proxy::handle_connection, this, std::placeholders::_1);
-        m_selector.add(*client_socket, EPOLLIN, client_handler);
-
-        // Add the new connection to the connections list
-        auto address = client_socket->getRemoteAddress();
-        auto port = client_socket->getRemotePort();
+        // the next part is read only when the previous one was passed to the client,
+        // so a connection never holds more than one buffer of the response
+        auto status = send_response(connection);
+        if (status == TcpSocket::Status::ERROR)
+        {
+            LOG_DEBUG(m_logger, "error on handle_receiving_response::send");
+            set_state(connection, ConnectionState::CLOSING);
+            return;
+        }
 
-        m_connections[std::pair<std::string, uint16_t>(address, port)] = std::move(connection);
-    }
+        if (status == TcpSocket::Status::NOT_READY)
+        {
+            // the server waits until the client is ready for writing
+            set_server_reading(connection, false);
+            return;
+        }
 
-    if (status == TcpSocket::Status::ERROR) { std::cerr << "error on accept\n"; }
+        if (connection->response_is_complete)
+        {
+            finish_response(connection);
+            return;
+        }
 
-}
+        // the slowest waiter sets the pace, it resumes reading when it has sent enough, see resume_response
+        const std::size_t room = get_sharing_room(connection);
+        set_server_reading(connection, room != 0);
+        if (room == 0)
+        {
+            return;
+        }
 
-void Proxy::handle_connection(const epoll_event& event)
-{
-    auto it = m_connections.begin();
-    for (; it != m_connections.end(); ++it)
-    {
-        if (it->second.request_socket->m_socket_fd == event.data.fd
-                || (it->second.response_socket && it->second.response_socket->m_socket_fd == event.data.fd))
+        std::size_t received = 0;
+        status = receive_response(connection, room, &received);
+        if ((status == TcpSocket::Status::ERROR || (status == TcpSocket::Status::DONE && received == 0))
+                && retry_with_new_server(connection))
         {
-            break;
+            return;
         }
-    }
-    assert(it != m_connections.end());
 
-    Connection* connection = &it->second;
-    auto handler = m_transitions[connection->state];
-    handler(this, connection);
+        if (status == TcpSocket::Status::ERROR)
+        {
+            LOG_DEBUG(m_logger, "error on handle_receiving_response::receive");
+            set_state(connection, ConnectionState::CLOSING);
+            return;
+        }
 
-    if (connection->state == ConnectionState::CLOSING)
-    {
-        std::cerr << "goodby\n";
-        if (connection->request_socket)
+        if (status == TcpSocket::Status::NOT_READY)
         {
-            m_selector.remove(*connection->request_socket);
+            return; // wait for the next part of the response
         }
 
-        if (connection->response_socket)
+        if (received == 0)
         {
-            m_selector.remove(*connection->response_socket);
+            // the server closed the connection, it is the end of the response
+            finish_response(connection);
+            return;
         }
 
-        m_connections.erase(it);
+        add_counter(m_statistics.received_bytes, received);
     }
-    else if (is_die_events(event.events))
+}
+
+bool Proxy::track_response(Connection* connection, const char* data, const std::size_t size)
+{
+    auto& framer = connection->response_framer;
+    if (connection->response_header_received)
     {
-        if (connection->response_socket && connection->response_socket->m_socket_fd == event.data.fd)
+        // the data has been received into the free space of the buffer, the rest after the response is dropped
+        const auto consumed = framer.consume(data, size);
+        if (data != nullptr)
         {
-            m_selector.remove(*connection->response_socket);
-            connection->response_socket.reset();
-            if (connection->state == ConnectionState::RECEIVING_RESPONSE && !connection->buffer.empty()) {
-                connection->state = ConnectionState::SENDING_RESPONSE;
-            }
+            connection->buffer.commit(consumed);
         }
-        else
+
+        cache_response(connection, data, consumed);
+        if (!connection->waiters.empty())
         {
-            (event.events & EPOLLERR) ? std::cerr << "EPOLLERR\n" : std::cerr << "goodby\n";
+            share_response(connection, data, consumed);
+        }
 
-            if (connection->request_socket)
-            {
-                m_selector.remove(*connection->request_socket);
-            }
+        check_response_framing(connection, consumed, size);
+        return framer.is_done();
+    }
 
-            if (connection->response_socket)
-            {
-                m_selector.remove(*connection->response_socket);
-            }
+    // the header is held back until it is complete, so it can be rewritten for the client,
+    // the buffer is filled from the copy
+    auto& header = connection->response_header;
+    const auto old_size = header.size();
+    if (old_size == 0 && size != 0 && connection->phase_start != Clock::time_point())
+    {
+        // the final response after an interim one isn't counted again
+        record_latency(Phase::FIRST_BYTE, connection->phase_start, Clock::now());
+        connection->phase_start = Clock::time_point();
+    }
+    header.append(data, size);
 
-            m_connections.erase(it);
+    auto end_of_header = header.find("\r\n\r\n", old_size > 3 ? old_size - 3 : 0);
+    while (end_of_header != std::string::npos && HttpParser::status_code(header) / 100 == 1
+           && HttpParser::status_code(header) != 101)
+    {
+        // an interim response, e.g. 100 Continue to a client that holds its body back until it comes,
+        // is passed as is and the final response follows it, an HTTP/1.0 client gets only the final one
+        end_of_header += 4; // sizeof "\r\n\r\n"
+        if (connection->is_client_http_1_1)
+        {
+            connection->buffer.append(header.data(), end_of_header);
+        }
+        header.erase(0, end_of_header);
+        end_of_header = header.find("\r\n\r\n");
+    }
 
-            return;
+    if (end_of_header == std::string::npos)
+    {
+        if (header.size() > m_max_request_legnth * 4)
+        {
+            // the header is too large to be inspected, it is passed as is
+            // and the response lasts until the server closes connection
+            connection->response_header_received = true;
+            connection->client_keep_alive = false;
+            framer.start_close_delimited();
+            connection->buffer.append(header);
+            std::string().swap(header);
+
+            // nothing is known about the response, so it isn't shared
+            start_sharing(connection, std::string(), false);
+        }
+
+        return false;
+    }
+
+    end_of_header += 4; // sizeof "\r\n\r\n"
+    connection->response_header_received = true;
+
+    const std::string response_header = header.substr(0, end_of_header);
+    const bool has_framing = framer.start(response_header);
+
+    // the end of a close delimited response is the end of connection, so neither side can be reused
+    const bool is_delimited = has_framing && framer.get_framing() != ResponseFramer::Framing::CLOSE;
+    connection->response_keep_alive = is_delimited && HttpParser::is_keep_alive(response_header);
+    connection->client_keep_alive = connection->client_keep_alive && is_delimited;
+    connection->buffer.append(HttpParser::make_client_response(response_header, connection->client_keep_alive));
+
+    if (!connection->cache_key.empty())
+    {
+        start_caching(connection, response_header);
+    }
+
+    start_sharing(connection, response_header, is_delimited);
+
+    const std::size_t body_size = header.size() - end_of_header;
+    const auto consumed = framer.consume(header.data() + end_of_header, body_size);
+    connection->buffer.append(header.data() + end_of_header, consumed);
+    cache_response(connection, header.data() + end_of_header, consumed);
+    if (!connection->waiters.empty())
+    {
+        share_response(connection, header.data() + end_of_header, consumed);
+    }
+    std::string().swap(header);
+
+    check_response_framing(connection, consumed, body_size);
+    return framer.is_done();
+}
+
+void Proxy::start_caching(Connection* connection, const std::string& header)
+{
+    // only responses with known length are stored, so they can be sent to any client as they are
+    const auto& framer = connection->response_framer;
+    const bool has_length = framer.get_framing() == ResponseFramer::Framing::LENGTH
+            || framer.get_framing() == ResponseFramer::Framing::NONE;
+
+    if (!has_length || !ResponseCache::get_lifetime(header, &connection->cache_lifetime, &connection->cache_age))
+    {
+        return;
+    }
+
+    connection->cache_header = ResponseCache::make_stored_header(header);
+    const uint64_t size = connection->cache_header.size() + framer.get_remaining();
+
+    if (m_response_cache && size <= m_response_cache->get_max_response_bytes())
+    {
+        connection->is_caching = true;
+        connection->cache_body.reserve(framer.get_remaining());
+    }
+    else if (m_disk_cache && m_disk_cache->reserve(size, &connection->disk_writer))
+    {
+        // the header goes first, the body follows it as it is received
+        const auto& stored_header = connection->cache_header;
+        connection->is_disk_caching = m_disk_cache->write(&connection->disk_writer, stored_header.data(), stored_header.size());
+    }
+}
+
+void Proxy::cache_response(Connection* connection, const char* data, const std::size_t size)
+{
+    if (connection->is_caching)
+    {
+        connection->cache_body.append(data, size);
+    }
+
+    // a failed write leaves a hole in the segment, the response is just not stored
+    if (connection->is_disk_caching && !m_disk_cache->write(&connection->disk_writer, data, size))
+    {
+        connection->is_disk_caching = false;
+    }
+}
+
+void Proxy::start_sharing(Connection* connection, const std::string& header, const bool is_delimited)
+{
+    // the requests that come later can't get the beginning of the response anymore
+    if (!connection->fetch_key.empty())
+    {
+        m_fetches.erase(connection->fetch_key);
+        connection->fetch_key.clear();
+    }
+
+    if (connection->waiters.empty())
+    {
+        return;
+    }
+
+    // the response is shared on the same terms as a shared cache would store it
+    long lifetime = 0;
+    long age = 0;
+    ResponseCache::Vary vary;
+    const bool may_share = ResponseCache::get_lifetime(header, &lifetime, &age)
+            && ResponseCache::get_vary(header, connection->request, &vary);
+
+    std::vector<Connection*> released;
+    auto& waiters = connection->waiters;
+    for (auto it = waiters.begin(); it != waiters.end(); )
+    {
+        auto waiter = *it;
+        if (!may_share || !ResponseCache::matches_vary(vary, waiter->request))
+        {
+            waiter->leader = nullptr;
+            released.push_back(waiter);
+            it = waiters.erase(it);
+            continue;
+        }
+
+        waiter->response_header_received = true;
+        waiter->client_keep_alive = waiter->client_keep_alive && is_delimited;
+        waiter->buffer.clear();
+        waiter->buffer.append(HttpParser::make_client_response(header, waiter->client_keep_alive));
+        m_selector.change_mode(waiter->request_socket, EPOLLOUT);
+        add_counter(m_statistics.collapsed_requests, 1);
+        update_timer(waiter);
+        ++it;
+    }
+
+    // the others go to the server on their own, they aren't collapsed again, since the response would be the same
+    for (auto waiter : released)
+    {
+        forward_request(waiter);
+        settle_connection(waiter);
+    }
+}
+
+void Proxy::share_response(Connection* connection, const char* data, const std::size_t size)
+{
+    // a waiter that fails is closed and leaves the list, so the list is walked from the end
+    auto& waiters = connection->waiters;
+    for (std::size_t i = waiters.size(); i-- > 0; )
+    {
+        auto waiter = waiters[i];
+        waiter->buffer.append(data, size);
+        handle_sharing_response(waiter);
+        settle_connection(waiter);
+    }
+}
+
+void Proxy::finish_sharing(Connection* connection)
+{
+    std::string key;
+    key.swap(connection->fetch_key);
+    if (!key.empty())
+    {
+        m_fetches.erase(key);
+    }
+
+    // the client can't tell a truncated response from a complete one unless the connection is closed
+    const bool is_truncated = !connection->response_is_complete
+            && connection->response_framer.get_framing() != ResponseFramer::Framing::CLOSE;
+
+    std::vector<Connection*> waiters;
+    waiters.swap(connection->waiters);
+    for (auto waiter : waiters)
+    {
+        waiter->leader = nullptr;
+        if (waiter->response_header_received)
+        {
+            waiter->client_keep_alive = waiter->client_keep_alive && !is_truncated;
+            set_state(waiter, ConnectionState::SENDING_RESPONSE);
+            handle_sending_response(waiter);
+        }
+        else if (key.empty() || !collapse_request(waiter, key))
+        {
+            // no response has come, the requests are collapsed again, so only one of them goes to the server
+            forward_request(waiter);
+        }
+
+        settle_connection(waiter);
+    }
+}
+
+Proxy::Connection* Proxy::hand_over_fetch(Connection* connection)
+{
+    // the client of the leader has gone, but the waiters still get the response,
+    // the first of them takes over the server connection and the rest of waiters
+    if (connection->waiters.empty() || !connection->response_header_received || !connection->response_socket)
+    {
+        return nullptr;
+    }
+
+    auto successor = connection->waiters.front();
+    successor->leader = nullptr;
+    successor->waiters.assign(connection->waiters.begin() + 1, connection->waiters.end());
+    for (auto waiter : successor->waiters)
+    {
+        waiter->leader = successor;
+    }
+    connection->waiters.clear();
+
+    // the events of the server go to the handler of the successor from now on
+    successor->response_socket = std::move(connection->response_socket);
+    successor->is_server_reading = connection->is_server_reading;
+    m_selector.remove(*successor->response_socket);
+    m_selector.add(*successor->response_socket, successor->is_server_reading ? static_cast<uint32_t>(EPOLLIN) : 0, &successor->server_handler);
+    successor->is_server_reused = connection->is_server_reused;
+    successor->response_is_complete = connection->response_is_complete;
+    successor->response_keep_alive = connection->response_keep_alive;
+    successor->response_framer = connection->response_framer;
+
+    successor->cache_key = std::move(connection->cache_key);
+    successor->is_caching = connection->is_caching;
+    successor->is_disk_caching = connection->is_disk_caching;
+    successor->cache_lifetime = connection->cache_lifetime;
+    successor->cache_age = connection->cache_age;
+    successor->cache_header = std::move(connection->cache_header);
+    successor->cache_body = std::move(connection->cache_body);
+    successor->disk_writer = std::move(connection->disk_writer);
+    connection->is_caching = false;
+    connection->is_disk_caching = false;
+
+    set_state(successor, ConnectionState::RECEIVING_RESPONSE);
+    return successor;
+}
+
+void Proxy::detach_waiter(Connection* connection)
+{
+    if (connection->leader == nullptr)
+    {
+        return;
+    }
+
+    auto leader = connection->leader;
+    auto& waiters = leader->waiters;
+    waiters.erase(std::find(waiters.begin(), waiters.end(), connection));
+    connection->leader = nullptr;
+
+    // the waiter may have held the response back
+    resume_response(leader);
+}
+
+std::size_t Proxy::get_sharing_room(const Connection* connection) const
+{
+    std::size_t room = m_max_buffered_bytes;
+    for (auto waiter : connection->waiters)
+    {
+        const auto buffered = waiter->buffer.size();
+        room = std::min(room, buffered < m_max_buffered_bytes ? m_max_buffered_bytes - buffered : 0);
+    }
+    return room;
+}
+
+void Proxy::resume_response(Connection* connection)
+{
+    // only the server is watched again, its next event continues the response,
+    // so the caller, which may be a waiter being served by this very connection, isn't reentered
+    const bool has_output = !connection->buffer.empty() || connection->pipe.size != 0;
+    if (connection->state != ConnectionState::RECEIVING_RESPONSE || connection->is_server_reading
+            || has_output || get_sharing_room(connection) == 0)
+    {
+        return;
+    }
+
+    set_server_reading(connection, true);
+    update_timer(connection);
+}
+
+void Proxy::set_server_reading(Connection* connection, const bool is_reading)
+{
+    if (connection->is_server_reading == is_reading || !connection->response_socket)
+    {
+        return;
+    }
+
+    // a socket with data that has come while it wasn't watched is reported as soon as it is watched again
+    connection->is_server_reading = is_reading;
+    m_selector.change_mode(*connection->response_socket,
+                           (is_reading ? static_cast<uint32_t>(EPOLLIN) : 0)
+                           | (connection->is_server_writing ? static_cast<uint32_t>(EPOLLOUT) : 0));
+}
+
+void Proxy::set_server_writing(Connection* connection, const bool is_writing)
+{
+    if (connection->is_server_writing == is_writing || !connection->response_socket)
+    {
+        return;
+    }
+
+    connection->is_server_writing = is_writing;
+    m_selector.change_mode(*connection->response_socket,
+                           (connection->is_server_reading ? static_cast<uint32_t>(EPOLLIN) : 0)
+                           | (is_writing ? static_cast<uint32_t>(EPOLLOUT) : 0));
+}
+
+void Proxy::set_client_reading(Connection* connection, const bool is_reading)
+{
+    if (connection->is_client_reading == is_reading)
+    {
+        return;
+    }
+
+    // the client is watched for writing all the time the response may be sent
+    connection->is_client_reading = is_reading;
+    m_selector.change_mode(connection->request_socket, is_reading ? EPOLLIN | EPOLLOUT : EPOLLOUT);
+}
+
+void Proxy::check_response_framing(Connection* connection, const std::size_t consumed, const std::size_t received)
+{
+    if (consumed < received)
+    {
+        connection->response_keep_alive = false; // the server sent more than the response
+    }
+
+    if (connection->response_framer.get_status() == ResponseFramer::Status::ERROR)
+    {
+        // the end of the response can't be found anymore, both connections end with it
+        connection->response_keep_alive = false;
+        connection->client_keep_alive = false;
+    }
+}
+
+void Proxy::finish_response(Connection* connection)
+{
+    // the server may answer before the request body is over, then the rest of the body isn't relayed
+    const bool is_request_sent = connection->request_framer.is_done() && connection->request_body.empty();
+    if (connection->is_uploading)
+    {
+        stop_uploading(connection);
+    }
+
+    // the server is not needed anymore, the rest of the buffer is sent in SENDING_RESPONSE
+    if (connection->response_socket)
+    {
+        m_selector.remove(*connection->response_socket);
+
+        // only a response with known end to the whole request leaves the connection ready for the next request
+        if (connection->response_is_complete && connection->response_keep_alive && is_request_sent)
+        {
+            m_server_pool.checkin(connection->address, connection->port, std::move(connection->response_socket));
+        }
+        connection->response_socket.reset();
+    }
+
+    if (connection->is_caching && connection->response_is_complete)
+    {
+        m_response_cache->insert(connection->cache_key, connection->request, connection->cache_header,
+                                 std::move(connection->cache_body), connection->cache_lifetime, connection->cache_age);
+        connection->is_caching = false;
+    }
+
+    if (connection->is_disk_caching && connection->response_is_complete)
+    {
+        m_disk_cache->commit(connection->disk_writer, connection->cache_key, connection->request, connection->cache_header,
+                             connection->cache_lifetime, connection->cache_age);
+        connection->is_disk_caching = false;
+    }
+    connection->disk_writer = DiskCache::Writer();
+
+    // the client can't tell a truncated response from a complete one unless the connection is closed
+    if (!connection->response_is_complete && connection->response_framer.get_framing() != ResponseFramer::Framing::CLOSE)
+    {
+        connection->client_keep_alive = false;
+    }
+
+    finish_sharing(connection);
+
+    set_state(connection, ConnectionState::SENDING_RESPONSE);
+    handle_sending_response(connection);
+}
+
+TcpSocket::Status Proxy::send_response(Connection* connection)
+{
+    auto socket = &connection->request_socket;
+    auto status = send_buffer(&connection->buffer, socket);
+    if (status != TcpSocket::Status::DONE)
+    {
+        return status;
+    }
+
+    auto& pipe = connection->pipe;
+    std::size_t sent = 0;
+    while (pipe.size != 0)
+    {
+        status = socket->sendFromPipe(pipe.read_fd, pipe.size, &sent);
+        if (status != TcpSocket::Status::DONE)
+        {
+            return status;
+        }
+
+        add_counter(m_statistics.sent_bytes, sent);
+        pipe.size -= sent;
+    }
+
+    if (connection->cached_response)
+    {
+        const auto& body = connection->cached_response->body;
+        while (connection->cached_offset < body.size())
+        {
+            status = socket->send(body.data() + connection->cached_offset, body.size() - connection->cached_offset, &sent);
+            if (status != TcpSocket::Status::DONE)
+            {
+                return status;
+            }
+
+            add_counter(m_statistics.sent_bytes, sent);
+            connection->cached_offset += sent;
+        }
+        connection->cached_response.reset();
+    }
+
+    auto& file = connection->cached_file;
+    while (file.size != 0)
+    {
+        status = socket->sendFile(file.segment->fd, &file.offset, file.size, &sent);
+        if (status != TcpSocket::Status::DONE)
+        {
+            return status;
+        }
+
+        if (sent == 0)
+        {
+            // the segment has been truncated, the client has to see the response is incomplete
+            connection->client_keep_alive = false;
+            break;
+        }
+
+        add_counter(m_statistics.sent_bytes, sent);
+        file.size -= sent;
+    }
+    file.segment.reset();
+
+    return TcpSocket::Status::DONE;
+}
+
+TcpSocket::Status Proxy::receive_response(Connection* connection, const std::size_t max_size, std::size_t* received)
+{
+    assert(connection->buffer.empty() && connection->pipe.size == 0);
+
+    auto socket = connection->response_socket.get();
+    if (can_splice(connection) && (connection->pipe || m_pipes.acquire(&connection->pipe)))
+    {
+        const std::size_t size = connection->response_framer.limit(std::min(max_size, m_pipes.get_pipe_capacity()));
+        auto status = socket->receiveToPipe(connection->pipe.write_fd, size, received);
+        if (status == TcpSocket::Status::DONE)
+        {
+            connection->pipe.size = *received;
+            connection->response_is_complete = track_response(connection, nullptr, *received);
+        }
+
+        return status;
+    }
+
+    // the response is received straight into the buffer a chunk at a time,
+    // nothing after the end of the response is read, so the connection may be reused
+    std::size_t capacity = 0;
+    auto data = connection->buffer.prepare(&capacity);
+    const std::size_t size = connection->response_framer.limit(std::min(max_size, capacity));
+    auto status = socket->receive(data, size, received);
+    if (status == TcpSocket::Status::DONE)
+    {
+        connection->response_is_complete = track_response(connection, data, *received);
+    }
+
+    return status;
+}
+
+bool Proxy::can_splice(const Connection* connection) const
+{
+    // the header and the chunked framing have to be inspected, so only the rest of body may bypass user space
+    // and a body that goes to the cache or to waiters has to be copied anyway
+    return m_use_splice && connection->response_header_received
+            && !connection->response_framer.needs_data() && !connection->is_caching && !connection->is_disk_caching
+            && connection->waiters.empty();
+}
+
+TcpSocket::Status Proxy::send_buffer(ChunkBuffer* buffer, TcpSocket* socket)
+{
+    std::size_t sent = 0;
+    while (!buffer->empty())
+    {
+        auto status = socket->send(buffer->front(), buffer->front_size(), &sent);
+        if (status != TcpSocket::Status::DONE)
+        {
+            return status;
+        }
+
+        add_counter(m_statistics.sent_bytes, sent);
+        buffer->consume(sent);
+    }
+
+    return TcpSocket::Status::DONE;
+}
+
+void Proxy::handle_received_data(Connection* connection, char* buffer, const std::size_t received)
+{
+    LOG_DEBUG(m_logger, "handle_received_data {}", received);
+
+    if (connection->request_start == Clock::time_point())
+    {
+        connection->request_start = Clock::now();
+    }
+    connection->input.append(buffer, received);
+    if (connection->state == ConnectionState::RECEIVING_REQUEST)
+    {
+        process_request(connection);
+    }
+}
+
+bool Proxy::relay_request_body(Connection* connection)
+{
+    // the client isn't read while the server hasn't taken enough of the body,
+    // so an upload of any size holds no more than the bound of the buffer
+    auto& body = connection->request_body;
+    auto& framer = connection->request_framer;
+    auto& input = connection->input;
+    bool is_server_ready = true;
+    bool has_moved = false;
+    while (true)
+    {
+        if (is_server_ready)
+        {
+            const auto unsent = body.size();
+            auto status = send_buffer(&body, connection->response_socket.get());
+            has_moved = has_moved || body.size() != unsent;
+            if (status == TcpSocket::Status::ERROR)
+            {
+                // the server may have answered without waiting for the rest of the body, the answer is still relayed
+                LOG_DEBUG(m_logger, "error on relay_request_body::send");
+                stop_uploading(connection);
+                return true;
+            }
+            is_server_ready = status == TcpSocket::Status::DONE;
+        }
+
+        const std::size_t room = body.size() < m_max_buffered_bytes ? m_max_buffered_bytes - body.size() : 0;
+        if (framer.is_done() || room == 0)
+        {
+            break;
+        }
+
+        if (!input.empty())
+        {
+            // the part of the body that has been read ahead with the request
+            const auto consumed = framer.consume(input.data(), std::min(room, input.size()));
+            body.append(input.data(), consumed);
+            input.erase(0, consumed);
+            has_moved = has_moved || consumed != 0;
+        }
+        else
+        {
+            std::size_t capacity = 0;
+            std::size_t received = 0;
+            auto data = body.prepare(&capacity);
+            auto status = connection->request_socket.receive(data, framer.limit(std::min(room, capacity)), &received);
+            if (status == TcpSocket::Status::NOT_READY)
+            {
+                break;
+            }
+
+            if (status == TcpSocket::Status::ERROR || received == 0)
+            {
+                // the server can't tell a truncated body from a complete one unless its connection is closed
+                LOG_DEBUG(m_logger, "error on relay_request_body::receive");
+                set_state(connection, ConnectionState::CLOSING);
+                return false;
+            }
+
+            add_counter(m_statistics.received_bytes, received);
+            const auto consumed = framer.consume(data, received);
+            body.commit(consumed);
+            has_moved = true;
+
+            // a pipelined request may follow the chunked body
+            input.append(data + consumed, received - consumed);
+        }
+
+        if (framer.get_status() == ResponseFramer::Status::ERROR)
+        {
+            LOG_DEBUG(m_logger, "malformed chunked request body");
+            reject_request_body(connection);
+            return false;
+        }
+    }
+
+    if (framer.is_done() && body.empty())
+    {
+        // the first byte of the response is waited for from the end of the request
+        connection->is_uploading = false;
+        if (!connection->response_header_received && connection->response_header.empty()
+                && connection->phase_start != Clock::time_point())
+        {
+            connection->phase_start = Clock::now();
+        }
+    }
+
+    set_server_writing(connection, !body.empty());
+    set_client_reading(connection, !framer.is_done() && body.size() < m_max_buffered_bytes);
+
+    // the deadline of the upload is kept through the events that move nothing, see update_timer
+    if (has_moved)
+    {
+        m_selector.get_timers().cancel(&connection->timer);
+    }
+    return true;
+}
+
+void Proxy::reject_request_body(Connection* connection)
+{
+    // the server gets no end of the body, so its connection is closed
+    stop_uploading(connection);
+    drop_server(connection);
+
+    // the error can't follow a part of the response
+    if (connection->response_header_received || !connection->buffer.empty())
+    {
+        set_state(connection, ConnectionState::CLOSING);
+        return;
+    }
+
+    // the end of the body can't be found -> 400 Bad Request
+    send_error(connection, "HTTP/1.0 400 Bad Request\r\n\r\n");
+}
+
+void Proxy::stop_uploading(Connection* connection)
+{
+    // the rest of the body is left unread in the client connection, so it can't carry the next request,
+    // the framer starts over, so the server isn't taken for having the whole request either
+    connection->is_uploading = false;
+    connection->client_keep_alive = false;
+    connection->request_body.clear();
+    connection->request_framer.reset();
+    set_server_writing(connection, false);
+    set_client_reading(connection, false);
+}
+
+void Proxy::process_request(Connection* connection)
+{
+    assert(connection->state == ConnectionState::RECEIVING_REQUEST);
+
+    // the parser resumes where it has stopped, so a request arriving in small pieces is scanned only once
+    auto& input = connection->input;
+    auto& parser = connection->parser;
+    const auto status = parser.parse(input.data(), input.size());
+    if (status == RequestParser::Status::INCOMPLETE)
+    {
+        if (input.size() > m_max_request_legnth)
+        {
+            // too large request, it must be an attack -> send 500 Internal Server Error
+            send_error(connection, "HTTP/1.0 500 Internal Server Error\r\n\r\n");
+        }
+
+        return;
+    }
+
+    HttpParser::Header header;
+    if (status == RequestParser::Status::DONE)
+    {
+        header = HttpParser::parse(parser, input.data());
+    }
+
+    if (!header)
+    {
+        // server can't parse request -> 400 Bad Request
+        send_error(connection, "HTTP/1.0 400 Bad Request\r\n\r\n");
+        return;
+    }
+
+    if (header.method != HttpParser::Method::GET && header.method != HttpParser::Method::POST
+            && header.method != HttpParser::Method::PUT)
+    {
+        // not suppoted -> 405 Method Not Allowed
+        send_error(connection, "HTTP/1.0 405 Method Not Allowed\r\n\r\n");
+        return;
+    }
+
+    const std::string request = input.substr(0, parser.get_header_size());
+    auto& framer = connection->request_framer;
+    if (!framer.start_request(request))
+    {
+        // the end of the body can't be found -> 400 Bad Request
+        send_error(connection, "HTTP/1.0 400 Bad Request\r\n\r\n");
+        return;
+    }
+
+    record_latency(Phase::REQUEST, connection->request_start, Clock::now());
+    connection->client_keep_alive = HttpParser::is_keep_alive(parser, input.data(), header);
+    connection->is_client_http_1_1 = header.version == HttpParser::Version::HTTP_1_1;
+
+    input.erase(0, parser.get_header_size());
+    parser.reset();
+
+    // the part of the body that has come with the header is sent with it, the rest is relayed as it arrives,
+    // so a body of any size is never held whole
+    const auto body_size = framer.consume(input.data(), input.size());
+    if (framer.get_status() == ResponseFramer::Status::ERROR)
+    {
+        send_error(connection, "HTTP/1.0 400 Bad Request\r\n\r\n");
+        return;
+    }
+
+    const std::string body = input.substr(0, body_size);
+    input.erase(0, body_size);
+    connection->is_uploading = !framer.is_done();
+    connection->is_repeatable = header.method == HttpParser::Method::GET && !connection->is_uploading;
+
+    connection->address = header.host;
+    connection->port = header.port;
+
+    // the address is looked up only if the record is written
+    LOG_INFO(m_logger, "NEW CLIENT Address : {} Port : {} URL : {}",
+             connection->request_socket.getRemoteAddress(), connection->request_socket.getRemotePort(), header.URI);
+
+    assert(connection->response_socket == nullptr);
+    connection->request = HttpParser::make_server_request(request + body, header, m_server_pool.is_enabled());
+
+    // only the responses to GET without a body are cached and shared
+    const bool may_cache = header.method == HttpParser::Method::GET && framer.get_framing() == ResponseFramer::Framing::NONE;
+    if (may_cache && (m_response_cache || m_disk_cache) && serve_from_cache(connection, header))
+    {
+        return;
+    }
+
+    if (may_cache && m_collapse_requests && collapse_request(connection, ResponseCache::make_key(header)))
+    {
+        return;
+    }
+
+    forward_request(connection);
+}
+
+void Proxy::forward_request(Connection* connection)
+{
+    connection->buffer.clear();
+    connection->buffer.append(connection->request);
+
+    auto socket = m_server_pool.checkout(connection->address, connection->port);
+    if (socket)
+    {
+        reuse_server(connection, std::move(socket));
+    }
+    else
+    {
+        resolve_address(connection);
+    }
+}
+
+bool Proxy::serve_from_cache(Connection* connection, const HttpParser::Header& header)
+{
+    // the request rewritten for the server has all the fields the cache looks at
+    const auto& request = connection->request;
+    auto key = ResponseCache::make_key(header);
+
+    // the memory cache is looked at first, the disk cache holds larger responses
+    const bool may_serve = ResponseCache::may_serve(request);
+    long age = 0;
+    auto response = may_serve && m_response_cache ? m_response_cache->find(key, request, &age) : nullptr;
+
+    DiskCache::Hit hit;
+    if (!response && (!may_serve || !m_disk_cache || !m_disk_cache->find(key, request, &hit)))
+    {
+        if (ResponseCache::may_store(request))
+        {
+            connection->cache_key = std::move(key);
+        }
+
+        return false;
+    }
+
+    // no server is involved, the response is sent right away
+    const auto& stored_header = response ? response->header : hit.header;
+    std::string client_header = HttpParser::make_client_response(stored_header, connection->client_keep_alive);
+    client_header.insert(client_header.find("\r\n") + 2, "Age: " + std::to_string(response ? age : hit.age) + "\r\n");
+    connection->buffer.clear();
+    connection->buffer.append(client_header);
+    if (response)
+    {
+        connection->cached_response = std::move(response);
+    }
+    else
+    {
+        connection->cached_file = std::move(hit);
+    }
+    set_state(connection, ConnectionState::SENDING_RESPONSE);
+    m_selector.change_mode(connection->request_socket, EPOLLOUT);
+    handle_sending_response(connection);
+    return true;
+}
+
+bool Proxy::collapse_request(Connection* connection, std::string key)
+{
+    // only the requests whose responses a shared cache may use are collapsed
+    const auto& request = connection->request;
+    if (!ResponseCache::may_serve(request) || !ResponseCache::may_store(request))
+    {
+        return false;
+    }
+
+    auto it = m_fetches.find(key);
+    if (it == m_fetches.end())
+    {
+        connection->fetch_key = key;
+        m_fetches.emplace(std::move(key), connection);
+        return false;
+    }
+
+    // the client is served when the response arrives, see start_sharing
+    connection->leader = it->second;
+    it->second->waiters.push_back(connection);
+    set_state(connection, ConnectionState::SHARING_RESPONSE);
+    return true;
+}
+
+void Proxy::send_error(Connection* connection, const std::string& message)
+{
+    // the message starts with the status line, "HTTP/1.x NNN"
+    const std::size_t status = message.size() > 12 ? std::strtoul(message.c_str() + 9, nullptr, 10) : 0;
+    if (status >= first_error_status && status < first_error_status + error_statuses_count)
+    {
+        add_counter(m_statistics.error_responses[status - first_error_status], 1);
+    }
+
+    set_state(connection, ConnectionState::SENDING_ERROR);
+    connection->buffer.clear();
+    connection->buffer.append(message);
+    m_selector.change_mode(connection->request_socket, EPOLLOUT);
+    handle_sending_error(connection);
+}
+
+void Proxy::handle_incoming_connection(const uint32_t events)
+{
+    LOG_DEBUG(m_logger, "handle_incoming_connection");
+
+    if (is_die_events(events))
+    {
+        LOG_DEBUG(m_logger, "{}", (events & EPOLLERR) ? "EPOLLERR" : "goodby");
+        m_selector.remove(m_server_socket);
+        return;
+    }
+
+    assert(events & EPOLLIN);
+
+    auto status = TcpSocket::Status::DONE;
+    while (true)
+    {
+        TcpSocket client_socket(-1);
+        if ( (status = m_server_socket.accept(&client_socket) ) != TcpSocket::Status::DONE)
+        {
+            break;
+        }
+
+        // a cached response goes out as a header and a body, with Nagle's algorithm the body would wait
+        // for the client's delayed acknowledgement of the header, up to 40 ms on Linux
+        client_socket.setNoDelay();
+
+        // the timer's handler captures no more than fits into std::function itself, so nothing is allocated for it
+        Connection* connection = m_connections.create(std::move(client_socket), &m_buffers);
+        connection->client_handler.bind(this, connection, false);
+        connection->server_handler.bind(this, connection, true);
+        m_selector.add(connection->request_socket, EPOLLIN, &connection->client_handler);
+        connection->timer.handler = [this, connection]() { handle_timeout(connection); };
+        connection->request_start = Clock::now();
+        update_timer(connection);
+        add_counter(m_statistics.accepted_connections, 1);
+        add_counter(m_statistics.connections_by_state[get_index(connection->state)], 1);
+    }
+
+    if (status == TcpSocket::Status::ERROR) { LOG_DEBUG(m_logger, "error on accept"); }
+
+}
+
+void Proxy::handle_connection(Connection* connection, const bool is_server_event, const uint32_t events)
+{
+    // pipelined requests are read only after the current response,
+    // so the client's input is of no interest while the server is being reached
+    const bool is_waiting_for_server = connection->state == ConnectionState::RESOLVING_ADDRESS
+            || connection->state == ConnectionState::CONNECTING_TO_SERVER
+            || connection->state == ConnectionState::SENDING_REQUEST;
+
+    if (is_server_event || !is_waiting_for_server)
+    {
+        auto handler = m_transitions[connection->state];
+        handler(this, connection);
+    }
+
+    // the handlers read the server until the end of stream or an error, so only
+    // the client's hang up needs to be handled here
+    if (connection->state != ConnectionState::CLOSING && !is_server_event && is_die_events(events))
+    {
+        LOG_DEBUG(m_logger, "{}", (events & EPOLLERR) ? "EPOLLERR" : "goodby");
+        set_state(connection, ConnectionState::CLOSING);
+    }
+
+    settle_connection(connection);
+}
+
+Proxy::SocketHandler::SocketHandler()
+    : m_proxy(nullptr)
+    , m_connection(nullptr)
+    , m_is_server(false)
+{}
+
+Proxy::SocketHandler::SocketHandler(SocketHandler&&)
+    : SocketHandler()
+{}
+
+Proxy::SocketHandler& Proxy::SocketHandler::operator= (SocketHandler&&) { return *this; }
+
+void Proxy::SocketHandler::bind(Proxy* proxy, Connection* connection, const bool is_server)
+{
+    m_proxy = proxy;
+    m_connection = connection;
+    m_is_server = is_server;
+}
+
+void Proxy::SocketHandler::handle_event(const uint32_t events)
+{
+    m_proxy->handle_connection(m_connection, m_is_server, events);
+}
+
+void Proxy::close_connection(Connection* connection)
+{
+    detach_waiter(connection);
+    auto successor = hand_over_fetch(connection);
+    finish_sharing(connection);
+    drop_server(connection);
+    m_pipes.release(&connection->pipe);
+
+    m_selector.remove(connection->request_socket);
+
+    add_counter(m_statistics.connections_by_state[get_index(connection->state)], -1);
+    m_connections.destroy(connection);
+    add_counter(m_statistics.closed_connections, 1);
+
+    // the response may be waiting in the socket already, so no event would come for it
+    if (successor != nullptr)
+    {
+        handle_receiving_response(successor);
+        settle_connection(successor);
+    }
+}
+
+void Proxy::fail_fetch(Connection* connection, const std::string& message)
+{
+    // the waiters would hardly be luckier with the same server, so they get the same answer
+    drop_server(connection);
+    if (!connection->fetch_key.empty())
+    {
+        m_fetches.erase(connection->fetch_key);
+        connection->fetch_key.clear();
+    }
+
+    std::vector<Connection*> waiters;
+    waiters.swap(connection->waiters);
+    for (auto waiter : waiters)
+    {
+        waiter->leader = nullptr;
+        send_error(waiter, message);
+        settle_connection(waiter);
+    }
+
+    send_error(connection, message);
+}
+
+void Proxy::drop_server(Connection* connection)
+{
+    if (connection->response_socket)
+    {
+        m_selector.remove(*connection->response_socket);
+        connection->response_socket.reset();
+        connection->is_server_reading = false;
+        connection->is_server_writing = false;
+    }
+
+    // the answer is dropped when it comes
+    connection->resolve_id = 0;
+}
+
+void Proxy::settle_connection(Connection* connection)
+{
+    if (connection->state == ConnectionState::CLOSING)
+    {
+        LOG_DEBUG(m_logger, "goodby");
+        close_connection(connection);
+        return;
+    }
+
+    update_timer(connection);
+}
+
+void Proxy::set_state(Connection* connection, const ConnectionState state)
+{
+    add_counter(m_statistics.connections_by_state[get_index(connection->state)], -1);
+    add_counter(m_statistics.connections_by_state[get_index(state)], 1);
+    connection->state = state;
+}
+
+void Proxy::record_latency(const Phase phase, const Clock::time_point start, const Clock::time_point end)
+{
+    m_statistics.latencies[static_cast<std::size_t>(phase)].record(end - start);
+}
+
+void Proxy::update_timer(Connection* connection)
+{
+    const auto timeout = get_timeout(connection);
+    auto& timers = m_selector.get_timers();
+    if (timeout == Timeout::NONE)
+    {
+        timers.cancel(&connection->timer);
+        connection->timeout = timeout;
+        return;
+    }
+
+    // the deadlines of a request and of reaching the server hold however the data trickles in,
+    // the transfer of the response only must not stall, an upload gets a new deadline when its body moves
+    const bool is_sliding = timeout == Timeout::READ || timeout == Timeout::SEND;
+    if (timeout == connection->timeout && !is_sliding && connection->timer.is_armed())
+    {
+        return;
+    }
+
+    // an upload stalls on the server while it hasn't taken what has come of the body
+    const bool is_client = timeout == Timeout::IDLE || timeout == Timeout::REQUEST || timeout == Timeout::SEND
+            || (timeout == Timeout::UPLOAD && connection->request_body.empty());
+    connection->timeout = timeout;
+    timers.arm(&connection->timer, is_client ? m_timeouts.client : m_timeouts.server);
+}
+
+Proxy::Timeout Proxy::get_timeout(const Connection* connection) const
+{
+    // while something is to be sent the client is waited for, otherwise the server
+    const bool has_output = !connection->buffer.empty() || connection->pipe.size != 0
+            || connection->cached_response || connection->cached_file.size != 0;
+
+    switch (connection->state)
+    {
+    case ConnectionState::RECEIVING_REQUEST:
+        return connection->input.empty() ? Timeout::IDLE : Timeout::REQUEST;
+    case ConnectionState::RESOLVING_ADDRESS:
+    case ConnectionState::CONNECTING_TO_SERVER:
+        return Timeout::CONNECT;
+    case ConnectionState::SENDING_REQUEST:
+        return Timeout::FIRST_BYTE;
+    case ConnectionState::RECEIVING_RESPONSE:
+        // the body of a request may take any time to come, but not a long pause
+        if (connection->is_uploading)
+        {
+            return Timeout::UPLOAD;
+        }
+
+        // a response held back by its waiters waits for them, they have their own deadlines
+        if (!connection->response_header_received)
+        {
+            return Timeout::FIRST_BYTE;
         }
+        return has_output ? Timeout::SEND : connection->is_server_reading ? Timeout::READ : Timeout::NONE;
+    case ConnectionState::SENDING_RESPONSE:
+    case ConnectionState::SENDING_ERROR:
+        return Timeout::SEND;
+    case ConnectionState::SHARING_RESPONSE:
+        // the leader keeps the time of the server
+        return connection->response_header_received && has_output ? Timeout::SEND : Timeout::NONE;
+    default:
+        return Timeout::NONE;
     }
 }
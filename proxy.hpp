@@ -2,56 +2,302 @@
 #define PROXY_HPP
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstddef>
 #include <utility>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <functional>
 #include <string>
 
 #include "tcpsocket.hpp"
 #include "selector.hpp"
 #include "httpparser.hpp"
+#include "requestparser.hpp"
+#include "responseframer.hpp"
+#include "responsecache.hpp"
+#include "diskcache.hpp"
 #include "logger.hpp"
+#include "pipepool.hpp"
+#include "bufferpool.hpp"
+#include "resolver.hpp"
+#include "dnscache.hpp"
+#include "upstreampool.hpp"
+#include "ipaddress.hpp"
+#include "timerwheel.hpp"
+#include "slabpool.hpp"
+#include "histogram.hpp"
 
 class Proxy final
 {
 public:
+    using Clock = std::chrono::steady_clock;
+
     enum class ConnectionState
     {
         RECEIVING_REQUEST,
+        RESOLVING_ADDRESS, // the first step of connecting, waits for the resolver
         CONNECTING_TO_SERVER,
         SENDING_REQUEST,
         RECEIVING_RESPONSE,
         SENDING_RESPONSE,
         SENDING_ERROR,
+        SHARING_RESPONSE,  // waits for the response of another connection to the same URL, sends it as it arrives
         CLOSING
     };
 
-    struct Connection
+    static const std::size_t states_count = static_cast<std::size_t>(ConnectionState::CLOSING) + 1;
+
+    // the parts of a request whose durations are counted in histograms
+    enum class Phase
     {
-        Connection()
-            : state(ConnectionState::RECEIVING_REQUEST)
-            , have_connect_called(false)
+        REQUEST,    // from the connection or the first byte of the request to its parsed header
+        DNS,        // the name lookup, a hit of the DNS cache takes no time
+        CONNECT,    // the TCP handshake with the server
+        FIRST_BYTE, // from the start of sending the request to the first byte of the response
+        TOTAL       // from the start of the request to the end of its response
+    };
+
+    static const std::size_t phases_count = static_cast<std::size_t>(Phase::TOTAL) + 1;
+
+    // the statuses of the errors the proxy answers with itself
+    static const std::size_t first_error_status = 400;
+    static const std::size_t error_statuses_count = 200;
+
+    // what the connection waits for, every kind has its own deadline
+    enum class Timeout
+    {
+        NONE,
+        IDLE,       // the next request on a keep-alive connection
+        REQUEST,    // the rest of a request header, from its first byte
+        CONNECT,    // resolving and connecting to the server
+        FIRST_BYTE, // the response header, from the start of sending the request
+        READ,       // the next part of the response body, restarts with every event
+        SEND,       // the client to take the next part of the response, restarts with every event
+        UPLOAD      // the next part of the request body, restarts when a part is relayed
+    };
+
+    struct Timeouts
+    {
+        Timeouts()
+            : client(std::chrono::seconds(30))
+            , server(std::chrono::seconds(30))
         {}
 
-        Connection(std::unique_ptr<TcpSocket>&& _clinet_socket)
+        // idle, request, send and upload while the client is waited for
+        std::chrono::milliseconds client;
+
+        // connect, first byte, read and upload while the server doesn't take the body
+        std::chrono::milliseconds server;
+    };
+
+    struct Connection;
+
+    // passes the events of a socket of the connection to the proxy, it is bound when the connection is accepted
+    // and stays bound, like the handler of the timer, when the connection starts over for the next request
+    class SocketHandler final : public Selector::Handler
+    {
+    public:
+        SocketHandler();
+
+        SocketHandler(SocketHandler&&);
+        SocketHandler& operator= (SocketHandler&&);
+
+        void bind(Proxy* proxy, Connection* connection, const bool is_server);
+
+        void handle_event(const uint32_t events) override;
+
+    private:
+        Proxy* m_proxy;
+        Connection* m_connection;
+        bool m_is_server;
+    };
+
+    // the fields handling of every event goes through come first, the ones used once for a request
+    // (the request itself, the addresses and caching) follow them, so an event touches a few cache lines
+    struct Connection
+    {
+        Connection(TcpSocket&& client_socket, BufferPool* buffer_pool)
             : state(ConnectionState::RECEIVING_REQUEST)
-            , request_socket(std::move(_clinet_socket))
-            , idx(0)
+            , timeout(Timeout::NONE)
             , have_connect_called(false)
+            , is_server_reading(false)
+            , is_server_writing(false)
+            , is_server_reused(false)
+            , client_keep_alive(false)
+            , is_client_http_1_1(false)
+            , is_uploading(false)
+            , is_repeatable(false)
+            , is_client_reading(false)
+            , response_header_received(false)
+            , response_is_complete(false)
+            , response_keep_alive(false)
+            , is_caching(false)
+            , is_disk_caching(false)
+            , request_socket(std::move(client_socket))
+            , buffer(buffer_pool)
+            , request_body(buffer_pool)
+            , resolve_id(0)
+            , leader(nullptr)
+            , cached_offset(0)
+            , port(0)
+            , server_address_index(0)
+            , request_start()
+            , phase_start()
+            , cache_lifetime(0)
+            , cache_age(0)
         {}
 
         ConnectionState state;
+        Timeout timeout;
+
+        bool have_connect_called;
+
+        // the server socket is watched for reading, it isn't while the client or a waiter has no room for more
+        bool is_server_reading;
+
+        // the server socket is watched for writing while the server can't take more of the request body
+        bool is_server_writing;
 
-        std::unique_ptr<TcpSocket> request_socket;
+        // the server connection is taken from the pool, the request is sent again over a new one if it is closed
+        bool is_server_reused;
+
+        bool client_keep_alive;
+
+        // an HTTP/1.0 client doesn't know interim responses, so they aren't sent to it, see RFC 7231 6.2
+        bool is_client_http_1_1;
+
+        // the request body is relayed to the server as it arrives, at the same time as the response to the client
+        bool is_uploading;
+
+        // only a GET that is kept whole may be sent again over a new connection, see RFC 7230 6.3.1
+        bool is_repeatable;
+
+        // the client socket is watched for reading the request body along with writing the response
+        bool is_client_reading;
+
+        bool response_header_received;
+        bool response_is_complete;
+        bool response_keep_alive;
+
+        bool is_caching;
+        bool is_disk_caching;
+
+        TcpSocket request_socket;
         std::unique_ptr<TcpSocket> response_socket;
 
+        SocketHandler client_handler;
+        SocketHandler server_handler;
+
+        // what is to be sent next, the request to the server or the response to the client
+        ChunkBuffer buffer;
+
+        // the received part of the request body that the server hasn't taken yet
+        ChunkBuffer request_body;
+
+        // non-zero while the address is being resolved, the handle of the connection
+        uint64_t resolve_id;
+
+        // concurrent requests for the same URL are collapsed: the first one goes to the server
+        // with the key registered in the proxy, the others wait for its response as waiters
+        // and get copies of it as it arrives, if the response may be shared
+        Connection* leader;
+        std::vector<Connection*> waiters;
+
+        // follows the response body once its header is received
+        ResponseFramer response_framer;
+
+        // follows the request body from the end of the request header
+        ResponseFramer request_framer;
+
+        // the body of a cached response is sent after the buffer straight from the memory cache
+        // or from the segment of the disk cache
+        std::shared_ptr<const ResponseCache::Response> cached_response;
+        std::size_t cached_offset;
+
+        // the body is moved from the server to the client through the pipe if splice is enabled
+        PipePool::Pipe pipe;
+
+        // the deadline of the current timeout, the handler is set once for the connection
+        TimerWheel::Timer timer;
+
         std::string address;
-        std::size_t idx;
-        std::string buffer;
+        uint16_t port;
 
-        bool have_connect_called;
+        // the addresses of the server are tried in turn until one of them accepts the connection
+        std::vector<IpAddress> server_addresses;
+        std::size_t server_address_index;
+
+        // the start of the request is not set while a keep-alive connection waits for the next one,
+        // the start of the phase moves from the lookup to the connect and to the first byte
+        Clock::time_point request_start;
+        Clock::time_point phase_start;
+
+        // the request rewritten for the server is kept to be sent again over a new connection
+        // and for the response cache to match the fields listed in Vary
+        std::string request;
+
+        // received from the client, but not processed yet, e.g. pipelined requests
+        std::string input;
+        RequestParser parser;
+
+        std::string fetch_key;
+
+        // the response header is kept only until its end is found
+        std::string response_header;
+
+        // not empty if the client allows to store the response, the response is copied
+        // while it is relayed and goes to the cache when it is complete,
+        // a response too large for the memory cache is written straight to the disk cache
+        std::string cache_key;
+        long cache_lifetime;
+        long cache_age;
+        std::string cache_header;
+        std::string cache_body;
+        DiskCache::Writer disk_writer;
+
+        DiskCache::Hit cached_file;
+    };
+
+    struct Counters
+    {
+        Counters()
+            : accepted_connections(0)
+            , active_connections(0)
+            , received_bytes(0)
+            , sent_bytes(0)
+            , collapsed_requests(0)
+            , timed_out_connections(0)
+            , connections_by_state()
+            , error_responses()
+        {}
+
+        Counters& operator+= (const Counters& other);
+
+        uint64_t accepted_connections;
+        uint64_t active_connections;
+        uint64_t received_bytes;
+        uint64_t sent_bytes;
+
+        // served from the response of another request to the same URL
+        uint64_t collapsed_requests;
+
+        uint64_t timed_out_connections;
+
+        uint64_t connections_by_state[states_count];
+
+        // indexed by the status less first_error_status
+        uint64_t error_responses[error_statuses_count];
+
+        LatencyHistogram::Snapshot latencies[phases_count];
+
+        BufferPool::Counters buffers;
+
+        // idle keep-alive connections to servers
+        UpstreamPool::Counters servers;
     };
 
 public:
@@ -64,45 +310,229 @@ public:
 
     void set_port(const uint16_t port);
 
+    // several proxies may listen on the same port, each of them in its own thread
+    void set_reuse_port(const bool reuse_port);
+
+    // relays response bodies with splice(2) without copying them to user space
+    void set_splice(const bool use_splice);
+
+    // must be called before start, returns the backend that is used, epoll if io_uring isn't available
+    Selector::Backend set_event_backend(const Selector::Backend backend);
+
+    // resolves names only from the file in the /etc/hosts format instead of DNS
+    bool set_hosts_file(const std::string& path);
+
+    // the cache may be shared by several proxies
+    void set_dns_cache(const std::shared_ptr<DnsCache>& dns_cache);
+
+    // the cache may be shared by several proxies
+    void set_response_cache(const std::shared_ptr<ResponseCache>& response_cache);
+
+    // the cache may be shared by several proxies, it must be opened already
+    void set_disk_cache(const std::shared_ptr<DiskCache>& disk_cache);
+
+    // idle keep-alive connections kept for every server, 0 disables reusing of connections
+    void set_max_idle_servers(const std::size_t max_idle_servers);
+
+    // concurrent requests for the same URL wait for one response from the server, enabled by default
+    void set_request_collapsing(const bool collapse_requests);
+
+    void set_timeouts(const Timeouts& timeouts);
+
+    // the most a connection holds of a response for its client, the server isn't read while the client
+    // or a request collapsed with it has no room for more, 64 KiB by default, the same bound holds
+    // for a request body, the client isn't read while the server doesn't take it
+    void set_max_buffered_bytes(const std::size_t max_buffered_bytes);
+
+    // may be called from any thread
+    Counters get_counters() const;
+
+    static const char* get_state_name(const ConnectionState state);
+    static const char* get_phase_name(const Phase phase);
+
+private:
+    // counters are written only by the thread running the proxy
+    struct Statistics
+    {
+        Statistics()
+            : accepted_connections(0)
+            , closed_connections(0)
+            , received_bytes(0)
+            , sent_bytes(0)
+            , collapsed_requests(0)
+            , timed_out_connections(0)
+        {
+            for (auto& connections : connections_by_state)
+            {
+                connections.store(0, std::memory_order_relaxed);
+            }
+            for (auto& responses : error_responses)
+            {
+                responses.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<uint64_t> accepted_connections;
+        std::atomic<uint64_t> closed_connections;
+        std::atomic<uint64_t> received_bytes;
+        std::atomic<uint64_t> sent_bytes;
+        std::atomic<uint64_t> collapsed_requests;
+        std::atomic<uint64_t> timed_out_connections;
+        std::atomic<uint64_t> connections_by_state[states_count];
+        std::atomic<uint64_t> error_responses[error_statuses_count];
+        LatencyHistogram latencies[phases_count];
+    };
+
 private:
     uint16_t m_port;
 
+    bool m_reuse_port;
+
+    bool m_use_splice;
+
+    bool m_collapse_requests;
+
+    Timeouts m_timeouts;
+
+    std::size_t m_max_buffered_bytes;
+
     std::atomic_bool m_running;
 
-    static const std::size_t m_size_of_buffer =  1024;
+    Statistics m_statistics;
+
+    // requests are received in chunks as well
+    static const std::size_t m_size_of_buffer = BufferPool::chunk_size;
 
     static const std::size_t m_max_request_legnth = 2048;
 
     TcpSocket m_server_socket;
 
-    using ID = std::pair<std::string, uint16_t>;
+    static const std::size_t m_max_idle_chunks = 1024;
+
+    // outlives the connections, all their buffers come from it
+    BufferPool m_buffers;
 
-    std::map<ID, Connection> m_connections;
+    static const std::size_t m_connections_per_slab = 64;
+
+    // connections never move, so pointers to them stay valid until they are closed,
+    // the closed ones are constructed again in the same memory for the next clients
+    SlabPool<Connection> m_connections;
 
     Selector m_selector;
 
+    Selector::MemberHandler<Proxy> m_incoming_handler;
+    Selector::MemberHandler<Proxy> m_resolved_handler;
+
+    static const std::size_t m_default_max_idle_servers = 8;
+
+    UpstreamPool m_server_pool;
+
+    // idle server connections are checked once in a while
+    static const std::chrono::seconds m_pool_check_period;
+
+    TimerWheel::Timer m_pool_timer;
+
     char m_buffer[m_size_of_buffer];
 
+    static const std::size_t m_max_idle_pipes = 64;
+
+    static const std::size_t m_pipe_capacity = 256 * 1024;
+
+    PipePool m_pipes;
+
     std::map < ConnectionState, std::function<void(Proxy*, Connection*)> > m_transitions;
 
     Logger m_logger;
 
-    static const uint16_t HTTP_PORT = 80;
+    static const std::size_t m_resolver_threads = 2;
+
+    Resolver m_resolver;
+
+    std::vector<Resolver::Result> m_resolved;
+
+    std::shared_ptr<DnsCache> m_dns_cache;
+
+    std::vector<IpAddress> m_cached_addresses;
+
+    std::shared_ptr<ResponseCache> m_response_cache;
+
+    std::shared_ptr<DiskCache> m_disk_cache;
+
+    // the connections fetching responses that other requests may wait for, keyed by URL
+    std::unordered_map<std::string, Connection*> m_fetches;
 
 private:
-    void handle_incoming_connection(const epoll_event &event);
-    void handle_connection(const epoll_event& event);
+    void handle_incoming_connection(const uint32_t events);
+    void handle_connection(Connection* connection, const bool is_server_event, const uint32_t events);
 
     void handle_connections();
 
+    void handle_resolved_addresses(const uint32_t events);
+
     void handle_receiving_request(Connection *connection);
+    void handle_resolving_address(Connection *connection);
     void handle_connecting_to_server(Connection *connection);
     void handle_sending_request(Connection *connection);
     void handle_receiving_response(Connection* connection);
     void handle_sending_response(Connection* connection);
     void handle_sending_error(Connection* connection);
+    void handle_sharing_response(Connection* connection);
+    void handle_timeout(Connection* connection);
+    void handle_pool_timer();
 
     void handle_received_data(Connection* connection, char* m_buffer, const std::size_t received);
+    // false if the connection has been closed or answered with an error
+    bool relay_request_body(Connection* connection);
+    void reject_request_body(Connection* connection);
+    void stop_uploading(Connection* connection);
+    void process_request(Connection* connection);
+    bool serve_from_cache(Connection* connection, const HttpParser::Header& header);
+    bool collapse_request(Connection* connection, std::string key);
+    void forward_request(Connection* connection);
+    void finish_request(Connection* connection);
+
+    void reuse_server(Connection* connection, std::unique_ptr<TcpSocket>&& socket);
+    // false if the closed server connection can't be helped, otherwise the request is sent again or answered with 502
+    bool retry_with_new_server(Connection* connection);
+    void resolve_address(Connection* connection);
+    void connect_to_server(Connection* connection, const std::vector<IpAddress>& addresses);
+    bool connect_to_next_address(Connection* connection);
+    void fail_fetch(Connection* connection, const std::string& message);
+
+    bool track_response(Connection* connection, const char* data, const std::size_t size);
+    void finish_response(Connection* connection);
+    void start_caching(Connection* connection, const std::string& header);
+    void cache_response(Connection* connection, const char* data, const std::size_t size);
+
+    void start_sharing(Connection* connection, const std::string& header, const bool is_delimited);
+    void share_response(Connection* connection, const char* data, const std::size_t size);
+    void finish_sharing(Connection* connection);
+    void detach_waiter(Connection* connection);
+    std::size_t get_sharing_room(const Connection* connection) const;
+    void resume_response(Connection* connection);
+    void set_server_reading(Connection* connection, const bool is_reading);
+    void set_server_writing(Connection* connection, const bool is_writing);
+    void set_client_reading(Connection* connection, const bool is_reading);
+    Connection* hand_over_fetch(Connection* connection);
+
+    // every change of the state goes through here, so the number of connections in every state is known
+    void set_state(Connection* connection, const ConnectionState state);
+    void record_latency(const Phase phase, const Clock::time_point start, const Clock::time_point end);
+
+    TcpSocket::Status send_buffer(ChunkBuffer* buffer, TcpSocket* socket);
+    TcpSocket::Status send_response(Connection* connection);
+    TcpSocket::Status receive_response(Connection* connection, const std::size_t max_size, std::size_t* received);
+
+    void check_response_framing(Connection* connection, const std::size_t consumed, const std::size_t received);
+    bool can_splice(const Connection* connection) const;
+
+    void drop_server(Connection* connection);
+    void close_connection(Connection* connection);
+
+    // closes the connection if it is over, otherwise arms the timer for its state
+    void settle_connection(Connection* connection);
+    void update_timer(Connection* connection);
+    Timeout get_timeout(const Connection* connection) const;
 
     void send_error(Connection* socket, const std::string& message);
 };
@@ -0,0 +1,213 @@
+#include "proxygroup.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+
+// getaddrinfo doesn't tell the time to live of the records, so it is fixed
+const auto dns_ttl = std::chrono::seconds(60);
+const auto dns_negative_ttl = std::chrono::seconds(5);
+
+// a single response may take no more than this part of the cache
+const std::size_t max_response_share = 8;
+
+}
+
+ProxyGroup::ProxyGroup(const uint16_t port, const std::size_t threads, const Logger& log)
+    : m_pin_threads(false)
+{
+    assert(threads > 0);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        m_proxies.push_back(std::make_unique<Proxy>(port, log));
+        m_proxies.back()->set_reuse_port(threads > 1);
+    }
+}
+
+ProxyGroup::~ProxyGroup() { join(); }
+
+void ProxyGroup::set_cpu_pinning(const bool pin_threads) { m_pin_threads = pin_threads; }
+
+void ProxyGroup::set_splice(const bool use_splice)
+{
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_splice(use_splice);
+    }
+}
+
+Selector::Backend ProxyGroup::set_event_backend(const Selector::Backend backend)
+{
+    for (auto& proxy : m_proxies)
+    {
+        if (proxy->set_event_backend(backend) != backend)
+        {
+            // all the threads use the same backend, so they behave alike
+            for (auto& other : m_proxies)
+            {
+                other->set_event_backend(Selector::Backend::EPOLL);
+            }
+            return Selector::Backend::EPOLL;
+        }
+    }
+
+    return backend;
+}
+
+bool ProxyGroup::set_hosts_file(const std::string& path)
+{
+    for (auto& proxy : m_proxies)
+    {
+        if (!proxy->set_hosts_file(path))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ProxyGroup::set_max_idle_servers(const std::size_t max_idle_servers)
+{
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_max_idle_servers(max_idle_servers);
+    }
+}
+
+void ProxyGroup::set_request_collapsing(const bool collapse_requests)
+{
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_request_collapsing(collapse_requests);
+    }
+}
+
+void ProxyGroup::set_timeouts(const Proxy::Timeouts& timeouts)
+{
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_timeouts(timeouts);
+    }
+}
+
+void ProxyGroup::set_max_buffered_bytes(const std::size_t max_buffered_bytes)
+{
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_max_buffered_bytes(max_buffered_bytes);
+    }
+}
+
+void ProxyGroup::set_dns_cache(const std::size_t max_entries)
+{
+    m_dns_cache = std::make_shared<DnsCache>(max_entries, dns_ttl, dns_negative_ttl);
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_dns_cache(m_dns_cache);
+    }
+}
+
+void ProxyGroup::set_response_cache(const std::size_t max_bytes)
+{
+    m_response_cache = std::make_shared<ResponseCache>(max_bytes, max_bytes / max_response_share);
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_response_cache(m_response_cache);
+    }
+}
+
+bool ProxyGroup::set_disk_cache(const std::string& directory, const uint64_t max_bytes)
+{
+    auto disk_cache = std::make_shared<DiskCache>(directory, max_bytes);
+    if (!disk_cache->open())
+    {
+        return false;
+    }
+
+    m_disk_cache = disk_cache;
+    for (auto& proxy : m_proxies)
+    {
+        proxy->set_disk_cache(m_disk_cache);
+    }
+    return true;
+}
+
+void ProxyGroup::start()
+{
+    assert(m_threads.empty());
+
+    for (std::size_t i = 0; i < m_proxies.size(); ++i)
+    {
+        auto proxy = m_proxies[i].get();
+        m_threads.emplace_back([proxy]() { proxy->start(); });
+
+        if (m_pin_threads)
+        {
+            pin_thread(m_threads.back(), i % default_threads_count());
+        }
+    }
+}
+
+void ProxyGroup::join()
+{
+    for (auto& thread : m_threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+Proxy::Counters ProxyGroup::get_counters() const
+{
+    Proxy::Counters counters;
+    for (const auto& proxy : m_proxies)
+    {
+        counters += proxy->get_counters();
+    }
+
+    return counters;
+}
+
+DnsCache::Counters ProxyGroup::get_dns_counters() const
+{
+    return m_dns_cache ? m_dns_cache->get_counters() : DnsCache::Counters();
+}
+
+ResponseCache::Counters ProxyGroup::get_cache_counters() const
+{
+    return m_response_cache ? m_response_cache->get_counters() : ResponseCache::Counters();
+}
+
+DiskCache::Counters ProxyGroup::get_disk_counters() const
+{
+    return m_disk_cache ? m_disk_cache->get_counters() : DiskCache::Counters();
+}
+
+std::size_t ProxyGroup::size() const { return m_proxies.size(); }
+
+std::size_t ProxyGroup::default_threads_count()
+{
+    const auto cpus = std::thread::hardware_concurrency();
+    return cpus == 0 ? 1 : cpus;
+}
+
+void ProxyGroup::pin_thread(std::thread& thread, const std::size_t cpu)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+
+    int return_code = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+    if (return_code != 0)
+    {
+        std::cerr << "pthread_setaffinity_np: " << std::strerror(return_code) << "\n";
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef PROXY_GROUP_HPP
+#define PROXY_GROUP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proxy.hpp"
+#include "logger.hpp"
+#include "dnscache.hpp"
+#include "responsecache.hpp"
+#include "diskcache.hpp"
+
+// Runs several independent proxies (one selector and one connection table each)
+// in their own threads, all of them listen on the same port with SO_REUSEPORT
+class ProxyGroup final
+{
+public:
+    ProxyGroup(const uint16_t port, const std::size_t threads, const Logger& log);
+    ~ProxyGroup();
+
+    ProxyGroup(const ProxyGroup&) = delete;
+    ProxyGroup& operator= (const ProxyGroup&) = delete;
+
+    // pins the i-th thread to the (i mod cpu count)-th cpu
+    void set_cpu_pinning(const bool pin_threads);
+
+    void set_splice(const bool use_splice);
+
+    // epoll if any of the proxies can't use io_uring
+    Selector::Backend set_event_backend(const Selector::Backend backend);
+
+    bool set_hosts_file(const std::string& path);
+
+    void set_max_idle_servers(const std::size_t max_idle_servers);
+
+    // requests are collapsed within every proxy, each of them fetches a hot URL once
+    void set_request_collapsing(const bool collapse_requests);
+
+    void set_timeouts(const Proxy::Timeouts& timeouts);
+
+    void set_max_buffered_bytes(const std::size_t max_buffered_bytes);
+
+    // one cache of resolved names is shared by all proxies of the group
+    void set_dns_cache(const std::size_t max_entries);
+
+    // one cache of responses is shared by all proxies of the group
+    void set_response_cache(const std::size_t max_bytes);
+
+    // one cache on disk is shared by all proxies of the group, false if the directory can't be used
+    bool set_disk_cache(const std::string& directory, const uint64_t max_bytes);
+
+    void start();
+    void join();
+
+    Proxy::Counters get_counters() const;
+
+    // all counters are zero if there is no cache
+    DnsCache::Counters get_dns_counters() const;
+
+    // all counters are zero if there is no cache
+    ResponseCache::Counters get_cache_counters() const;
+
+    // all counters are zero if there is no cache
+    DiskCache::Counters get_disk_counters() const;
+
+    std::size_t size() const;
+
+    static std::size_t default_threads_count();
+
+private:
+    void pin_thread(std::thread& thread, const std::size_t cpu);
+
+private:
+    bool m_pin_threads;
+
+    std::vector< std::unique_ptr<Proxy> > m_proxies;
+
+    std::shared_ptr<DnsCache> m_dns_cache;
+
+    std::shared_ptr<ResponseCache> m_response_cache;
+
+    std::shared_ptr<DiskCache> m_disk_cache;
+
+    std::vector<std::thread> m_threads;
+};
+
+#endif // PROXY_GROUP_HPP
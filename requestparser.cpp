@@ -0,0 +1,210 @@
+#include "requestparser.hpp"
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+
+// the characters of method and field names, RFC 7230 3.2.6
+struct TokenChars
+{
+    TokenChars()
+        : table()
+    {
+        for (int c = 0; c < 256; ++c)
+        {
+            table[c] = std::isalnum(c) || (c != 0 && std::strchr("!#$%&'*+-.^_`|~", c) != nullptr);
+        }
+    }
+
+    bool table[256];
+};
+
+const TokenChars token_chars;
+
+bool is_token_char(const char c) { return token_chars.table[static_cast<unsigned char>(c)]; }
+
+bool is_whitespace(const char c) { return c == ' ' || c == '\t'; }
+
+}
+
+const std::size_t RequestParser::max_fields;
+
+RequestParser::RequestParser()
+{
+    reset();
+}
+
+RequestParser::Status RequestParser::parse(const char* data, const std::size_t size)
+{
+    while (m_status == Status::INCOMPLETE)
+    {
+        auto lf = static_cast<const char*>(std::memchr(data + m_position, '\n', size - m_position));
+        if (lf == nullptr)
+        {
+            m_position = size;
+            break;
+        }
+
+        const std::size_t begin = m_line;
+        std::size_t end = lf - data;
+        m_position = end + 1;
+        m_line = m_position;
+
+        // the rest of the proxy looks for CRLF, so a line ending with a bare LF is refused
+        if (end == begin || data[end - 1] != '\r')
+        {
+            m_status = Status::ERROR;
+            break;
+        }
+        --end;
+
+        if (m_method.size == 0)
+        {
+            m_status = parse_request_line(data, begin, end) ? Status::INCOMPLETE : Status::ERROR;
+        }
+        else if (begin == end)
+        {
+            m_header_size = m_position;
+            m_status = Status::DONE;
+        }
+        else
+        {
+            m_status = parse_field(data, begin, end) ? Status::INCOMPLETE : Status::ERROR;
+        }
+    }
+
+    return m_status;
+}
+
+void RequestParser::reset()
+{
+    m_status = Status::INCOMPLETE;
+    m_line = 0;
+    m_position = 0;
+    m_header_size = 0;
+    m_method = Span();
+    m_target = Span();
+    m_version = Span();
+    m_fields_count = 0;
+}
+
+RequestParser::Status RequestParser::get_status() const { return m_status; }
+
+std::size_t RequestParser::get_header_size() const { return m_header_size; }
+
+const RequestParser::Span& RequestParser::get_method() const { return m_method; }
+
+const RequestParser::Span& RequestParser::get_target() const { return m_target; }
+
+const RequestParser::Span& RequestParser::get_version() const { return m_version; }
+
+const RequestParser::Field* RequestParser::get_fields() const { return m_fields; }
+
+std::size_t RequestParser::get_fields_count() const { return m_fields_count; }
+
+bool RequestParser::find_field(const char* data, const char* name, Span* value) const
+{
+    for (std::size_t i = 0; i < m_fields_count; ++i)
+    {
+        if (iequals(data, m_fields[i].name, name))
+        {
+            *value = m_fields[i].value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RequestParser::iequals(const char* data, const Span& span, const char* lowercase)
+{
+    std::size_t i = 0;
+    for (; i < span.size && lowercase[i] != '\0'; ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(data[span.offset + i])) != lowercase[i])
+        {
+            return false;
+        }
+    }
+
+    return i == span.size && lowercase[i] == '\0';
+}
+
+bool RequestParser::parse_request_line(const char* data, const std::size_t begin, const std::size_t end)
+{
+    // method SP request-target SP HTTP-version
+    std::size_t i = begin;
+    while (i < end && is_token_char(data[i]))
+    {
+        ++i;
+    }
+
+    if (i == begin || i == end || data[i] != ' ')
+    {
+        return false;
+    }
+    m_method = Span(begin, i - begin);
+
+    const std::size_t target = ++i;
+    while (i < end && data[i] != ' ' && !std::iscntrl(static_cast<unsigned char>(data[i])))
+    {
+        ++i;
+    }
+
+    if (i == target || i == end || data[i] != ' ')
+    {
+        return false;
+    }
+    m_target = Span(target, i - target);
+
+    const std::size_t version = ++i;
+    if (end - version != 8 // sizeof "HTTP/x.y"
+            || std::memcmp(data + version, "HTTP/", 5) != 0
+            || !std::isdigit(static_cast<unsigned char>(data[version + 5]))
+            || data[version + 6] != '.'
+            || !std::isdigit(static_cast<unsigned char>(data[version + 7])))
+    {
+        return false;
+    }
+    m_version = Span(version, end - version);
+
+    return true;
+}
+
+bool RequestParser::parse_field(const char* data, const std::size_t begin, const std::size_t end)
+{
+    // field-name ":" OWS field-value OWS, obsolete line folding is rejected
+    if (m_fields_count == max_fields)
+    {
+        return false;
+    }
+
+    std::size_t i = begin;
+    while (i < end && is_token_char(data[i]))
+    {
+        ++i;
+    }
+
+    if (i == begin || i == end || data[i] != ':')
+    {
+        return false;
+    }
+
+    Field& field = m_fields[m_fields_count++];
+    field.name = Span(begin, i - begin);
+
+    std::size_t value_begin = i + 1;
+    std::size_t value_end = end;
+    while (value_begin < value_end && is_whitespace(data[value_begin]))
+    {
+        ++value_begin;
+    }
+    while (value_end > value_begin && is_whitespace(data[value_end - 1]))
+    {
+        --value_end;
+    }
+    field.value = Span(value_begin, value_end - value_begin);
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef REQUEST_PARSER_HPP
+#define REQUEST_PARSER_HPP
+
+#include <cstddef>
+
+// Resumable parser of a request header. It is fed with the whole buffer received so far
+// and continues from the place where the previous call has stopped, so every byte is scanned once.
+// The results are spans into the buffer, the parser itself never allocates memory.
+class RequestParser final
+{
+public:
+    enum class Status
+    {
+        INCOMPLETE,
+        DONE,
+        ERROR
+    };
+
+    // offsets are taken from the beginning of the buffer,
+    // so the spans stay valid when the buffer is reallocated
+    struct Span
+    {
+        Span()
+            : offset(0)
+            , size(0)
+        {}
+
+        Span(const std::size_t _offset, const std::size_t _size)
+            : offset(_offset)
+            , size(_size)
+        {}
+
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    struct Field
+    {
+        Span name;
+        Span value; // without leading and trailing whitespaces
+    };
+
+    static const std::size_t max_fields = 64;
+
+public:
+    RequestParser();
+
+    // the buffer must start with the request and keep the bytes passed to the previous calls
+    Status parse(const char* data, const std::size_t size);
+
+    // forgets the request, the next one is expected at the beginning of the buffer
+    void reset();
+
+    Status get_status() const;
+
+    // the size of the request line and fields including the empty line, valid when DONE
+    std::size_t get_header_size() const;
+
+    const Span& get_method() const;
+    const Span& get_target() const;
+    const Span& get_version() const;
+
+    const Field* get_fields() const;
+    std::size_t get_fields_count() const;
+
+    // the value of the first field with the given name, the name must be in lower case
+    bool find_field(const char* data, const char* name, Span* value) const;
+
+    static bool iequals(const char* data, const Span& span, const char* lowercase);
+
+private:
+    bool parse_request_line(const char* data, const std::size_t begin, const std::size_t end);
+    bool parse_field(const char* data, const std::size_t begin, const std::size_t end);
+
+private:
+    Status m_status;
+
+    // the beginning of the current line and the place where the search for its end resumes
+    std::size_t m_line;
+    std::size_t m_position;
+
+    std::size_t m_header_size;
+
+    Span m_method;
+    Span m_target;
+    Span m_version;
+
+    Field m_fields[max_fields];
+    std::size_t m_fields_count;
+};
+
+#endif // REQUEST_PARSER_HPP
@@ -0,0 +1,166 @@
+#include "resolver.hpp"
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <utility>
+
+Resolver::Resolver(const std::size_t threads)
+    : m_backend(Backend::SYSTEM)
+    , m_stopped(false)
+{
+    m_event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event_fd == -1)
+    {
+        perror("eventfd");
+        return;
+    }
+
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        m_threads.emplace_back(&Resolver::run, this);
+    }
+}
+
+Resolver::~Resolver()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+    }
+    m_condition.notify_all();
+
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+
+    if (m_event_fd != -1)
+    {
+        ::close(m_event_fd);
+    }
+}
+
+bool Resolver::load_hosts_file(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "can't open hosts file " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::stringstream ss(line);
+        std::string address;
+        std::string name;
+        if (!(ss >> address))
+        {
+            continue;
+        }
+
+        while (ss >> name)
+        {
+            m_hosts[name].push_back(address);
+        }
+    }
+
+    m_backend = Backend::HOSTS_FILE;
+    return true;
+}
+
+Resolver::Backend Resolver::get_backend() const { return m_backend; }
+
+void Resolver::resolve(const uint64_t id, const std::string& host, const uint16_t port)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(Request{id, host, port});
+    }
+    m_condition.notify_one();
+}
+
+int Resolver::get_fd() const { return m_event_fd; }
+
+void Resolver::take_results(std::vector<Result>* results)
+{
+    // reading resets the counter, the results are taken afterwards so none of them is missed
+    uint64_t counter = 0;
+    if (::read(m_event_fd, &counter, sizeof(counter)) == -1 && errno != EAGAIN)
+    {
+        perror("read:take_results");
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::move(m_results.begin(), m_results.end(), std::back_inserter(*results));
+    m_results.clear();
+}
+
+void Resolver::run()
+{
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stopped || !m_requests.empty(); });
+            if (m_stopped)
+            {
+                return;
+            }
+
+            request = std::move(m_requests.front());
+            m_requests.pop_front();
+        }
+
+        Result result{request.id, request.host, request.port, lookup(request.host, request.port)};
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_results.push_back(std::move(result));
+        }
+
+        uint64_t one = 1;
+        if (::write(m_event_fd, &one, sizeof(one)) == -1)
+        {
+            perror("write:resolver");
+        }
+    }
+}
+
+std::vector<IpAddress> Resolver::lookup(const std::string& host, const uint16_t port) const
+{
+    std::vector<IpAddress> addresses(1);
+    if (IpAddress::from_numeric(host, port, &addresses.front()))
+    {
+        return addresses;
+    }
+    addresses.clear();
+
+    if (m_backend == Backend::SYSTEM)
+    {
+        return IpAddress::lookup(host, port);
+    }
+
+    auto it = m_hosts.find(host);
+    if (it != m_hosts.end())
+    {
+        for (const auto& numeric : it->second)
+        {
+            IpAddress address;
+            if (IpAddress::from_numeric(numeric, port, &address))
+            {
+                addresses.push_back(address);
+            }
+        }
+    }
+
+    return addresses;
+}
@@ -0,0 +1,89 @@
+#ifndef RESOLVER_HPP
+#define RESOLVER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ipaddress.hpp"
+
+// Resolves host names on its own threads so the event loop never blocks on DNS.
+// Finished lookups are collected with take_results, the descriptor returned by
+// get_fd becomes readable whenever there are results to take.
+class Resolver final
+{
+public:
+    enum class Backend
+    {
+        SYSTEM,     // getaddrinfo
+        HOSTS_FILE  // only names from the hosts file, no network at all
+    };
+
+    struct Result
+    {
+        uint64_t id;
+        std::string host;
+        uint16_t port;
+
+        // empty if the host can't be resolved
+        std::vector<IpAddress> addresses;
+    };
+
+public:
+    explicit Resolver(const std::size_t threads);
+    ~Resolver();
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator= (const Resolver&) = delete;
+
+    // reads "address name [aliases]" lines in the /etc/hosts format and switches to HOSTS_FILE backend
+    bool load_hosts_file(const std::string& path);
+
+    Backend get_backend() const;
+
+    void resolve(const uint64_t id, const std::string& host, const uint16_t port);
+
+    int get_fd() const;
+
+    // the results are appended to the vector
+    void take_results(std::vector<Result>* results);
+
+private:
+    struct Request
+    {
+        uint64_t id;
+        std::string host;
+        uint16_t port;
+    };
+
+private:
+    void run();
+
+    std::vector<IpAddress> lookup(const std::string& host, const uint16_t port) const;
+
+private:
+    Backend m_backend;
+
+    // the values are numeric addresses
+    std::unordered_map< std::string, std::vector<std::string> > m_hosts;
+
+    int m_event_fd;
+
+    bool m_stopped;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    std::deque<Request> m_requests;
+    std::vector<Result> m_results;
+
+    std::vector<std::thread> m_threads;
+};
+
+#endif // RESOLVER_HPP
@@ -0,0 +1,364 @@
+#include "responsecache.hpp"
+#include <time.h>
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+
+std::string to_lower(std::string str)
+{
+    for (auto& c : str)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    return str;
+}
+
+std::string trim(const std::string& str)
+{
+    auto begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+
+    return str.substr(begin, str.find_last_not_of(" \t") - begin + 1);
+}
+
+// the comma separated elements of a field value, e.g. Cache-Control directives or Vary names
+std::vector<std::string> split_list(const std::string& value)
+{
+    std::vector<std::string> elements;
+    std::size_t begin = 0;
+    while (begin <= value.size())
+    {
+        auto comma = std::min(value.find(',', begin), value.size());
+        auto element = trim(value.substr(begin, comma - begin));
+        if (!element.empty())
+        {
+            elements.push_back(to_lower(element));
+        }
+        begin = comma + 1;
+    }
+
+    return elements;
+}
+
+long to_seconds(std::string value)
+{
+    value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+    if (value.empty() || value.size() > 10 || !std::all_of(value.begin(), value.end(), ::isdigit))
+    {
+        return 0; // an invalid value makes the response stale
+    }
+
+    return std::stol(value);
+}
+
+// whether the Cache-Control field has the directive, its argument is stored if there is one
+bool find_directive(const std::string& message, const char* name, long* argument = nullptr)
+{
+    std::string cache_control;
+    if (!HttpParser::find_field(message, "cache-control", &cache_control))
+    {
+        return false;
+    }
+
+    for (const auto& directive : split_list(cache_control))
+    {
+        auto equal = directive.find('=');
+        if (trim(directive.substr(0, equal)) != name)
+        {
+            continue;
+        }
+
+        if (argument != nullptr)
+        {
+            *argument = equal == std::string::npos ? 0 : to_seconds(trim(directive.substr(equal + 1)));
+        }
+        return true;
+    }
+
+    return false;
+}
+
+// IMF-fixdate, the only format that servers must send
+bool parse_http_date(const std::string& value, std::time_t* time)
+{
+    std::tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+
+    const char* end = ::strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0')
+    {
+        return false;
+    }
+
+    *time = ::timegm(&tm);
+    return true;
+}
+
+// the header without the field, the name must be in lower case
+std::string remove_field(const std::string& header, const char* name)
+{
+    std::string result;
+    result.reserve(header.size());
+
+    const auto size = std::strlen(name);
+    std::size_t line = 0;
+    while (line < header.size())
+    {
+        auto end_of_line = header.find("\r\n", line);
+        end_of_line = end_of_line == std::string::npos ? header.size() : end_of_line + 2;
+
+        const bool is_removed = line != 0
+                && header.size() > line + size
+                && header[line + size] == ':'
+                && to_lower(header.substr(line, size)) == name;
+        if (!is_removed)
+        {
+            result.append(header, line, end_of_line - line);
+        }
+        line = end_of_line;
+    }
+
+    return result;
+}
+
+}
+
+ResponseCache::ResponseCache(const std::size_t max_bytes, const std::size_t max_response_bytes)
+    : m_max_bytes(max_bytes)
+    , m_max_response_bytes(std::min(max_bytes, max_response_bytes))
+    , m_bytes(0)
+{
+    assert(m_max_bytes > 0);
+}
+
+std::shared_ptr<const ResponseCache::Response> ResponseCache::find(const std::string& key, const std::string& request, long* age)
+{
+    const auto now = std::time(nullptr);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        ++m_counters.misses;
+        return nullptr;
+    }
+
+    auto entry = it->second;
+    if (entry->expires <= now)
+    {
+        erase(entry);
+        ++m_counters.misses;
+        return nullptr;
+    }
+
+    if (!matches_vary(entry->vary, request))
+    {
+        ++m_counters.misses;
+        return nullptr;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+    ++m_counters.hits;
+    m_counters.bytes_saved += entry->response->header.size() + entry->response->body.size();
+
+    *age = entry->age + static_cast<long>(now - entry->stored);
+    return entry->response;
+}
+
+void ResponseCache::insert(const std::string& key, const std::string& request, const std::string& header, std::string&& body,
+                           const long lifetime, const long age)
+{
+    if (header.size() + body.size() > m_max_response_bytes)
+    {
+        return;
+    }
+
+    Entry entry;
+    entry.key = key;
+
+    if (!get_vary(header, request, &entry.vary))
+    {
+        return;
+    }
+
+    auto response = std::make_shared<Response>();
+    response->header = header;
+    response->body = std::move(body);
+
+    entry.size = sizeof(Entry) + key.size() + response->header.size() + response->body.size();
+    for (const auto& field : entry.vary)
+    {
+        entry.size += field.first.size() + field.second.size();
+    }
+
+    entry.response = std::move(response);
+    entry.stored = std::time(nullptr);
+    entry.expires = entry.stored + (lifetime - age);
+    entry.age = age;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        erase(it->second);
+    }
+
+    m_bytes += entry.size;
+    m_entries.push_front(std::move(entry));
+    m_index[key] = m_entries.begin();
+    ++m_counters.stores;
+
+    while (m_bytes > m_max_bytes)
+    {
+        erase(std::prev(m_entries.end()));
+        ++m_counters.evictions;
+    }
+}
+
+std::size_t ResponseCache::get_max_response_bytes() const { return m_max_response_bytes; }
+
+ResponseCache::Counters ResponseCache::get_counters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto counters = m_counters;
+    counters.entries = m_entries.size();
+    counters.bytes = m_bytes;
+    return counters;
+}
+
+std::string ResponseCache::make_key(const HttpParser::Header& header)
+{
+    std::string key = "http://" + to_lower(header.host);
+    if (header.port != 80)
+    {
+        key += ":" + std::to_string(header.port);
+    }
+
+    // the full target with its trailing slash, the URI of the header is shortened for the log
+    return key + header.path;
+}
+
+bool ResponseCache::may_serve(const std::string& request)
+{
+    long max_age = 0;
+    if (find_directive(request, "no-cache") || find_directive(request, "no-store")
+            || (find_directive(request, "max-age", &max_age) && max_age == 0))
+    {
+        return false;
+    }
+
+    // HTTP/1.0 clients ask for a fresh response with Pragma
+    std::string pragma;
+    return !HttpParser::find_field(request, "pragma", &pragma) || to_lower(pragma).find("no-cache") == std::string::npos;
+}
+
+bool ResponseCache::may_store(const std::string& request)
+{
+    // responses to authorized requests are private to the client
+    std::string authorization;
+    return !find_directive(request, "no-store") && !HttpParser::find_field(request, "authorization", &authorization);
+}
+
+bool ResponseCache::get_lifetime(const std::string& header, long* lifetime, long* age)
+{
+    // the codes that are cacheable by default, RFC 7231 6.1
+    static const int cacheable_codes[] = { 200, 203, 300, 301, 404, 410 };
+    const int code = HttpParser::status_code(header);
+    if (std::find(std::begin(cacheable_codes), std::end(cacheable_codes), code) == std::end(cacheable_codes))
+    {
+        return false;
+    }
+
+    // a response that must be revalidated on every use is not worth storing without revalidation
+    std::string cookie;
+    if (find_directive(header, "no-store") || find_directive(header, "private") || find_directive(header, "no-cache")
+            || HttpParser::find_field(header, "set-cookie", &cookie))
+    {
+        return false;
+    }
+
+    const auto now = std::time(nullptr);
+    std::time_t date = now;
+    std::string value;
+    if (HttpParser::find_field(header, "date", &value))
+    {
+        parse_http_date(value, &date);
+    }
+
+    // s-maxage is meant for shared caches and overrides max-age, both override Expires
+    std::time_t expires = 0;
+    if (!find_directive(header, "s-maxage", lifetime) && !find_directive(header, "max-age", lifetime))
+    {
+        if (!HttpParser::find_field(header, "expires", &value) || !parse_http_date(value, &expires))
+        {
+            return false; // no explicit lifetime, an invalid Expires means the response is stale
+        }
+        *lifetime = static_cast<long>(expires - date);
+    }
+
+    *age = std::max(0L, static_cast<long>(now - date));
+    if (HttpParser::find_field(header, "age", &value))
+    {
+        *age = std::max(*age, to_seconds(value));
+    }
+
+    return *lifetime > *age;
+}
+
+std::string ResponseCache::make_stored_header(const std::string& header) { return remove_field(header, "age"); }
+
+bool ResponseCache::get_vary(const std::string& header, const std::string& request, Vary* vary)
+{
+    std::string names;
+    if (!HttpParser::find_field(header, "vary", &names))
+    {
+        return true;
+    }
+
+    for (const auto& name : split_list(names))
+    {
+        if (name == "*")
+        {
+            return false;
+        }
+
+        std::string value;
+        HttpParser::find_field(request, name.c_str(), &value);
+        vary->emplace_back(name, value);
+    }
+
+    return true;
+}
+
+bool ResponseCache::matches_vary(const Vary& vary, const std::string& request)
+{
+    for (const auto& field : vary)
+    {
+        std::string value;
+        HttpParser::find_field(request, field.first.c_str(), &value);
+        if (value != field.second)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ResponseCache::erase(Entries::iterator entry)
+{
+    m_bytes -= entry->size;
+    m_index.erase(entry->key);
+    m_entries.erase(entry);
+}
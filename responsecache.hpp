@@ -0,0 +1,125 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "httpparser.hpp"
+
+// Responses shared by all proxies, bounded by the number of bytes with LRU eviction.
+// Only responses that a shared cache may store according to Cache-Control and Expires are kept,
+// one variant per URI selected by the request fields listed in Vary.
+class ResponseCache final
+{
+public:
+    struct Counters
+    {
+        Counters()
+            : hits(0)
+            , misses(0)
+            , stores(0)
+            , evictions(0)
+            , bytes_saved(0)
+            , entries(0)
+            , bytes(0)
+        {}
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stores;
+        uint64_t evictions;
+        uint64_t bytes_saved; // served from the cache instead of being fetched from servers
+        uint64_t entries;
+        uint64_t bytes;
+    };
+
+    // the header is the server's one without the Age field
+    struct Response
+    {
+        std::string header;
+        std::string body;
+    };
+
+public:
+    ResponseCache(const std::size_t max_bytes, const std::size_t max_response_bytes);
+
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator= (const ResponseCache&) = delete;
+
+    // a fresh response to the request or nullptr, age is the number of seconds since the server has generated it
+    std::shared_ptr<const Response> find(const std::string& key, const std::string& request, long* age);
+
+    // the response must be complete, its header must come from make_stored_header,
+    // lifetime and age are the ones from get_lifetime
+    void insert(const std::string& key, const std::string& request, const std::string& header, std::string&& body,
+                const long lifetime, const long age);
+
+    std::size_t get_max_response_bytes() const;
+
+    Counters get_counters() const;
+
+    // the same resource has the same key whatever the case of the host and the default port,
+    // the path is kept as the client sent it, so /dir and /dir/ are different entries
+    static std::string make_key(const HttpParser::Header& header);
+
+    // whether the client allows to answer from the cache and to store the response
+    static bool may_serve(const std::string& request);
+    static bool may_store(const std::string& request);
+
+    // the freshness lifetime of the response and the age it already has in seconds,
+    // false if a shared cache must not store the response
+    static bool get_lifetime(const std::string& header, long* lifetime, long* age);
+
+    // the header without the Age field, the cache tells the age by itself
+    static std::string make_stored_header(const std::string& header);
+
+    using Vary = std::vector< std::pair<std::string, std::string> >;
+
+    // the names of the fields listed in Vary and their values in the request,
+    // false if the response can't be selected by request fields at all
+    static bool get_vary(const std::string& header, const std::string& request, Vary* vary);
+    static bool matches_vary(const Vary& vary, const std::string& request);
+
+private:
+    struct Entry
+    {
+        std::string key;
+
+        Vary vary;
+
+        std::shared_ptr<const Response> response;
+        std::time_t stored;
+        std::time_t expires;
+        long age;
+        std::size_t size;
+    };
+
+    using Entries = std::list<Entry>;
+
+private:
+    void erase(Entries::iterator entry);
+
+private:
+    std::size_t m_max_bytes;
+    std::size_t m_max_response_bytes;
+
+    mutable std::mutex m_mutex;
+
+    // the most recently used entries are at the front
+    Entries m_entries;
+    std::unordered_map<std::string, Entries::iterator> m_index;
+
+    std::size_t m_bytes;
+
+    Counters m_counters;
+};
+
+#endif // RESPONSE_CACHE_HPP
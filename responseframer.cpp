@@ -0,0 +1,304 @@
+#include "responseframer.hpp"
+#include "httpparser.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+
+int hex_value(const char c)
+{
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+// whether chunked is the last of the transfer codings
+bool is_chunked(std::string codings)
+{
+    for (auto& c : codings)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+
+    auto comma = codings.rfind(',');
+    auto begin = codings.find_first_not_of(" \t", comma == std::string::npos ? 0 : comma + 1);
+    auto end = codings.find_last_not_of(" \t");
+    return begin != std::string::npos && codings.compare(begin, end - begin + 1, "chunked") == 0;
+}
+
+}
+
+ResponseFramer::ResponseFramer()
+{
+    reset();
+}
+
+void ResponseFramer::reset(const bool is_head_request)
+{
+    m_status = Status::HEADER;
+    m_framing = Framing::CLOSE;
+    m_is_head_request = is_head_request;
+    m_remaining = 0;
+    m_chunk_state = ChunkState::SIZE;
+    m_has_chunk_size = false;
+}
+
+bool ResponseFramer::start(const std::string& header)
+{
+    // RFC 7230 3.3.3, these responses never have a body
+    const auto status_code = HttpParser::status_code(header);
+    if (m_is_head_request || status_code / 100 == 1 || status_code == 204 || status_code == 304)
+    {
+        m_framing = Framing::NONE;
+        m_status = Status::DONE;
+        return true;
+    }
+
+    // Transfer-Encoding overrides Content-Length
+    std::string codings;
+    if (HttpParser::find_field(header, "transfer-encoding", &codings))
+    {
+        m_framing = is_chunked(codings) ? Framing::CHUNKED : Framing::CLOSE;
+        m_status = Status::BODY;
+        return true;
+    }
+
+    std::string length;
+    if (HttpParser::find_field(header, "content-length", &length))
+    {
+        if (!HttpParser::content_length(header, &m_remaining))
+        {
+            start_close_delimited();
+            return false;
+        }
+
+        m_framing = Framing::LENGTH;
+        m_status = m_remaining == 0 ? Status::DONE : Status::BODY;
+        return true;
+    }
+
+    m_framing = Framing::CLOSE;
+    m_status = Status::BODY;
+    return true;
+}
+
+bool ResponseFramer::start_request(const std::string& header)
+{
+    // RFC 7230 3.3.3, a request body can't last until the end of connection, since the client waits for the response
+    std::string codings;
+    if (HttpParser::find_field(header, "transfer-encoding", &codings))
+    {
+        // a message framed both ways may be read differently by the server, so it's rejected as a smuggling attempt
+        std::string length;
+        if (!is_chunked(codings) || HttpParser::find_field(header, "content-length", &length))
+        {
+            return false;
+        }
+
+        m_framing = Framing::CHUNKED;
+        m_status = Status::BODY;
+        return true;
+    }
+
+    std::string length;
+    if (HttpParser::find_field(header, "content-length", &length))
+    {
+        if (!HttpParser::content_length(header, &m_remaining))
+        {
+            return false;
+        }
+
+        m_framing = m_remaining == 0 ? Framing::NONE : Framing::LENGTH;
+        m_status = m_remaining == 0 ? Status::DONE : Status::BODY;
+        return true;
+    }
+
+    m_framing = Framing::NONE;
+    m_status = Status::DONE;
+    return true;
+}
+
+void ResponseFramer::start_close_delimited()
+{
+    m_framing = Framing::CLOSE;
+    m_status = Status::BODY;
+}
+
+std::size_t ResponseFramer::consume(const char* data, const std::size_t size)
+{
+    if (m_status == Status::DONE)
+    {
+        return 0;
+    }
+
+    if (m_status != Status::BODY || m_framing == Framing::CLOSE)
+    {
+        return size;
+    }
+
+    if (m_framing == Framing::LENGTH)
+    {
+        const auto consumed = static_cast<std::size_t>(std::min<uint64_t>(size, m_remaining));
+        m_remaining -= consumed;
+        if (m_remaining == 0)
+        {
+            m_status = Status::DONE;
+        }
+        return consumed;
+    }
+
+    return consume_chunked(data, size);
+}
+
+std::size_t ResponseFramer::limit(const std::size_t size) const
+{
+    if (m_status == Status::BODY && m_framing == Framing::LENGTH)
+    {
+        return static_cast<std::size_t>(std::min<uint64_t>(size, m_remaining));
+    }
+
+    return size;
+}
+
+uint64_t ResponseFramer::get_remaining() const { return m_framing == Framing::LENGTH ? m_remaining : 0; }
+
+bool ResponseFramer::needs_data() const { return m_framing == Framing::CHUNKED && m_status == Status::BODY; }
+
+bool ResponseFramer::is_done() const { return m_status == Status::DONE; }
+
+ResponseFramer::Status ResponseFramer::get_status() const { return m_status; }
+
+ResponseFramer::Framing ResponseFramer::get_framing() const { return m_framing; }
+
+std::size_t ResponseFramer::consume_chunked(const char* data, const std::size_t size)
+{
+    // chunk-size [ chunk-ext ] CRLF chunk-data CRLF ... 0 CRLF trailer CRLF
+    std::size_t i = 0;
+    while (i < size && m_status == Status::BODY)
+    {
+        const char c = data[i];
+        switch (m_chunk_state)
+        {
+        case ChunkState::SIZE:
+        {
+            const int digit = hex_value(c);
+            if (digit >= 0 && (m_remaining >> 59) == 0)
+            {
+                m_remaining = m_remaining * 16 + digit;
+                m_has_chunk_size = true;
+            }
+            else if (m_has_chunk_size && (c == ';' || c == ' ' || c == '\t'))
+            {
+                m_chunk_state = ChunkState::EXTENSION;
+            }
+            else if (m_has_chunk_size && c == '\r')
+            {
+                m_chunk_state = ChunkState::SIZE_LF;
+            }
+            else if (m_has_chunk_size && c == '\n')
+            {
+                m_chunk_state = m_remaining == 0 ? ChunkState::TRAILER_START : ChunkState::DATA;
+            }
+            else
+            {
+                m_status = Status::ERROR;
+            }
+            ++i;
+            break;
+        }
+
+        case ChunkState::EXTENSION:
+            // the extensions are not interpreted
+            if (c == '\n')
+            {
+                m_chunk_state = m_remaining == 0 ? ChunkState::TRAILER_START : ChunkState::DATA;
+            }
+            ++i;
+            break;
+
+        case ChunkState::SIZE_LF:
+            if (c != '\n')
+            {
+                m_status = Status::ERROR;
+            }
+            m_chunk_state = m_remaining == 0 ? ChunkState::TRAILER_START : ChunkState::DATA;
+            ++i;
+            break;
+
+        case ChunkState::DATA:
+        {
+            // the data are skipped at once, they are not looked at
+            const auto skipped = static_cast<std::size_t>(std::min<uint64_t>(size - i, m_remaining));
+            m_remaining -= skipped;
+            i += skipped;
+            if (m_remaining == 0)
+            {
+                m_chunk_state = ChunkState::DATA_CR;
+            }
+            break;
+        }
+
+        case ChunkState::DATA_CR:
+            if (c == '\r')
+            {
+                m_chunk_state = ChunkState::DATA_LF;
+            }
+            else if (c == '\n')
+            {
+                m_chunk_state = ChunkState::SIZE;
+                m_has_chunk_size = false;
+            }
+            else
+            {
+                m_status = Status::ERROR;
+            }
+            ++i;
+            break;
+
+        case ChunkState::DATA_LF:
+            if (c != '\n')
+            {
+                m_status = Status::ERROR;
+            }
+            m_chunk_state = ChunkState::SIZE;
+            m_has_chunk_size = false;
+            ++i;
+            break;
+
+        case ChunkState::TRAILER_START:
+            // an empty line ends the trailer and the response
+            if (c == '\r')
+            {
+                m_chunk_state = ChunkState::TRAILER_LF;
+            }
+            else if (c == '\n')
+            {
+                m_status = Status::DONE;
+            }
+            else
+            {
+                m_chunk_state = ChunkState::TRAILER;
+            }
+            ++i;
+            break;
+
+        case ChunkState::TRAILER:
+            if (c == '\n')
+            {
+                m_chunk_state = ChunkState::TRAILER_START;
+            }
+            ++i;
+            break;
+
+        case ChunkState::TRAILER_LF:
+            m_status = c == '\n' ? Status::DONE : Status::ERROR;
+            ++i;
+            break;
+        }
+    }
+
+    // after an error nothing can be told about the rest, it is relayed as it is
+    return m_status == Status::ERROR ? size : i;
+}
@@ -0,0 +1,95 @@
+#ifndef RESPONSE_FRAMER_HPP
+#define RESPONSE_FRAMER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Finds the end of a response or of a request body. The header is inspected once, then the body is followed
+// by Content-Length, by the chunked transfer coding with its trailer or until the server closes connection.
+// Every byte of the body is looked at no more than once, the data of chunks are skipped at once.
+class ResponseFramer final
+{
+public:
+    enum class Framing
+    {
+        NONE,    // the response has no body
+        LENGTH,
+        CHUNKED,
+        CLOSE    // the body lasts until the end of connection
+    };
+
+    enum class Status
+    {
+        HEADER,  // waits for the header
+        BODY,
+        DONE,
+        ERROR    // the chunked body is malformed, the rest of the connection is the body
+    };
+
+public:
+    ResponseFramer();
+
+    // prepares for the next response, the bodies of responses to HEAD are always empty
+    void reset(const bool is_head_request = false);
+
+    // the complete header up to and including the empty line,
+    // returns false if the length of the body can't be determined
+    bool start(const std::string& header);
+
+    // a request body is followed in the same way, but without Content-Length or chunked coding
+    // a request has no body, returns false if its length can't be determined
+    // or it's framed both by Transfer-Encoding and Content-Length
+    bool start_request(const std::string& header);
+
+    // the header can't be inspected, so the body lasts until the end of connection
+    void start_close_delimited();
+
+    // returns how many of the bytes belong to the response, the rest must not be relayed,
+    // data may be nullptr if the body is not chunked
+    std::size_t consume(const char* data, const std::size_t size);
+
+    // the most bytes that can be read without touching the next response
+    std::size_t limit(const std::size_t size) const;
+
+    // the rest of the body with known length
+    uint64_t get_remaining() const;
+
+    // only the chunked body has to be seen, the others are counted
+    bool needs_data() const;
+
+    bool is_done() const;
+
+    Status get_status() const;
+    Framing get_framing() const;
+
+private:
+    enum class ChunkState
+    {
+        SIZE,
+        EXTENSION,
+        SIZE_LF,
+        DATA,
+        DATA_CR,
+        DATA_LF,
+        TRAILER_START,
+        TRAILER,
+        TRAILER_LF
+    };
+
+private:
+    std::size_t consume_chunked(const char* data, const std::size_t size);
+
+private:
+    Status m_status;
+    Framing m_framing;
+    bool m_is_head_request;
+
+    // the rest of the body or of the current chunk
+    uint64_t m_remaining;
+
+    ChunkState m_chunk_state;
+    bool m_has_chunk_size;
+};
+
+#endif // RESPONSE_FRAMER_HPP
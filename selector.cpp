@@ -1,61 +1,134 @@
 #include "selector.hpp"
-#include <iostream>
-#include <utility>
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
 
-Selector::Selector()
+Selector::Selector(const Logger& log)
     : m_size(0)
+    , m_next_event(0)
+    , m_events_count(0)
+    , m_logger(log)
 {
     m_selector_fd = epoll_create1(0);
     if (m_selector_fd == -1)
     {
-        std::cerr << "error in epoll_create\n";
+        LOG_ERROR(m_logger, "error in epoll_create");
         return;
     }
 }
 
-void Selector::add(const TcpSocket& socket, const uint32_t mode, const THandler& handler)
+Selector::~Selector()
 {
-    auto event = std::make_unique<epoll_event>();
-    event->data.fd = socket.m_socket_fd;
-    event->events = mode;
-    event->events |= EPOLLET; // always add edge-triggered mode
-    int return_code = epoll_ctl(m_selector_fd, EPOLL_CTL_ADD, socket.m_socket_fd, event.get());
-    if (return_code == -1)
+    if (m_selector_fd != -1)
     {
-        perror("epoll_ctl:add");
-        return;
+        ::close(m_selector_fd);
     }
-    m_events[socket.m_socket_fd] = Event(std::move(event), handler);
+}
+
+void Selector::add(const TcpSocket& socket, const uint32_t mode, Handler* handler)
+{
+    add(socket.m_socket_fd, mode, handler);
+}
+
+void Selector::remove(const TcpSocket& socket) { remove(socket.m_socket_fd); }
+
+void Selector::change_mode(const TcpSocket& socket, const uint32_t mode) { change_mode(socket.m_socket_fd, mode); }
+
+void Selector::add(const int fd, const uint32_t mode, Handler* handler)
+{
+    assert(fd >= 0 && handler != nullptr);
+    const auto index = static_cast<std::size_t>(fd);
+    if (m_ring)
+    {
+        if (index >= m_polls.size())
+        {
+            m_polls.resize(std::max(index + 1, m_polls.size() * 2), Poll{0, 0});
+        }
+        m_polls[index].mode = mode;
+        add_poll(fd);
+    }
+    else
+    {
+        epoll_event event = {};
+        event.data.ptr = handler;
+        event.events = mode;
+        event.events |= EPOLLET; // always add edge-triggered mode
+        int return_code = epoll_ctl(m_selector_fd, EPOLL_CTL_ADD, fd, &event);
+        if (return_code == -1)
+        {
+            perror("epoll_ctl:add");
+            return;
+        }
+    }
+
+    if (index >= m_handlers.size())
+    {
+        m_handlers.resize(std::max(index + 1, m_handlers.size() * 2), nullptr);
+    }
+    m_handlers[index] = handler;
     ++m_size;
-    m_buffer.reserve(m_size);
 }
 
-void Selector::remove(const TcpSocket& socket)
+void Selector::remove(const int fd)
 {
-    auto event_iterator = m_events.find(socket.m_socket_fd);
-    assert(event_iterator != m_events.end()); // you trying to delete socket that isn't in selector
+    const auto index = static_cast<std::size_t>(fd);
+    assert(index < m_handlers.size() && m_handlers[index] != nullptr); // you trying to delete socket that isn't in selector
 
-    auto event = event_iterator->second.m_event_ptr.get();
-    int return_code = epoll_ctl(m_selector_fd, EPOLL_CTL_DEL, socket.m_socket_fd, event);
-    if (return_code == -1)
+    if (m_ring)
     {
-        perror("epoll_ctl:remove");
-        return;
+        // the poll holds the file, so it goes on after the descriptor is closed until the removal is submitted,
+        // its completions are dropped by the generation
+        m_ring->remove_poll(get_poll_data(fd));
+        ++m_polls[index].generation;
+    }
+    else
+    {
+        // the kernel ignores the event argument of EPOLL_CTL_DEL
+        int return_code = epoll_ctl(m_selector_fd, EPOLL_CTL_DEL, fd, nullptr);
+        if (return_code == -1)
+        {
+            perror("epoll_ctl:remove");
+            return;
+        }
+    }
+
+    // the handler may be gone before the rest of the events of this iteration are dispatched
+    const auto handler = m_handlers[index];
+    for (auto i = m_next_event; i < m_events_count; ++i)
+    {
+        if (m_buffer[i].data.ptr == handler)
+        {
+            m_buffer[i].data.ptr = nullptr;
+        }
     }
-    m_events.erase(event_iterator);
+
+    m_handlers[index] = nullptr;
     --m_size;
 }
 
-void Selector::change_mode(const TcpSocket& socket, const uint32_t mode)
+void Selector::change_mode(const int fd, const uint32_t mode)
 {
-    auto event_iterator = m_events.find(socket.m_socket_fd);
-    assert(event_iterator != m_events.end()); // you trying to change socket that isn't in selector
+    const auto index = static_cast<std::size_t>(fd);
+    assert(index < m_handlers.size() && m_handlers[index] != nullptr); // you trying to change socket that isn't in selector
 
-    auto event = event_iterator->second.m_event_ptr.get();
-    event->events = mode;
-    event->events |= EPOLLET; // always add edge-triggered mode
-    int return_code = epoll_ctl(m_selector_fd, EPOLL_CTL_MOD, socket.m_socket_fd, event);
+    if (m_ring)
+    {
+        // the poll is updated in place and checks the descriptor again, just as EPOLL_CTL_MOD does
+        m_polls[index].mode = mode;
+        if (!m_ring->update_poll(get_poll_data(fd), mode, get_poll_data(fd) | m_update_flag))
+        {
+            LOG_ERROR(m_logger, "can't update the poll of {}", fd);
+        }
+        return;
+    }
+
+    epoll_event event = {};
+    event.data.ptr = m_handlers[index];
+    event.events = mode;
+    event.events |= EPOLLET; // always add edge-triggered mode
+    int return_code = epoll_ctl(m_selector_fd, EPOLL_CTL_MOD, fd, &event);
     if (return_code == -1)
     {
         perror("epoll_ctl:change_mode");
@@ -63,39 +136,143 @@ void Selector::change_mode(const TcpSocket& socket, const uint32_t mode)
     }
 }
 
-namespace
+bool Selector::do_iteration()
 {
+    // the handlers add sockets while the events are being dispatched,
+    // so the buffer grows only here and never under the loop below
+    if (m_buffer.size() < m_size)
+    {
+        m_buffer.resize(m_size);
+    }
 
-const auto default_handler = [](Selector*, const epoll_event&)
-{
-    std::cerr << "default handler\n";
-    /* nothing to do here */
-};
+    if (m_ring)
+    {
+        if (!m_ring->submit_and_wait(m_timers.get_timeout()))
+        {
+            return false;
+        }
+
+        take_completions();
+        dispatch();
+        m_timers.expire();
+        return true;
+    }
 
+    int n = ::epoll_wait(m_selector_fd, m_buffer.data(), m_buffer.size(), m_timers.get_timeout());
+    if (n >= 0)
+    {
+        m_events_count = static_cast<std::size_t>(n);
+        dispatch();
+        m_timers.expire();
+        return true;
+    }
+
+    // a signal is not an error, the timers may be due anyway
+    if (errno == EINTR)
+    {
+        m_timers.expire();
+        return true;
+    }
+
+    return false;
 }
 
-bool Selector::do_iteration()
+void Selector::dispatch()
 {
-    std::cout << "epoll wait " << m_size << std::endl;
-    int n = ::epoll_wait(m_selector_fd, m_buffer.data(), m_size, -1);
-    if (n >= 0)
+    for (m_next_event = 0; m_next_event < m_events_count; )
     {
-        auto events = m_buffer.data();
-        for (int i = 0; i < n; ++i)
+        // the index moves first, so removing the handler that is being called clears only the later events
+        const auto& event = m_buffer[m_next_event++];
+        if (event.data.ptr != nullptr)
         {
-            auto event_iterator = m_events.find(events[i].data.fd);
-            assert(event_iterator != m_events.end()); // something wrong with add
-            Event& event = event_iterator->second;
-            event.m_handler(events[i]);
+            static_cast<Handler*>(event.data.ptr)->handle_event(event.events);
         }
+    }
+    m_next_event = m_events_count = 0;
+}
 
-        return true;
+void Selector::take_completions()
+{
+    if (m_completions.size() < m_buffer.size())
+    {
+        m_completions.resize(m_buffer.size());
     }
 
-    return false;
+    const std::size_t count = m_ring->take_completions(m_completions.data(), m_completions.size());
+    m_events_count = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto& completion = m_completions[i];
+        const auto index = static_cast<std::size_t>(completion.user_data & ~m_update_flag & 0xffffffff);
+        const auto generation = static_cast<uint32_t>(completion.user_data >> 32);
+        if (index >= m_polls.size() || index >= m_handlers.size() || m_handlers[index] == nullptr
+                || m_polls[index].generation != generation)
+        {
+            continue;
+        }
+
+        if ((completion.user_data & m_update_flag) != 0)
+        {
+            // the poll was completing or had ended when the update came, it is replaced with a new one
+            if (completion.result < 0)
+            {
+                m_ring->remove_poll(get_poll_data(static_cast<int>(index)));
+                ++m_polls[index].generation;
+                add_poll(static_cast<int>(index));
+            }
+            continue;
+        }
+
+        // the kernel ends a multishot poll when it can't post a completion, then the poll is added again
+        if (completion.result >= 0 && !completion.has_more)
+        {
+            add_poll(static_cast<int>(index));
+        }
+
+        auto& event = m_buffer[m_events_count++];
+        event.events = completion.result >= 0 ? static_cast<uint32_t>(completion.result) : EPOLLERR;
+        event.data.ptr = m_handlers[index];
+    }
+}
+
+void Selector::add_poll(const int fd)
+{
+    if (!m_ring->add_poll(fd, m_polls[fd].mode, get_poll_data(fd)))
+    {
+        LOG_ERROR(m_logger, "can't add the poll of {}", fd);
+    }
+}
+
+uint64_t Selector::get_poll_data(const int fd) const
+{
+    return static_cast<uint64_t>(m_polls[fd].generation) << 32 | static_cast<uint32_t>(fd);
+}
+
+std::size_t Selector::size() const { return m_size; }
+
+Selector::Backend Selector::set_backend(const Backend backend)
+{
+    assert(m_size == 0); // the descriptors that are added already can't be moved to the other backend
+
+    if (backend == Backend::IO_URING_POLL && !m_ring)
+    {
+        std::unique_ptr<IoUring> ring(new IoUring());
+        if (ring->init(m_ring_entries))
+        {
+            m_ring = std::move(ring);
+            ::close(m_selector_fd);
+            m_selector_fd = -1;
+        }
+    }
+    else if (backend == Backend::EPOLL && m_ring)
+    {
+        m_ring.reset();
+        m_selector_fd = epoll_create1(0);
+    }
+
+    return get_backend();
 }
 
-Selector::Event::Event(std::unique_ptr<epoll_event>&& event_ptr, const THandler& handler)
-    : m_event_ptr(std::move(event_ptr))
-    , m_handler(handler)
-{}
+Selector::Backend Selector::get_backend() const { return m_ring ? Backend::IO_URING_POLL : Backend::EPOLL; }
+
+TimerWheel& Selector::get_timers() { return m_timers; }
@@ -1,43 +1,134 @@
 #ifndef SELECTOR_HPP
 #define SELECTOR_HPP
 
+#include "iouring.hpp"
+#include "logger.hpp"
 #include "tcpsocket.hpp"
+#include "timerwheel.hpp"
 #include <sys/epoll.h>
-#include <vector>
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
-#include <functional>
+#include <vector>
 
 class Selector final
 {
 public:
-    using THandler = std::function<void(const epoll_event& event)>;
+    // Told about the events of the descriptor it is added with. The handler lives in the object
+    // that owns the descriptor and epoll hands the pointer to it back with every event,
+    // so an event costs one virtual call without any lookup. It must stay in place until it is removed.
+    class Handler
+    {
+    public:
+        virtual void handle_event(const uint32_t events) = 0;
+
+    protected:
+        Handler() = default;
+        ~Handler() = default;
+    };
+
+    // calls a member function of the object that watches the descriptor
+    template <typename T>
+    class MemberHandler final : public Handler
+    {
+    public:
+        using Method = void (T::*)(const uint32_t events);
+
+        MemberHandler(T* object, const Method method)
+            : m_object(object)
+            , m_method(method)
+        {}
+
+        void handle_event(const uint32_t events) override { (m_object->*m_method)(events); }
+
+    private:
+        T* m_object;
+        Method m_method;
+    };
+
+    enum class Backend
+    {
+        EPOLL,
+
+        // multishot polls in io_uring, adding, removing and changing descriptors cost no system call,
+        // the requests are submitted in a batch with the next wait, the sockets are still read and written by the handlers
+        IO_URING_POLL
+    };
 
 public:
-    Selector();
+    // the logger reports the requests that the kernel refuses
+    explicit Selector(const Logger& log);
+    ~Selector();
 
-    void add(const TcpSocket& socket, const uint32_t mode, const THandler& handler);
+    Selector(const Selector&) = delete;
+    Selector& operator= (const Selector&) = delete;
+
+    void add(const TcpSocket& socket, const uint32_t mode, Handler* handler);
     void remove(const TcpSocket& socket);
     void change_mode(const TcpSocket& socket, const uint32_t mode);
+
+    // for descriptors that are not sockets, e.g. eventfd
+    void add(const int fd, const uint32_t mode, Handler* handler);
+    void remove(const int fd);
+    void change_mode(const int fd, const uint32_t mode);
     bool do_iteration();
 
+    // the number of added descriptors
+    std::size_t size() const;
+
+    // must be chosen before anything is added, epoll is kept if the kernel can't give io_uring,
+    // returns the backend that is used
+    Backend set_backend(const Backend backend);
+    Backend get_backend() const;
+
+    // the timers expire between the iterations, epoll_wait sleeps no longer than until the nearest one
+    TimerWheel& get_timers();
+
 private:
-    struct Event
-    {
-        Event() = default;
-        Event(std::unique_ptr<epoll_event>&& event_ptr, const THandler& handler);
+    // hands the events of the iteration to their handlers
+    void dispatch();
 
-        std::unique_ptr<epoll_event> m_event_ptr;
-        THandler m_handler;
-    };
+    // takes the completions of the polls as the events of the iteration
+    void take_completions();
+
+    // the poll of the descriptor's current generation
+    void add_poll(const int fd);
+    uint64_t get_poll_data(const int fd) const;
 
 private:
     int m_selector_fd;
     std::size_t m_size;
 
-    std::unordered_map< int, Event > m_events;
+    // the handler of every added descriptor, only adding, removing and changing look here
+    std::vector<Handler*> m_handlers;
 
     std::vector<epoll_event> m_buffer;
+
+    // the events of the current iteration that are not dispatched yet,
+    // a removed handler is cleared from them, so it never gets a stale event
+    std::size_t m_next_event;
+    std::size_t m_events_count;
+
+    TimerWheel m_timers;
+
+    Logger m_logger;
+
+    static const unsigned m_ring_entries = 1024;
+
+    std::unique_ptr<IoUring> m_ring;
+
+    // marks the user data of the updates of polls, descriptors never reach this bit
+    static const uint64_t m_update_flag = uint64_t(1) << 31;
+
+    // io_uring keeps the events and the generation of every descriptor, a completion of an older
+    // generation belongs to a poll that has been removed or replaced and is dropped
+    struct Poll
+    {
+        uint32_t mode;
+        uint32_t generation;
+    };
+
+    std::vector<Poll> m_polls;
+    std::vector<IoUring::Completion> m_completions;
 };
 
 #endif // SELECTOR_HPP
@@ -0,0 +1,204 @@
+// Replays a trace of requests through cache policies of several sizes and reports
+// hit ratio, byte hit ratio and the memory every policy needs besides the cached objects.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "policy.hpp"
+#include "trace.hpp"
+
+namespace
+{
+
+void usage(const char* name)
+{
+    std::cerr << "usage: " << name << " [-f format] [-p policies] [-c sizes] [-s bytes] [-o binary trace] trace\n"
+              << "  -f  format of the trace: auto, log, text or binary (auto by default)\n"
+              << "  -p  comma separated policies: lru, slru, tinylfu-lru, tinylfu-slru (all by default)\n"
+              << "  -c  comma separated cache sizes in bytes with optional K, M or G suffix\n"
+              << "      (1%, 5%, 10% and 25% of the distinct bytes of the trace by default)\n"
+              << "  -s  size of objects whose size is not in the trace (4096 by default)\n"
+              << "  -o  writes the trace in the binary format, it is read much faster\n";
+}
+
+std::vector<std::string> split(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::size_t begin = 0;
+    while (begin <= list.size())
+    {
+        auto comma = std::min(list.find(',', begin), list.size());
+        if (comma != begin)
+        {
+            items.push_back(list.substr(begin, comma - begin));
+        }
+        begin = comma + 1;
+    }
+    return items;
+}
+
+bool parse_size(const std::string& value, uint64_t* size)
+{
+    char* end = nullptr;
+    *size = std::strtoull(value.c_str(), &end, 10);
+    switch (*end)
+    {
+    case 'K': case 'k': *size <<= 10; ++end; break;
+    case 'M': case 'm': *size <<= 20; ++end; break;
+    case 'G': case 'g': *size <<= 30; ++end; break;
+    default: break;
+    }
+    return end != value.c_str() && *end == '\0' && *size != 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Trace::Format format = Trace::Format::AUTO;
+    std::vector<std::string> policies = { "lru", "slru", "tinylfu-lru", "tinylfu-slru" };
+    std::vector<uint64_t> sizes;
+    uint32_t default_size = 4096;
+    std::string binary_path;
+
+    int option = 0;
+    while ((option = ::getopt(argc, argv, "f:p:c:s:o:h")) != -1)
+    {
+        switch (option)
+        {
+        case 'f':
+        {
+            const std::string name = optarg;
+            format = name == "log" ? Trace::Format::LOG
+                    : name == "text" ? Trace::Format::TEXT
+                    : name == "binary" ? Trace::Format::BINARY : Trace::Format::AUTO;
+            break;
+        }
+        case 'p':
+            policies = split(optarg);
+            break;
+        case 'c':
+            for (const auto& item : split(optarg))
+            {
+                uint64_t size = 0;
+                if (!parse_size(item, &size))
+                {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                sizes.push_back(size);
+            }
+            break;
+        case 's':
+            default_size = static_cast<uint32_t>(std::stoul(optarg));
+            break;
+        case 'o':
+            binary_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Trace::Record> records;
+    auto start = std::chrono::steady_clock::now();
+    if (!Trace::read_trace(argv[optind], format, default_size, &records))
+    {
+        return EXIT_FAILURE;
+    }
+    std::chrono::duration<double> read_time = std::chrono::steady_clock::now() - start;
+
+    if (!binary_path.empty() && !Trace::write_trace(binary_path, records))
+    {
+        return EXIT_FAILURE;
+    }
+
+    uint64_t total_bytes = 0;
+    uint64_t distinct_bytes = 0;
+    std::unordered_map<uint64_t, uint32_t> objects(records.size() / 4 + 1);
+    for (const auto& record : records)
+    {
+        total_bytes += record.size;
+        if (objects.emplace(record.key, record.size).second)
+        {
+            distinct_bytes += record.size;
+        }
+    }
+
+    std::cout << "requests : " << records.size()
+              << " objects : " << objects.size()
+              << " bytes : " << total_bytes
+              << " distinct bytes : " << distinct_bytes
+              << " read in " << read_time.count() << " s" << std::endl;
+    if (records.empty())
+    {
+        return EXIT_SUCCESS;
+    }
+
+    if (sizes.empty())
+    {
+        for (const auto percent : { 1, 5, 10, 25 })
+        {
+            sizes.push_back(std::max<uint64_t>(distinct_bytes * percent / 100, 1));
+        }
+    }
+
+    const double average_size = static_cast<double>(distinct_bytes) / objects.size();
+
+    std::printf("%-13s | %12s | %9s | %14s | %9s | %14s | %15s | %9s\n", "policy", "cache bytes", "hit ratio", "byte hit ratio",
+                "entries", "overhead bytes", "overhead/entry", "Mreq/s");
+    for (const auto size : sizes)
+    {
+        for (const auto& name : policies)
+        {
+            auto policy = CachePolicy::create(name, size, static_cast<std::size_t>(size / average_size) + 1);
+            if (!policy)
+            {
+                std::cerr << "unknown policy " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            uint64_t hits = 0;
+            uint64_t hit_bytes = 0;
+            start = std::chrono::steady_clock::now();
+            for (const auto& record : records)
+            {
+                if (policy->access(record.key, record.size))
+                {
+                    ++hits;
+                    hit_bytes += record.size;
+                }
+            }
+            std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+            const auto entries = policy->get_entries();
+            std::printf("%-13s | %12llu | %9.4f | %14.4f | %9zu | %14zu | %15.1f | %9.2f\n",
+                        name.c_str(),
+                        static_cast<unsigned long long>(size),
+                        static_cast<double>(hits) / records.size(),
+                        total_bytes == 0 ? 0.0 : static_cast<double>(hit_bytes) / total_bytes,
+                        entries,
+                        policy->get_memory(),
+                        entries == 0 ? 0.0 : static_cast<double>(policy->get_memory()) / entries,
+                        records.size() / time.count() / 1e6);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,12 @@
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += cachesim.cpp \
+    policy.cpp \
+    trace.cpp
+
+HEADERS += \
+    policy.hpp \
+    trace.hpp
@@ -0,0 +1,341 @@
+#include "policy.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+
+const uint64_t golden_ratio = 0x9E3779B97F4A7C15ULL;
+
+// the odd multipliers of the sketch rows
+const uint64_t row_seeds[] = { 0xC3A5C85C97CB3127ULL, 0xB492B66FBE98F273ULL, 0x9AE16A3B2F90404FULL, 0xCBF29CE484222325ULL };
+
+std::size_t next_power_of_two(const std::size_t value)
+{
+    std::size_t power = 1;
+    while (power < value)
+    {
+        power <<= 1;
+    }
+    return power;
+}
+
+}
+
+KeyIndex::KeyIndex()
+    : m_slots(1024, Slot{0, 0})
+    , m_size(0)
+    , m_mask(1023)
+{}
+
+uint32_t KeyIndex::find(const uint64_t key) const
+{
+    for (auto slot = get_slot(key); ; slot = (slot + 1) & m_mask)
+    {
+        if (m_slots[slot].key == key)
+        {
+            return m_slots[slot].value;
+        }
+        if (m_slots[slot].key == 0)
+        {
+            return npos;
+        }
+    }
+}
+
+void KeyIndex::insert(const uint64_t key, const uint32_t value)
+{
+    assert(key != 0);
+    if ((m_size + 1) * 10 > m_slots.size() * 7)
+    {
+        grow();
+    }
+
+    auto slot = get_slot(key);
+    while (m_slots[slot].key != 0 && m_slots[slot].key != key)
+    {
+        slot = (slot + 1) & m_mask;
+    }
+
+    m_size += m_slots[slot].key == 0 ? 1 : 0;
+    m_slots[slot] = Slot{key, value};
+}
+
+void KeyIndex::erase(const uint64_t key)
+{
+    auto hole = get_slot(key);
+    while (m_slots[hole].key != key)
+    {
+        if (m_slots[hole].key == 0)
+        {
+            return;
+        }
+        hole = (hole + 1) & m_mask;
+    }
+
+    // the following keys of the run are shifted back, so no lookup stops at the hole
+    for (auto slot = (hole + 1) & m_mask; m_slots[slot].key != 0; slot = (slot + 1) & m_mask)
+    {
+        const auto home = get_slot(m_slots[slot].key);
+        const bool can_move = hole <= slot ? (home <= hole || home > slot) : (home <= hole && home > slot);
+        if (can_move)
+        {
+            m_slots[hole] = m_slots[slot];
+            hole = slot;
+        }
+    }
+
+    m_slots[hole].key = 0;
+    --m_size;
+}
+
+std::size_t KeyIndex::get_memory() const { return m_slots.capacity() * sizeof(Slot); }
+
+std::size_t KeyIndex::get_slot(const uint64_t key) const { return static_cast<std::size_t>((key * golden_ratio) >> 32) & m_mask; }
+
+void KeyIndex::grow()
+{
+    std::vector<Slot> slots(m_slots.size() * 2, Slot{0, 0});
+    slots.swap(m_slots);
+    m_mask = m_slots.size() - 1;
+    m_size = 0;
+
+    for (const auto& slot : slots)
+    {
+        if (slot.key != 0)
+        {
+            insert(slot.key, slot.value);
+        }
+    }
+}
+
+FrequencySketch::FrequencySketch(const std::size_t entries)
+    : m_mask(next_power_of_two(std::max<std::size_t>(entries, 64)) - 1)
+    , m_sample_size(10 * (m_mask + 1))
+    , m_additions(0)
+{
+    m_table.assign(m_depth * (m_mask + 1) / 16, 0);
+}
+
+void FrequencySketch::increment(const uint64_t key)
+{
+    bool is_added = false;
+    for (int row = 0; row < m_depth; ++row)
+    {
+        const auto counter = get_counter(key, row);
+        auto& word = m_table[counter / 16];
+        const auto shift = (counter % 16) * 4;
+        if (((word >> shift) & 0xF) != 0xF)
+        {
+            word += uint64_t(1) << shift;
+            is_added = true;
+        }
+    }
+
+    if (is_added && ++m_additions == m_sample_size)
+    {
+        age();
+    }
+}
+
+unsigned FrequencySketch::estimate(const uint64_t key) const
+{
+    unsigned frequency = 0xF;
+    for (int row = 0; row < m_depth; ++row)
+    {
+        const auto counter = get_counter(key, row);
+        frequency = std::min(frequency, static_cast<unsigned>((m_table[counter / 16] >> ((counter % 16) * 4)) & 0xF));
+    }
+    return frequency;
+}
+
+std::size_t FrequencySketch::get_memory() const { return m_table.capacity() * sizeof(uint64_t); }
+
+std::size_t FrequencySketch::get_counter(const uint64_t key, const int row) const
+{
+    const auto hash = static_cast<std::size_t>((key * row_seeds[row]) >> 32);
+    return row * (m_mask + 1) + (hash & m_mask);
+}
+
+void FrequencySketch::age()
+{
+    for (auto& word : m_table)
+    {
+        word = (word >> 1) & 0x7777777777777777ULL;
+    }
+    m_additions /= 2;
+}
+
+CachePolicy::CachePolicy(const std::string& name, const uint64_t capacity, const double protected_share, const bool use_sketch,
+                         const std::size_t expected_entries)
+    : m_name(name)
+    , m_capacity(capacity)
+    , m_protected_capacity(static_cast<uint64_t>(capacity * protected_share))
+{
+    if (use_sketch)
+    {
+        m_sketch.reset(new FrequencySketch(expected_entries));
+    }
+}
+
+bool CachePolicy::access(const uint64_t key, const uint32_t size)
+{
+    if (m_sketch)
+    {
+        m_sketch->increment(key);
+    }
+
+    const auto found = m_index.find(key);
+    if (found != KeyIndex::npos)
+    {
+        const auto segment = static_cast<Segment>(m_entries[found].segment);
+        unlink(found);
+
+        if (m_protected_capacity == 0 || m_entries[found].size > m_protected_capacity)
+        {
+            link(found, segment);
+            return true;
+        }
+
+        // the protected segment overflows to the probation one
+        link(found, PROTECTED);
+        auto& protected_list = m_lists[PROTECTED];
+        while (protected_list.bytes > m_protected_capacity)
+        {
+            const auto demoted = protected_list.tail;
+            unlink(demoted);
+            link(demoted, PROBATION);
+        }
+        return true;
+    }
+
+    if (size > m_capacity)
+    {
+        return false;
+    }
+
+    const auto bytes = m_lists[PROBATION].bytes + m_lists[PROTECTED].bytes;
+    if (m_sketch && bytes + size > m_capacity && m_sketch->estimate(key) <= m_sketch->estimate(m_entries[get_victim()].key))
+    {
+        return false;
+    }
+
+    while (m_lists[PROBATION].bytes + m_lists[PROTECTED].bytes + size > m_capacity)
+    {
+        evict(get_victim());
+    }
+
+    uint32_t entry = 0;
+    if (m_free_entries.empty())
+    {
+        entry = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+    else
+    {
+        entry = m_free_entries.back();
+        m_free_entries.pop_back();
+    }
+
+    m_entries[entry].key = key;
+    m_entries[entry].size = size;
+    link(entry, PROBATION);
+    m_index.insert(key, entry);
+    return false;
+}
+
+const std::string& CachePolicy::get_name() const { return m_name; }
+
+std::size_t CachePolicy::get_memory() const
+{
+    return m_entries.capacity() * sizeof(Entry) + m_free_entries.capacity() * sizeof(uint32_t)
+            + m_index.get_memory() + (m_sketch ? m_sketch->get_memory() : 0);
+}
+
+std::size_t CachePolicy::get_entries() const { return m_entries.size() - m_free_entries.size(); }
+
+std::unique_ptr<CachePolicy> CachePolicy::create(const std::string& name, const uint64_t capacity,
+                                                 const std::size_t expected_entries)
+{
+    // the protected segment takes 80% of the cache as in the TinyLFU paper
+    const double protected_share = 0.8;
+
+    std::unique_ptr<CachePolicy> policy;
+    if (name == "lru")
+    {
+        policy.reset(new CachePolicy(name, capacity, 0.0, false, expected_entries));
+    }
+    else if (name == "slru")
+    {
+        policy.reset(new CachePolicy(name, capacity, protected_share, false, expected_entries));
+    }
+    else if (name == "tinylfu-lru")
+    {
+        policy.reset(new CachePolicy(name, capacity, 0.0, true, expected_entries));
+    }
+    else if (name == "tinylfu-slru")
+    {
+        policy.reset(new CachePolicy(name, capacity, protected_share, true, expected_entries));
+    }
+
+    return policy;
+}
+
+void CachePolicy::link(const uint32_t entry, const Segment segment)
+{
+    auto& list = m_lists[segment];
+    auto& item = m_entries[entry];
+    item.segment = segment;
+    item.prev = KeyIndex::npos;
+    item.next = list.head;
+
+    if (list.head != KeyIndex::npos)
+    {
+        m_entries[list.head].prev = entry;
+    }
+    else
+    {
+        list.tail = entry;
+    }
+
+    list.head = entry;
+    list.bytes += item.size;
+}
+
+void CachePolicy::unlink(const uint32_t entry)
+{
+    auto& item = m_entries[entry];
+    auto& list = m_lists[item.segment];
+
+    if (item.prev != KeyIndex::npos)
+    {
+        m_entries[item.prev].next = item.next;
+    }
+    else
+    {
+        list.head = item.next;
+    }
+
+    if (item.next != KeyIndex::npos)
+    {
+        m_entries[item.next].prev = item.prev;
+    }
+    else
+    {
+        list.tail = item.prev;
+    }
+
+    list.bytes -= item.size;
+}
+
+void CachePolicy::evict(const uint32_t entry)
+{
+    unlink(entry);
+    m_index.erase(m_entries[entry].key);
+    m_free_entries.push_back(entry);
+}
+
+uint32_t CachePolicy::get_victim() const
+{
+    return m_lists[PROBATION].tail != KeyIndex::npos ? m_lists[PROBATION].tail : m_lists[PROTECTED].tail;
+}
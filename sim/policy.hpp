@@ -0,0 +1,148 @@
+#ifndef POLICY_HPP
+#define POLICY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Maps keys to entry indices with open addressing and linear probing, 0 is the empty key.
+// It is much faster than unordered_map for the millions of lookups of a replay.
+class KeyIndex final
+{
+public:
+    KeyIndex();
+
+    // returns npos if there is no key
+    uint32_t find(const uint64_t key) const;
+
+    void insert(const uint64_t key, const uint32_t value);
+    void erase(const uint64_t key);
+
+    std::size_t get_memory() const;
+
+    static const uint32_t npos = UINT32_MAX;
+
+private:
+    struct Slot
+    {
+        uint64_t key;
+        uint32_t value;
+    };
+
+private:
+    std::size_t get_slot(const uint64_t key) const;
+    void grow();
+
+private:
+    std::vector<Slot> m_slots;
+    std::size_t m_size;
+    std::size_t m_mask;
+};
+
+// Estimates how often keys are requested, a count-min sketch with four rows of 4-bit counters.
+// All counters are halved after every sample of the given number of requests, so the old popularity fades away.
+class FrequencySketch final
+{
+public:
+    // the sketch is sized for the number of entries the cache may hold
+    explicit FrequencySketch(const std::size_t entries);
+
+    void increment(const uint64_t key);
+    unsigned estimate(const uint64_t key) const;
+
+    std::size_t get_memory() const;
+
+private:
+    static const int m_depth = 4;
+
+    std::size_t get_counter(const uint64_t key, const int row) const;
+    void age();
+
+private:
+    // 16 counters in a word
+    std::vector<uint64_t> m_table;
+    std::size_t m_mask;
+    std::size_t m_sample_size;
+    std::size_t m_additions;
+};
+
+// Eviction and admission of a cache with a limit of bytes. Entries are evicted from the least recently used end.
+// Segmented LRU keeps the entries that were requested again in the protected segment, new entries
+// go to the probation segment and are evicted first. With the frequency sketch a new entry is admitted
+// only if it is requested more often than the entry it would evict (TinyLFU).
+class CachePolicy final
+{
+public:
+    // protected_share is the part of the cache for the protected segment, 0 makes plain LRU
+    CachePolicy(const std::string& name, const uint64_t capacity, const double protected_share, const bool use_sketch,
+                const std::size_t expected_entries);
+
+    CachePolicy(const CachePolicy&) = delete;
+    CachePolicy& operator= (const CachePolicy&) = delete;
+
+    // returns true on a hit
+    bool access(const uint64_t key, const uint32_t size);
+
+    const std::string& get_name() const;
+
+    // the memory the policy takes besides the cached objects
+    std::size_t get_memory() const;
+
+    std::size_t get_entries() const;
+
+    // the policies the simulator knows: lru, slru, tinylfu-lru, tinylfu-slru
+    static std::unique_ptr<CachePolicy> create(const std::string& name, const uint64_t capacity,
+                                               const std::size_t expected_entries);
+
+private:
+    enum Segment
+    {
+        PROBATION = 0,
+        PROTECTED = 1
+    };
+
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t size;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t segment;
+    };
+
+    struct List
+    {
+        List()
+            : head(KeyIndex::npos)
+            , tail(KeyIndex::npos)
+            , bytes(0)
+        {}
+
+        // the most recently used entry is the head
+        uint32_t head;
+        uint32_t tail;
+        uint64_t bytes;
+    };
+
+private:
+    void link(const uint32_t entry, const Segment segment);
+    void unlink(const uint32_t entry);
+    void evict(const uint32_t entry);
+    uint32_t get_victim() const;
+
+private:
+    std::string m_name;
+    uint64_t m_capacity;
+    uint64_t m_protected_capacity;
+
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_free_entries;
+    KeyIndex m_index;
+    List m_lists[2];
+
+    std::unique_ptr<FrequencySketch> m_sketch;
+};
+
+#endif // POLICY_HPP
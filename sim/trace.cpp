@@ -0,0 +1,163 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+
+const char magic[8] = { 'C', 'S', 'I', 'M', 'T', 'R', '1', '\n' };
+
+// the record is written without padding in the byte order of the host
+const std::size_t record_size = sizeof(uint64_t) + sizeof(uint32_t);
+
+const char log_marker[] = "NEW CLIENT ";
+const char url_marker[] = " URL : ";
+
+bool read_binary(std::ifstream& file, std::vector<Trace::Record>* records)
+{
+    char buffer[record_size * 4096];
+    while (file)
+    {
+        file.read(buffer, sizeof(buffer));
+        const auto size = static_cast<std::size_t>(file.gcount());
+        if (size % record_size != 0)
+        {
+            std::cerr << "the binary trace is truncated" << std::endl;
+            return false;
+        }
+
+        for (std::size_t i = 0; i < size; i += record_size)
+        {
+            Trace::Record record;
+            std::memcpy(&record.key, buffer + i, sizeof(record.key));
+            std::memcpy(&record.size, buffer + i + sizeof(record.key), sizeof(record.size));
+            records->push_back(record);
+        }
+    }
+
+    return true;
+}
+
+bool read_lines(std::ifstream& file, const bool is_log, const uint32_t default_size, std::vector<Trace::Record>* records)
+{
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (is_log)
+        {
+            if (line.find(log_marker) == std::string::npos)
+            {
+                continue; // the log has many other lines
+            }
+
+            auto url = line.find(url_marker);
+            if (url == std::string::npos)
+            {
+                continue;
+            }
+            url += sizeof(url_marker) - 1;
+
+            const auto end = line.find_first_of(" \r", url);
+            const auto size = (end == std::string::npos ? line.size() : end) - url;
+            records->push_back({ Trace::hash_url(line.data() + url, size), default_size });
+            continue;
+        }
+
+        const auto url = line.find_first_not_of(" \t");
+        if (url == std::string::npos || line[url] == '#')
+        {
+            continue;
+        }
+
+        const auto end = std::min(line.find_first_of(" \t\r", url), line.size());
+        uint32_t size = default_size;
+        if (end != line.size())
+        {
+            char* size_end = nullptr;
+            const auto value = std::strtoul(line.c_str() + end, &size_end, 10);
+            if (size_end != line.c_str() + end && value <= UINT32_MAX)
+            {
+                size = static_cast<uint32_t>(value);
+            }
+        }
+
+        records->push_back({ Trace::hash_url(line.data() + url, end - url), size });
+    }
+
+    return true;
+}
+
+}
+
+bool Trace::read_trace(const std::string& path, Format format, const uint32_t size, std::vector<Record>* records)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "can't open " << path << std::endl;
+        return false;
+    }
+
+    char head[sizeof(magic)] = {};
+    file.read(head, sizeof(head));
+    const bool has_magic = file.gcount() == sizeof(magic) && std::memcmp(head, magic, sizeof(magic)) == 0;
+
+    if (format == Format::AUTO)
+    {
+        // the first lines are enough to tell the log from the text
+        std::string start(head, static_cast<std::size_t>(file.gcount()));
+        start.resize(64 * 1024);
+        file.read(&start[file.gcount()], start.size() - file.gcount());
+        format = has_magic ? Format::BINARY
+                : start.find(log_marker) != std::string::npos ? Format::LOG : Format::TEXT;
+    }
+
+    if (format == Format::BINARY && !has_magic)
+    {
+        std::cerr << path << " is not a binary trace" << std::endl;
+        return false;
+    }
+
+    file.clear();
+    file.seekg(format == Format::BINARY ? sizeof(magic) : 0);
+    return format == Format::BINARY ? read_binary(file, records) : read_lines(file, format == Format::LOG, size, records);
+}
+
+bool Trace::write_trace(const std::string& path, const std::vector<Record>& records)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(magic, sizeof(magic));
+
+    char buffer[record_size];
+    for (const auto& record : records)
+    {
+        std::memcpy(buffer, &record.key, sizeof(record.key));
+        std::memcpy(buffer + sizeof(record.key), &record.size, sizeof(record.size));
+        file.write(buffer, sizeof(buffer));
+    }
+
+    file.flush();
+    if (!file)
+    {
+        std::cerr << "can't write " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t Trace::hash_url(const char* url, const std::size_t size)
+{
+    // FNV-1a, it is stable, so binary traces stay valid between builds
+    uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(url[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash == 0 ? 1 : hash;
+}
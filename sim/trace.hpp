@@ -0,0 +1,41 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A trace of requests replayed by the cache simulator. URLs are replaced with their hashes when the trace is read,
+// so the replay never touches strings. A trace is read from
+// - the proxy log, every "NEW CLIENT ... URL : url" line is a request,
+// - text, every line is "url [size]",
+// - the binary format written by write_trace, it is the fastest to read.
+namespace Trace
+{
+
+enum class Format
+{
+    AUTO,    // binary if the file starts with the magic, the proxy log if it has NEW CLIENT lines, text otherwise
+    LOG,
+    TEXT,
+    BINARY
+};
+
+struct Record
+{
+    uint64_t key;
+    uint32_t size;
+};
+
+// size is used for the requests without size, the proxy log has none
+bool read_trace(const std::string& path, const Format format, const uint32_t size, std::vector<Record>* records);
+
+bool write_trace(const std::string& path, const std::vector<Record>& records);
+
+// never returns 0, the simulator uses it as the empty key
+uint64_t hash_url(const char* url, const std::size_t size);
+
+}
+
+#endif // TRACE_HPP
@@ -0,0 +1,180 @@
+#ifndef SLAB_POOL_HPP
+#define SLAB_POOL_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Objects of one type kept in slabs of a fixed number of slots, an object never moves until it is destroyed.
+// Free slots are reused before a new slab is allocated and slabs are freed only with the pool,
+// so creating an object allocates nothing once the pool has grown to the peak number of objects.
+// A pool belongs to one thread.
+template <typename T>
+class SlabPool final
+{
+public:
+    // names an object together with the generation of its slot, so the handle of a destroyed object
+    // never finds the object created later in the same slot
+    struct Handle
+    {
+        Handle()
+            : index(0)
+            , generation(0)
+        {}
+
+        // one number for the ids of asynchronous requests, 0 is never the id of an object
+        uint64_t to_id() const { return (static_cast<uint64_t>(index) << 32) | generation; }
+
+        static Handle from_id(const uint64_t id)
+        {
+            Handle handle;
+            handle.index = static_cast<uint32_t>(id >> 32);
+            handle.generation = static_cast<uint32_t>(id);
+            return handle;
+        }
+
+        uint32_t index;
+        uint32_t generation;
+    };
+
+public:
+    explicit SlabPool(const std::size_t slab_size)
+        : m_slab_size(slab_size)
+        , m_free(m_none)
+        , m_size(0)
+    {
+        assert(slab_size != 0);
+    }
+
+    ~SlabPool()
+    {
+        for (std::size_t index = 0; index < m_slabs.size() * m_slab_size; ++index)
+        {
+            auto& slot = get_slot(index);
+            if (is_used(slot))
+            {
+                get_object(slot)->~T();
+            }
+        }
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator= (const SlabPool&) = delete;
+
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        if (m_free == m_none)
+        {
+            add_slab();
+        }
+
+        // the slot is taken only when the object is constructed
+        auto& slot = get_slot(m_free);
+        new (&slot.storage) T(std::forward<Args>(args)...);
+        m_free = slot.next_free;
+        ++slot.generation;
+        ++m_size;
+        return get_object(slot);
+    }
+
+    void destroy(T* object)
+    {
+        auto& slot = get_slot(object);
+        assert(is_used(slot));
+        object->~T();
+
+        // the most recently used slot is taken first, its memory is likely to be in the cache yet
+        ++slot.generation;
+        slot.next_free = m_free;
+        m_free = slot.index;
+        --m_size;
+    }
+
+    Handle get_handle(const T* object) const
+    {
+        const auto& slot = get_slot(object);
+        Handle handle;
+        handle.index = slot.index;
+        handle.generation = slot.generation;
+        return handle;
+    }
+
+    // nullptr if the object is destroyed already
+    T* find(const Handle handle) const
+    {
+        if (handle.index >= m_slabs.size() * m_slab_size)
+        {
+            return nullptr;
+        }
+
+        auto& slot = get_slot(handle.index);
+        return is_used(slot) && slot.generation == handle.generation ? get_object(slot) : nullptr;
+    }
+
+    std::size_t size() const { return m_size; }
+
+    std::size_t capacity() const { return m_slabs.size() * m_slab_size; }
+
+private:
+    // the object comes first, so a pointer to the object is a pointer to its slot
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        // odd while the slot holds an object, a slot has to be reused 2^31 times to repeat a handle
+        uint32_t generation;
+        uint32_t index;
+        uint32_t next_free;
+    };
+
+    static const uint32_t m_none = UINT32_MAX;
+
+private:
+    static bool is_used(const Slot& slot) { return (slot.generation & 1) != 0; }
+
+    static T* get_object(Slot& slot) { return reinterpret_cast<T*>(&slot.storage); }
+
+    Slot& get_slot(const std::size_t index) const { return m_slabs[index / m_slab_size][index % m_slab_size]; }
+
+    Slot& get_slot(const T* object) const
+    {
+        return *reinterpret_cast<Slot*>(const_cast<T*>(object));
+    }
+
+    void add_slab()
+    {
+        assert(m_slabs.size() * m_slab_size + m_slab_size <= m_none);
+        const auto first = static_cast<uint32_t>(m_slabs.size() * m_slab_size);
+        m_slabs.emplace_back(new Slot[m_slab_size]);
+
+        // the slots of the slab are taken in order of addresses
+        for (std::size_t i = m_slab_size; i-- != 0; )
+        {
+            auto& slot = m_slabs.back()[i];
+            slot.generation = 0;
+            slot.index = first + static_cast<uint32_t>(i);
+            slot.next_free = m_free;
+            m_free = slot.index;
+        }
+    }
+
+private:
+    std::size_t m_slab_size;
+
+    std::vector< std::unique_ptr<Slot[]> > m_slabs;
+
+    uint32_t m_free;
+
+    std::size_t m_size;
+};
+
+template <typename T>
+const uint32_t SlabPool<T>::m_none;
+
+#endif // SLAB_POOL_HPP
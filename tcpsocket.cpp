@@ -1,10 +1,15 @@
 #include "tcpsocket.hpp"
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <iostream>
 #include <cassert>
 #include <cerrno>
 #include <cstdio>
+#include <utility>
 
 TcpSocket::TcpSocket() : TcpSocket(-1)
 {
@@ -34,10 +39,34 @@ TcpSocket::~TcpSocket()
     }
 }
 
+TcpSocket::TcpSocket(TcpSocket&& other)
+    : TcpSocket(-1)
+{
+    *this = std::move(other);
+}
+
+TcpSocket& TcpSocket::operator= (TcpSocket&& other)
+{
+    if (this != &other)
+    {
+        if (m_socket_fd != -1)
+        {
+            ::close(m_socket_fd);
+        }
+
+        m_socket_fd = other.m_socket_fd;
+        m_is_bound = other.m_is_bound;
+        m_remote_port = other.m_remote_port;
+        m_remote_host = std::move(other.m_remote_host);
+        other.m_socket_fd = -1;
+    }
+    return *this;
+}
+
 TcpSocket::Status TcpSocket::connect(const IpAddress& remoteAddress)
 {
     assert(m_socket_fd != -1);
-    addrinfo* address = remoteAddress.get_address_info();
+    const addrinfo* address = remoteAddress.get_address_info();
     if (address == nullptr) {
         return Status::ERROR;
     }
@@ -86,6 +115,13 @@ TcpSocket::Status TcpSocket::isConnected() const
     return Status::DONE;
 }
 
+bool TcpSocket::isAlive() const
+{
+    char byte = 0;
+    int code = ::recv(m_socket_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+    return code == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
 TcpSocket::Status TcpSocket::listen()
 {
     assert(m_is_bound);
@@ -114,7 +150,11 @@ TcpSocket::Status TcpSocket::bind(const IpAddress& remoteAddress)
 {
     assert(!m_is_bound);
 
-    addrinfo* address = remoteAddress.get_address_info();
+    const addrinfo* address = remoteAddress.get_address_info();
+    if (address == nullptr) {
+        return Status::ERROR;
+    }
+
     int return_code = ::bind(m_socket_fd, address->ai_addr, address->ai_addrlen);
     if (return_code == 0)
     {
@@ -128,6 +168,34 @@ TcpSocket::Status TcpSocket::bind(const IpAddress& remoteAddress)
 
 TcpSocket::Status TcpSocket::bind(const uint16_t port) { return bind(IpAddress("", port)); }
 
+TcpSocket::Status TcpSocket::setReusePort()
+{
+    assert(!m_is_bound);
+
+    int optval = 1;
+    int return_code = ::setsockopt(m_socket_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+    if (return_code == 0)
+    {
+        return Status::DONE;
+    }
+
+    perror("setsockopt:setReusePort");
+    return Status::ERROR;
+}
+
+TcpSocket::Status TcpSocket::setNoDelay()
+{
+    int optval = 1;
+    int return_code = ::setsockopt(m_socket_fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    if (return_code == 0)
+    {
+        return Status::DONE;
+    }
+
+    perror("setsockopt:setNoDelay");
+    return Status::ERROR;
+}
+
 TcpSocket::Status TcpSocket::accept(TcpSocket* client)
 {
     sockaddr in_address;
@@ -196,6 +264,62 @@ TcpSocket::Status TcpSocket::receive(char* data, const std::size_t size, std::si
     return Status::DONE;
 }
 
+TcpSocket::Status TcpSocket::sendFromPipe(const int pipe_fd, const std::size_t size, std::size_t* sent)
+{
+    auto code = ::splice(pipe_fd, nullptr, m_socket_fd, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (code == -1)
+    {
+        if (errno == EAGAIN)
+        {
+            return Status::NOT_READY;
+        }
+
+        perror("splice:sendFromPipe");
+        return Status::ERROR;
+    }
+
+    *sent = code;
+    return Status::DONE;
+}
+
+TcpSocket::Status TcpSocket::receiveToPipe(const int pipe_fd, const std::size_t size, std::size_t* received)
+{
+    auto code = ::splice(m_socket_fd, nullptr, pipe_fd, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (code == -1)
+    {
+        if (errno == EAGAIN)
+        {
+            return Status::NOT_READY;
+        }
+
+        perror("splice:receiveToPipe");
+        return Status::ERROR;
+    }
+
+    *received = code;
+    return Status::DONE;
+}
+
+TcpSocket::Status TcpSocket::sendFile(const int file_fd, uint64_t* offset, const std::size_t size, std::size_t* sent)
+{
+    off_t file_offset = static_cast<off_t>(*offset);
+    auto code = ::sendfile(m_socket_fd, file_fd, &file_offset, size);
+    if (code == -1)
+    {
+        if (errno == EAGAIN)
+        {
+            return Status::NOT_READY;
+        }
+
+        perror("sendfile:sendFile");
+        return Status::ERROR;
+    }
+
+    *offset = static_cast<uint64_t>(file_offset);
+    *sent = code;
+    return Status::DONE;
+}
+
 uint16_t TcpSocket::getRemotePort() const { return m_remote_port; }
 
 std::string TcpSocket::getRemoteAddress() const { return m_remote_host; }
@@ -21,20 +21,44 @@ public:
     TcpSocket(int file_descriptor);
     virtual ~TcpSocket();
 
+    // the descriptor goes to the new socket, the moved one is left without any
+    TcpSocket(TcpSocket&& other);
+    TcpSocket& operator= (TcpSocket&& other);
+
+    TcpSocket(const TcpSocket&) = delete;
+    TcpSocket& operator= (const TcpSocket&) = delete;
+
     Status connect(const IpAddress& remoteAddress);
     Status isConnected() const;
 
+    // an idle connection is alive if the peer has neither closed it nor sent anything
+    bool isAlive() const;
+
     Status listen();
     Status listen(const uint16_t port);
 
     Status bind(const IpAddress& remoteAddress);
     Status bind(const uint16_t port);
 
+    // allows several sockets to be bound to the same port,
+    // the kernel balances incoming connections between them
+    Status setReusePort();
+
+    // sends small writes at once instead of holding them until the previous ones are acknowledged
+    Status setNoDelay();
+
     Status accept(TcpSocket* client);
 
     Status send(const char *data, const std::size_t size, std::size_t* sent);
     Status receive(char *data, const std::size_t size, std::size_t* received);
 
+    // zero-copy transfer between the socket and a pipe with splice(2)
+    Status sendFromPipe(const int pipe_fd, const std::size_t size, std::size_t* sent);
+    Status receiveToPipe(const int pipe_fd, const std::size_t size, std::size_t* received);
+
+    // zero-copy transfer from a file with sendfile(2), the offset is advanced by the number of sent bytes
+    Status sendFile(const int file_fd, uint64_t* offset, const std::size_t size, std::size_t* sent);
+
     uint16_t getRemotePort() const;
     std::string getRemoteAddress() const;
 
@@ -48,6 +72,7 @@ private:
     std::string m_remote_host;
 
     friend class Selector;
+    friend class UpstreamPool;
 
     // TODO
     friend class Proxy;
@@ -0,0 +1,267 @@
+#include "timerwheel.hpp"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+TimerWheel::Timer::Timer()
+    : m_wheel(nullptr)
+    , m_prev(nullptr)
+    , m_next(nullptr)
+    , m_expires(0)
+    , m_level(0)
+    , m_slot(0)
+{}
+
+TimerWheel::Timer::~Timer()
+{
+    if (m_wheel != nullptr)
+    {
+        m_wheel->cancel(this);
+    }
+}
+
+TimerWheel::Timer::Timer(Timer&&)
+    : Timer()
+{}
+
+TimerWheel::Timer& TimerWheel::Timer::operator= (Timer&&)
+{
+    if (m_wheel != nullptr)
+    {
+        m_wheel->cancel(this);
+    }
+    return *this;
+}
+
+bool TimerWheel::Timer::is_armed() const { return m_wheel != nullptr; }
+
+TimerWheel::TimerWheel()
+    : m_start(Clock::now())
+    , m_now(0)
+    , m_size(0)
+{
+    for (int level = 0; level < m_levels; ++level)
+    {
+        m_occupied[level] = 0;
+        for (int slot = 0; slot < m_slots; ++slot)
+        {
+            m_wheel[level][slot] = nullptr;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    // the timers may outlive the wheel, they just forget it
+    for (int level = 0; level < m_levels; ++level)
+    {
+        for (int slot = 0; slot < m_slots; ++slot)
+        {
+            for (auto timer = m_wheel[level][slot]; timer != nullptr; timer = timer->m_next)
+            {
+                timer->m_wheel = nullptr;
+            }
+        }
+    }
+}
+
+void TimerWheel::arm(Timer* timer, const std::chrono::milliseconds delay)
+{
+    if (timer->m_wheel != nullptr)
+    {
+        unlink(timer);
+    }
+
+    // a deadline in the past expires on the next tick, the current one may have been handled already
+    const auto now = get_tick();
+    const auto ticks = delay.count() > 0 ? static_cast<uint64_t>(delay.count()) : 0;
+    timer->m_expires = std::max(now + ticks, m_now + 1);
+    timer->m_wheel = this;
+    insert(timer);
+    ++m_size;
+}
+
+void TimerWheel::cancel(Timer* timer)
+{
+    if (timer->m_wheel == nullptr)
+    {
+        return;
+    }
+
+    assert(timer->m_wheel == this);
+    unlink(timer);
+    timer->m_wheel = nullptr;
+    --m_size;
+}
+
+int TimerWheel::get_timeout() const
+{
+    if (m_size == 0)
+    {
+        return -1;
+    }
+
+    const auto next = get_next_tick();
+    const auto now = get_tick();
+    if (next <= now)
+    {
+        return 0;
+    }
+
+    return static_cast<int>(std::min<uint64_t>(next - now, INT_MAX));
+}
+
+void TimerWheel::expire()
+{
+    const auto target = get_tick();
+    while (m_size != 0 && m_now < target)
+    {
+        // the ticks without anything to do are skipped
+        const auto next = get_next_tick();
+        if (next > target)
+        {
+            break;
+        }
+        m_now = next;
+
+        // the higher levels go first, their timers may land in the lower slots of this tick
+        int top = 0;
+        while (top + 1 < m_levels && (m_now & ((uint64_t(1) << (m_slot_bits * (top + 1))) - 1)) == 0)
+        {
+            ++top;
+        }
+        for (int level = top; level > 0; --level)
+        {
+            cascade(level);
+        }
+
+        // the handlers may change any timers, so the slot is read again after every one
+        auto& slot = m_wheel[0][m_now & (m_slots - 1)];
+        while (slot != nullptr)
+        {
+            auto timer = slot;
+            unlink(timer);
+            if (timer->m_expires > m_now)
+            {
+                insert(timer);
+                continue;
+            }
+
+            timer->m_wheel = nullptr;
+            --m_size;
+            if (timer->handler)
+            {
+                timer->handler();
+            }
+        }
+    }
+
+    m_now = std::max(m_now, target);
+}
+
+std::size_t TimerWheel::size() const { return m_size; }
+
+uint64_t TimerWheel::get_tick() const
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_start).count());
+}
+
+uint64_t TimerWheel::get_next_tick() const
+{
+    // the first tick after now when a slot of any level has to be looked at
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < m_levels; ++level)
+    {
+        const auto occupied = m_occupied[level];
+        if (occupied == 0)
+        {
+            continue;
+        }
+
+        const int shift = m_slot_bits * level;
+        const int turn_shift = shift + m_slot_bits;
+        const auto index = (m_now >> shift) & (m_slots - 1);
+        const auto turn = turn_shift < 64 ? (m_now >> turn_shift) << turn_shift : 0;
+
+        const auto later = index + 1 < m_slots ? occupied & (~uint64_t(0) << (index + 1)) : 0;
+        uint64_t tick = 0;
+        if (later != 0)
+        {
+            tick = turn + (static_cast<uint64_t>(__builtin_ctzll(later)) << shift);
+        }
+        else
+        {
+            // the slot comes in the next turn of the level
+            tick = turn + (uint64_t(1) << turn_shift) + (static_cast<uint64_t>(__builtin_ctzll(occupied)) << shift);
+        }
+
+        next = std::min(next, tick);
+    }
+
+    return next;
+}
+
+void TimerWheel::insert(Timer* timer)
+{
+    // the lowest level whose current turn has the deadline, the farthest ones stay in the top level
+    int level = 0;
+    while (level + 1 < m_levels && (timer->m_expires >> (m_slot_bits * (level + 1))) != (m_now >> (m_slot_bits * (level + 1))))
+    {
+        ++level;
+    }
+
+    const auto slot = static_cast<uint8_t>((timer->m_expires >> (m_slot_bits * level)) & (m_slots - 1));
+    auto& head = m_wheel[level][slot];
+    timer->m_level = static_cast<uint8_t>(level);
+    timer->m_slot = slot;
+    timer->m_prev = nullptr;
+    timer->m_next = head;
+    if (head != nullptr)
+    {
+        head->m_prev = timer;
+    }
+    head = timer;
+    m_occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::unlink(Timer* timer)
+{
+    auto& head = m_wheel[timer->m_level][timer->m_slot];
+    if (timer->m_prev != nullptr)
+    {
+        timer->m_prev->m_next = timer->m_next;
+    }
+    else
+    {
+        head = timer->m_next;
+    }
+
+    if (timer->m_next != nullptr)
+    {
+        timer->m_next->m_prev = timer->m_prev;
+    }
+
+    if (head == nullptr)
+    {
+        m_occupied[timer->m_level] &= ~(uint64_t(1) << timer->m_slot);
+    }
+
+    timer->m_prev = nullptr;
+    timer->m_next = nullptr;
+}
+
+void TimerWheel::cascade(const int level)
+{
+    // the slot is taken as a whole, the farthest timers may go back to it
+    const auto slot = (m_now >> (m_slot_bits * level)) & (m_slots - 1);
+    auto timer = m_wheel[level][slot];
+    m_wheel[level][slot] = nullptr;
+    m_occupied[level] &= ~(uint64_t(1) << slot);
+
+    while (timer != nullptr)
+    {
+        auto next = timer->m_next;
+        insert(timer);
+        timer = next;
+    }
+}
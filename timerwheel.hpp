@@ -0,0 +1,94 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Hierarchical timer wheel with millisecond ticks. Every level has 64 slots, a slot of the first level
+// is one tick, a slot of the next level is a whole turn of the previous one. A timer is kept in the lowest level
+// whose turn its deadline is in and moves down when the turn of its slot comes, so arming, cancelling
+// and expiring take constant time however many timers there are. Timers are intrusive and never allocate.
+class TimerWheel final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Timer final
+    {
+    public:
+        Timer();
+        ~Timer();
+
+        // a timer belongs to its place, an assigned timer is cancelled and keeps its handler,
+        // so an object that owns a timer may be reset by assignment
+        Timer(Timer&& other);
+        Timer& operator= (Timer&& other);
+
+        Timer(const Timer&) = delete;
+        Timer& operator= (const Timer&) = delete;
+
+        bool is_armed() const;
+
+        // called when the timer expires, the timer is not armed anymore
+        std::function<void()> handler;
+
+    private:
+        friend class TimerWheel;
+
+        TimerWheel* m_wheel;
+        Timer* m_prev;
+        Timer* m_next;
+        uint64_t m_expires;
+        uint8_t m_level;
+        uint8_t m_slot;
+    };
+
+public:
+    TimerWheel();
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator= (const TimerWheel&) = delete;
+
+    // an armed timer is moved to the new deadline
+    void arm(Timer* timer, const std::chrono::milliseconds delay);
+    void cancel(Timer* timer);
+
+    // milliseconds until the next timer may expire, -1 if there are no timers, it suits epoll_wait
+    int get_timeout() const;
+
+    // calls the handlers of the expired timers, the handlers may arm and cancel any timers
+    void expire();
+
+    std::size_t size() const;
+
+private:
+    static const int m_levels = 5;
+    static const int m_slot_bits = 6;
+    static const int m_slots = 1 << m_slot_bits;
+
+private:
+    uint64_t get_tick() const;
+    uint64_t get_next_tick() const;
+
+    void insert(Timer* timer);
+    void unlink(Timer* timer);
+    void cascade(const int level);
+
+private:
+    Clock::time_point m_start;
+
+    // the last tick whose timers have expired
+    uint64_t m_now;
+
+    Timer* m_wheel[m_levels][m_slots];
+
+    // the non-empty slots of every level
+    uint64_t m_occupied[m_levels];
+
+    std::size_t m_size;
+};
+
+#endif // TIMER_WHEEL_HPP
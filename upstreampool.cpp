@@ -0,0 +1,171 @@
+#include "upstreampool.hpp"
+#include "counter.hpp"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <utility>
+
+UpstreamPool::Counters& UpstreamPool::Counters::operator+= (const Counters& other)
+{
+    reused += other.reused;
+    missed += other.missed;
+    expired += other.expired;
+    broken += other.broken;
+    return *this;
+}
+
+UpstreamPool::UpstreamPool(Selector& selector, const std::size_t max_idle_per_host, const Clock::duration idle_timeout)
+    : m_selector(selector)
+    , m_max_idle_per_host(max_idle_per_host)
+    , m_idle_timeout(idle_timeout)
+    , m_connections(m_connections_per_slab)
+    , m_reused(0)
+    , m_missed(0)
+    , m_expired(0)
+    , m_broken(0)
+{}
+
+UpstreamPool::~UpstreamPool()
+{
+    for (auto& pair : m_idle)
+    {
+        for (auto idle : pair.second)
+        {
+            release(idle);
+        }
+    }
+}
+
+std::unique_ptr<TcpSocket> UpstreamPool::checkout(const std::string& host, const uint16_t port)
+{
+    auto it = m_idle.find(make_key(host, port));
+    if (it == m_idle.end())
+    {
+        add_counter(m_missed, 1);
+        return nullptr;
+    }
+
+    auto& idle_list = it->second;
+    const auto now = Clock::now();
+    while (!idle_list.empty())
+    {
+        auto idle = idle_list.back();
+        idle_list.pop_back();
+        auto socket = std::move(idle->socket);
+        const auto since = idle->since;
+        m_selector.remove(*socket);
+        m_connections.destroy(idle);
+
+        if (since + m_idle_timeout <= now)
+        {
+            add_counter(m_expired, 1);
+        }
+        else if (!socket->isAlive())
+        {
+            // the server has closed the connection, but its event has not been handled yet
+            add_counter(m_broken, 1);
+        }
+        else
+        {
+            add_counter(m_reused, 1);
+            erase_if_empty(it);
+            return socket;
+        }
+    }
+
+    erase_if_empty(it);
+    add_counter(m_missed, 1);
+    return nullptr;
+}
+
+void UpstreamPool::checkin(const std::string& host, const uint16_t port, std::unique_ptr<TcpSocket>&& socket)
+{
+    if (!is_enabled())
+    {
+        return;
+    }
+
+    const auto now = Clock::now();
+    auto& entry = *m_idle.emplace(make_key(host, port), IdleList()).first;
+    auto& idle_list = entry.second;
+
+    // the oldest connections are at the front, they are dropped first
+    close_expired(idle_list, now);
+    if (idle_list.size() >= m_max_idle_per_host)
+    {
+        release(idle_list.front());
+        idle_list.erase(idle_list.begin());
+    }
+
+    // any event on an idle connection means that it can't be used anymore
+    auto idle = m_connections.create(this, &entry, std::move(socket), now);
+    m_selector.add(*idle->socket, EPOLLIN | EPOLLRDHUP, idle);
+    idle_list.push_back(idle);
+}
+
+void UpstreamPool::close_expired()
+{
+    const auto now = Clock::now();
+    for (auto it = m_idle.begin(); it != m_idle.end();)
+    {
+        close_expired(it->second, now);
+        it = it->second.empty() ? m_idle.erase(it) : std::next(it);
+    }
+}
+
+void UpstreamPool::close_expired(IdleList& idle_list, const Clock::time_point now)
+{
+    auto alive = std::find_if(idle_list.begin(), idle_list.end(),
+                              [this, now](const Idle* idle) { return idle->since + m_idle_timeout > now; });
+    std::for_each(idle_list.begin(), alive, [this](Idle* idle) { release(idle); });
+    add_counter(m_expired, alive - idle_list.begin());
+    idle_list.erase(idle_list.begin(), alive);
+}
+
+void UpstreamPool::set_max_idle_per_host(const std::size_t max_idle_per_host) { m_max_idle_per_host = max_idle_per_host; }
+
+bool UpstreamPool::is_enabled() const { return m_max_idle_per_host > 0; }
+
+UpstreamPool::Counters UpstreamPool::get_counters() const
+{
+    Counters counters;
+    counters.reused = m_reused.load(std::memory_order_relaxed);
+    counters.missed = m_missed.load(std::memory_order_relaxed);
+    counters.expired = m_expired.load(std::memory_order_relaxed);
+    counters.broken = m_broken.load(std::memory_order_relaxed);
+    return counters;
+}
+
+void UpstreamPool::handle_idle_event(Idle* idle)
+{
+    auto host = idle->host;
+    auto& idle_list = host->second;
+    auto it = std::find(idle_list.begin(), idle_list.end(), idle);
+    assert(it != idle_list.end());
+
+    idle_list.erase(it);
+    release(idle);
+    add_counter(m_broken, 1);
+    erase_if_empty(m_idle.find(host->first));
+}
+
+void UpstreamPool::release(Idle* idle)
+{
+    m_selector.remove(*idle->socket);
+    m_connections.destroy(idle);
+}
+
+void UpstreamPool::erase_if_empty(IdleMap::iterator it)
+{
+    if (it->second.empty())
+    {
+        m_idle.erase(it);
+    }
+}
+
+void UpstreamPool::Idle::handle_event(const uint32_t) { pool->handle_idle_event(this); }
+
+std::string UpstreamPool::make_key(const std::string& host, const uint16_t port)
+{
+    return host + ":" + std::to_string(port);
+}
@@ -0,0 +1,125 @@
+#ifndef UPSTREAM_POOL_HPP
+#define UPSTREAM_POOL_HPP
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tcpsocket.hpp"
+#include "selector.hpp"
+#include "slabpool.hpp"
+
+// Idle keep-alive connections to servers, grouped by host and port.
+// Idle sockets are watched by the selector, so the ones closed by the server are dropped at once.
+class UpstreamPool final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Counters
+    {
+        Counters()
+            : reused(0)
+            , missed(0)
+            , expired(0)
+            , broken(0)
+        {}
+
+        Counters& operator+= (const Counters& other);
+
+        uint64_t reused;
+        uint64_t missed;
+        uint64_t expired; // closed after the idle timeout
+        uint64_t broken;  // closed by the server or failed the health check
+    };
+
+public:
+    UpstreamPool(Selector& selector, const std::size_t max_idle_per_host, const Clock::duration idle_timeout);
+    ~UpstreamPool();
+
+    UpstreamPool(const UpstreamPool&) = delete;
+    UpstreamPool& operator= (const UpstreamPool&) = delete;
+
+    // the most recently returned alive connection, nullptr if there is none,
+    // the socket is not in the selector anymore
+    std::unique_ptr<TcpSocket> checkout(const std::string& host, const uint16_t port);
+
+    // the socket must not be in the selector, it is closed if the pool is full
+    void checkin(const std::string& host, const uint16_t port, std::unique_ptr<TcpSocket>&& socket);
+
+    // closes connections that have been idle for too long
+    void close_expired();
+
+    void set_max_idle_per_host(const std::size_t max_idle_per_host);
+
+    bool is_enabled() const;
+
+    // may be called from any thread
+    Counters get_counters() const;
+
+private:
+    struct Idle;
+
+    using IdleList = std::vector<Idle*>;
+    using IdleMap = std::unordered_map<std::string, IdleList>;
+
+    // an idle connection watches its socket itself, so the event of a closed one leads straight to it
+    struct Idle final : public Selector::Handler
+    {
+        Idle(UpstreamPool* _pool, IdleMap::value_type* _host, std::unique_ptr<TcpSocket>&& _socket, const Clock::time_point _since)
+            : pool(_pool)
+            , host(_host)
+            , socket(std::move(_socket))
+            , since(_since)
+        {}
+
+        void handle_event(const uint32_t events) override;
+
+        UpstreamPool* pool;
+        IdleMap::value_type* host;
+        std::unique_ptr<TcpSocket> socket;
+        Clock::time_point since;
+    };
+
+private:
+    void handle_idle_event(Idle* idle);
+
+    void close_expired(IdleList& idle_list, const Clock::time_point now);
+
+    // removes the connection from the selector and destroys it, the caller erases it from its list
+    void release(Idle* idle);
+
+    // a host without idle connections is forgotten, so the map doesn't grow with every server ever visited
+    void erase_if_empty(IdleMap::iterator it);
+
+    static std::string make_key(const std::string& host, const uint16_t port);
+
+private:
+    Selector& m_selector;
+
+    std::size_t m_max_idle_per_host;
+    Clock::duration m_idle_timeout;
+
+    static const std::size_t m_connections_per_slab = 64;
+
+    SlabPool<Idle> m_connections;
+
+    // the most recently returned connections are at the back, the connections point to the entries
+    // of their hosts, which stay in place when the map is rehashed
+    IdleMap m_idle;
+
+    // written only by the thread owning the pool
+    std::atomic<uint64_t> m_reused;
+    std::atomic<uint64_t> m_missed;
+    std::atomic<uint64_t> m_expired;
+    std::atomic<uint64_t> m_broken;
+};
+
+#endif // UPSTREAM_POOL_HPP